@@ -0,0 +1,40 @@
+/*
+ * PgBouncer - Lightweight connection pooler for PostgreSQL.
+ *
+ * Copyright (c) 2007-2009  Marko Kreen, Skype Technologies OÜ
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Cache of auth_query results, keyed by database and user name, and
+ * coalescing of concurrent lookups of the same user.
+ */
+
+enum AuthCacheResult {
+	AUTH_CACHE_MISS,	/* nothing usable cached, run auth_query */
+	AUTH_CACHE_FOUND,	/* cached secret returned */
+	AUTH_CACHE_NOT_FOUND,	/* auth_query recently returned no row */
+};
+
+enum AuthCacheResult auth_cache_lookup(PgDatabase *db, const char *user, const char **passwd_p);
+void auth_cache_store(PgDatabase *db, const char *user, const char *passwd);
+void auth_cache_forget(PgDatabase *db, const char *user);
+void auth_cache_expire(void);
+void auth_cache_reset(void);
+
+bool auth_query_join(PgSocket *client, const char *user);
+void auth_query_lead(PgSocket *client, const char *user);
+void auth_query_done(PgSocket *client);
+void auth_query_abandon(PgSocket *client);
+void auth_query_resume_waiters(void);
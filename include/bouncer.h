@@ -149,6 +149,17 @@ enum LoadBalanceHosts {
 	LOAD_BALANCE_HOSTS_ROUND_ROBIN
 };
 
+enum ServerCompression {
+	SERVER_COMPRESSION_DISABLE,
+	SERVER_COMPRESSION_ENABLE,	/* only on connections without TLS */
+	SERVER_COMPRESSION_ALWAYS
+};
+
+enum ReadOnlyRouting {
+	READ_ONLY_ROUTING_EXPLICIT,	/* BEGIN READ ONLY, default_transaction_read_only */
+	READ_ONLY_ROUTING_SELECT	/* also single SELECT statements */
+};
+
 #define is_server_socket(sk) ((sk)->state >= SV_FREE)
 
 
@@ -164,20 +175,28 @@ typedef enum PacketCallbackFlag PacketCallbackFlag;
 typedef struct PktHdr PktHdr;
 typedef struct PktBuf PktBuf;
 typedef struct ScramState ScramState;
+typedef struct PgLoginState PgLoginState;
 typedef struct PgPreparedStatement PgPreparedStatement;
 typedef enum ResponseAction ResponseAction;
 typedef enum ReplicationType ReplicationType;
+typedef struct OutstandingRequest OutstandingRequest;
 
 extern int cf_sbuf_len;
+extern int cf_sbuf_len_max;
+extern int cf_slab_free_target;
+extern unsigned int cf_huge_page_arena_size;
 
 #include "util.h"
+#include "timerwheel.h"
 #include "iobuf.h"
+#include "spool.h"
 #include "sbuf.h"
 #include "pktbuf.h"
 #include "varcache.h"
 #include "dnslookup.h"
 
 #include "admin.h"
+#include "authcache.h"
 #include "loader.h"
 #include "client.h"
 #include "server.h"
@@ -192,6 +211,9 @@ extern int cf_sbuf_len;
 #include "messages.h"
 #include "pam.h"
 #include "prepare.h"
+#include "prewarm.h"
+#include "route.h"
+#include "arena.h"
 
 #ifndef WIN32
 #define DEFAULT_UNIX_SOCKET_DIR "/tmp"
@@ -258,6 +280,8 @@ enum auth_type {
 #define PKT_CANCEL      80877102
 #define PKT_SSLREQ      80877103
 #define PKT_GSSENCREQ   80877104
+#define PKT_PEER_LINK   80877150	/* pgbouncer-only, see peer_link */
+#define PKT_COMPRESSREQ 80877151	/* pgbouncer-only, see want_server_compression() */
 
 #define POOL_SESSION    0
 #define POOL_TX         1
@@ -338,8 +362,13 @@ struct PgStats {
 	uint64_t ps_server_parse_count;
 	uint64_t ps_client_parse_count;
 	uint64_t ps_bind_count;
+	uint64_t ps_describe_cache_hit_count;
 
 	uint64_t client_login_count;
+	uint64_t client_tls_login_count;
+	uint64_t client_tls_resumed_count;
+	uint64_t server_tls_connect_count;
+	uint64_t server_tls_resumed_count;
 };
 
 /*
@@ -354,6 +383,7 @@ struct PgStats {
 struct PgPool {
 	struct List head;			/* entry in global pool_list */
 	struct List map_head;			/* entry in user->pool_list */
+	struct List ready_head;			/* entry in janitor's list of pools needing per-loop work */
 
 	PgDatabase *db;			/* corresponding database */
 	/*
@@ -409,6 +439,15 @@ struct PgPool {
 	 */
 	struct StatList active_cancel_server_list;
 
+	/*
+	 * Connections that are opened ahead of time for cancel requests (see
+	 * cancel_pool_size) after one arrived, both while connecting and once
+	 * connected.  They
+	 * are not part of the pool or database and user limits until one of
+	 * them is used for a request and moved to active_cancel_server_list.
+	 */
+	struct StatList cancel_standby_server_list;
+
 	/*
 	 * Servers that normally could become idle, to be linked with with a new
 	 * server. But active_cancel_server_list still contains servers that have a
@@ -476,7 +515,19 @@ struct PgPool {
 
 	bool welcome_msg_ready : 1;
 
+	/* connections opened for cancel requests in the current second */
+	usec_t cancel_rate_start;
+	int cancel_rate_count;
+	usec_t last_cancel_time;	/* standbys are kept for a while after it */
+
 	uint16_t rrcounter;		/* round-robin counter */
+
+	/*
+	 * Expected busy servers per time of day slot, learned from the stats
+	 * when predictive_prewarm is enabled.  LOAD_PROFILE_SLOTS entries,
+	 * NULL until the pool has a profile.  See prewarm.c.
+	 */
+	uint16_t *load_profile;
 };
 
 /*
@@ -586,6 +637,10 @@ struct PgGlobalUser {
 	int max_user_client_connections;	/* how many client connections are allowed */
 	int connection_count;	/* how many server connections are used by user now */
 	int client_connection_count;	/* how many client connections are used by user now */
+
+	/* evictable servers of all pools, oldest first, see evict_user_connection() */
+	struct StatList evict_idle_server_list;	/* idle servers */
+	struct StatList evict_used_server_list;	/* used and tested servers */
 };
 
 /*
@@ -619,6 +674,10 @@ struct PgDatabase {
 	usec_t server_lifetime;	/* max lifetime of server connection */
 	char *connect_query;	/* startup commands to send to server after connect */
 	enum LoadBalanceHosts load_balance_hosts;	/* strategy for host selection in a comma-separated host list */
+	enum ServerCompression server_compression;	/* ask the upstream PgBouncer for compression */
+	char *replicas;		/* if not NULL, comma-separated databases that take read-only transactions */
+	PgDatabase **replica_list;	/* the databases of replicas=, see resolve_replicas() */
+	int replica_count;
 
 	struct PktBuf *startup_params;	/* partial StartupMessage (without user) be sent to server */
 	const char *dbname;	/* server-side name, pointer to inside startup_msg */
@@ -643,6 +702,10 @@ struct PgDatabase {
 	int client_connection_count;	/* total client connections for this database */
 
 	struct AATree user_tree;	/* users that have been queried on this database */
+
+	/* evictable servers of all pools, oldest first, see evict_connection() */
+	struct StatList evict_idle_server_list;	/* idle servers */
+	struct StatList evict_used_server_list;	/* used and tested servers */
 };
 
 enum ResponseAction {
@@ -661,8 +724,7 @@ enum ResponseAction {
 	RA_FAKE,
 };
 
-typedef struct OutstandingRequest {
-	struct List node;
+struct OutstandingRequest {
 	char type;	/* The single character type of the request */
 	ResponseAction action;	/* What action to take (see comments on ResponseAction) */
 	/*
@@ -673,7 +735,33 @@ typedef struct OutstandingRequest {
 	PgServerPreparedStatement *server_ps;
 
 	uint64_t server_ps_query_id;
-} OutstandingRequest;
+
+	/*
+	 * Statement this Describe is about, if its response is to be cached
+	 * (RA_FORWARD) or answered from the cache (RA_FAKE).  Holds a
+	 * reference.  describe_buf collects the response while it arrives.
+	 */
+	PgPreparedStatement *describe_ps;
+	uint8_t *describe_buf;
+	unsigned describe_len;
+};
+
+/* requests kept inside PgSocket, a longer pipeline moves to the heap */
+#define OUTSTANDING_INLINE_SLOTS 4
+
+/*
+ * Ring of outstanding requests, oldest at head.  The slots are in
+ * inline_slots until the queue outgrows them, then in heap_slots, which
+ * is doubled when full and kept until the server is freed.  Sizes are
+ * powers of two.
+ */
+struct OutstandingQueue {
+	OutstandingRequest *heap_slots;
+	unsigned heap_size;
+	unsigned head;
+	unsigned count;
+	OutstandingRequest inline_slots[OUTSTANDING_INLINE_SLOTS];
+};
 
 enum ReplicationType {
 	REPLICATION_NONE = 0,
@@ -683,25 +771,58 @@ enum ReplicationType {
 
 extern const char *replication_type_parameters[3];
 
+/*
+ * Connection state that is only needed while logging in.  It is
+ * allocated on first use by socket_login_state() and released when the
+ * login is done, so established connections do not carry it.
+ */
+struct PgLoginState {
+	struct ScramState {
+		/* Common fields used in both client and server roles */
+		char *client_nonce;
+		char *client_first_message_bare;
+		char *client_final_message_without_proof;
+		char *server_nonce;
+		char *server_first_message;
+		int iterations;
+		pg_cryptohash_type hash_type;
+		int key_length;
+
+		/* Client-side fields (when PgBouncer connects to PostgreSQL) */
+		uint8_t *salt;	/* binary salt */
+		int saltlen;	/* length of salt */
+		uint8_t *SaltedPassword;
+
+		/* Server-side fields (when clients connect to PgBouncer) */
+		char cbind_flag;
+		bool adhoc;	/* SCRAM data made up from plain-text password */
+		char *encoded_salt;	/* base64-encoded salt for server messages */
+		uint8_t ClientKey[32];
+		uint8_t StoredKey[32];
+		uint8_t ServerKey[32];
+	} scram_state;
+	char auth_query_user[MAX_USERNAME];	/* user name auth_query was run for */
+	struct AuthQueryFlight *auth_query_flight;	/* lookup run by this client, see authcache.c */
+	struct List auth_query_node;	/* waiting for the lookup of another client */
+	PgSocket *auth_query_waiter;	/* set while auth_query_node is linked */
+#ifdef HAVE_LDAP
+	char ldap_options[MAX_LDAP_CONFIG];
+#endif
+};
+
 /*
  * A client or server connection.
  *
  * ->state corresponds to various lists the struct can be at.
+ *
+ * Fields used for every packet come first, so the forwarding path and
+ * the list walks touch as few cache lines as possible.
  */
 struct PgSocket {
 	struct List head;		/* list header for pool list */
-	struct List cancel_head;	/* list header for server->canceling_clients */
 	PgSocket *link;		/* the dest of packets */
 	PgPool *pool;		/* parent pool, if NULL not yet assigned */
 
-	PgCredentials *login_user_credentials;	/* presented login, for client it may differ from pool->user */
-
-	unsigned long long int id;	/* unique numeric ID used to identify PgSocket instance */
-	int client_auth_type;	/* auth method decided by hba */
-
-	/* the queue of requests that we still expect a server response for */
-	struct StatList outstanding_requests;
-
 	SocketState state : 8;		/* this also specifies socket location */
 
 	bool contributes_db_client_count : 1;
@@ -712,6 +833,7 @@ struct PgSocket {
 	bool close_needed : 1;		/* server: this socket must be closed ASAP */
 	bool setting_vars : 1;		/* server: setting client vars */
 	bool exec_on_connect : 1;	/* server: executing connect_query */
+	bool preparing_hot_statements : 1;	/* server: preparing statements after login */
 	bool resetting : 1;		/* server: executing reset query from auth login; don't release on flush */
 	bool copy_mode : 1;		/* server: in copy stream, ignores Sync packets until CopyDone/CopyFail;
 					   client: in copy-in stream, expecting CopyData/CopyDone/CopyFail */
@@ -725,6 +847,7 @@ struct PgSocket {
 	bool wait_for_user_conn : 1;	/* client: waiting for auth_conn server connection */
 	bool wait_for_user : 1;		/* client: waiting for auth_conn query results */
 	bool wait_for_auth : 1;		/* client: waiting for external auth (PAM/LDAP) to be completed */
+	bool auth_query_cached : 1;	/* client: secret was taken from the auth_query cache */
 
 	bool suspended : 1;		/* client/server: if the socket is suspended */
 
@@ -735,17 +858,47 @@ struct PgSocket {
 	bool wait_for_response : 1;	/* console client: waits for completion of PAUSE/SUSPEND cmd */
 
 	bool wait_sslchar : 1;		/* server: waiting for ssl response: S/N */
+	bool wait_compresschar : 1;	/* server: waiting for compression response: Z/N */
+	bool peer_link : 1;		/* client/server: long-lived link that carries cancel requests between peers */
+	bool cancel_standby : 1;	/* server: in pool->cancel_standby_server_list */
 	/* server: received an ErrorResponse, waiting for ReadyForQuery to clear
 	 * the outstanding requests until the next Sync */
 	bool query_failed : 1;
 
 	ReplicationType replication;	/* If this is a replication connection */
-	char *startup_options;	/* only tracked for replication connections */
 
-	usec_t connect_time;	/* when connection was made */
+	union {
+		struct DNSToken *dns_token;	/* ongoing request */
+		PgDatabase *db;			/* cache db while doing auth query */
+	};
+
+	/* the queue of requests that we still expect a server response for */
+	struct OutstandingQueue outstanding_requests;
+
 	usec_t request_time;	/* last activity time */
 	usec_t query_start;	/* client: query start moment */
 	usec_t xact_start;	/* client: xact start moment */
+
+	VarCache vars;		/* state of interesting server parameters */
+
+	/* client: prepared statements prepared by this client */
+	PgClientPreparedStatement *client_prepared_statements;
+	/* server: prepared statements prepared on this server */
+	PgServerPreparedStatement *server_prepared_statements;
+
+	struct List cancel_head;	/* list header for server->canceling_clients */
+	struct List evict_db_head;	/* server: list header for db eviction list */
+	struct List evict_user_head;	/* server: list header for user eviction list */
+	struct TimerEntry timeout;	/* timer for the nearest timeout of its state */
+
+	PgCredentials *login_user_credentials;	/* presented login, for client it may differ from pool->user */
+
+	unsigned long long int id;	/* unique numeric ID used to identify PgSocket instance */
+	int client_auth_type;	/* auth method decided by hba */
+
+	char *startup_options;	/* only tracked for replication connections */
+
+	usec_t connect_time;	/* when connection was made */
 	usec_t wait_start;	/* client: waiting start moment */
 
 	uint8_t cancel_key[BACKENDKEY_LEN];	/* client: generated, server: remote */
@@ -757,45 +910,10 @@ struct PgSocket {
 
 	char *host;
 
-	union {
-		struct DNSToken *dns_token;	/* ongoing request */
-		PgDatabase *db;			/* cache db while doing auth query */
-	};
-
-	struct ScramState {
-		/* Common fields used in both client and server roles */
-		char *client_nonce;
-		char *client_first_message_bare;
-		char *client_final_message_without_proof;
-		char *server_nonce;
-		char *server_first_message;
-		int iterations;
-		pg_cryptohash_type hash_type;
-		int key_length;
-
-		/* Client-side fields (when PgBouncer connects to PostgreSQL) */
-		uint8_t *salt;	/* binary salt */
-		int saltlen;	/* length of salt */
-		uint8_t *SaltedPassword;
-
-		/* Server-side fields (when clients connect to PgBouncer) */
-		char cbind_flag;
-		bool adhoc;	/* SCRAM data made up from plain-text password */
-		char *encoded_salt;	/* base64-encoded salt for server messages */
-		uint8_t ClientKey[32];
-		uint8_t StoredKey[32];
-		uint8_t ServerKey[32];
-	} scram_state;
-#ifdef HAVE_LDAP
-	char ldap_options[MAX_LDAP_CONFIG];
-#endif
-
-	VarCache vars;		/* state of interesting server parameters */
+	PgLoginState *login_state;	/* login-only state, NULL when not logging in */
 
-	/* client: prepared statements prepared by this client */
-	PgClientPreparedStatement *client_prepared_statements;
-	/* server: prepared statements prepared on this server */
-	PgServerPreparedStatement *server_prepared_statements;
+	/* server: ParseComplete count while preparing hot statements after login */
+	int hot_statements_prepared;
 
 	/* cb state during SBUF_EV_PKT_CALLBACK processing */
 	struct CallbackState {
@@ -818,6 +936,9 @@ struct PgSocket {
 #define RAW_IOBUF_SIZE  offsetof(IOBuf, buf)
 #define IOBUF_SIZE      (RAW_IOBUF_SIZE + cf_sbuf_len)
 
+/* IOBuf size classes, pkt_buf doubled until pkt_buf_max */
+#define MAX_IOBUF_CLASSES	8
+
 /* where to store old fd info during SHOW FDS result processing */
 #define tmp_sk_oldfd    request_time
 #define tmp_sk_linkfd   query_start
@@ -841,8 +962,11 @@ extern char *cf_listen_addr;
 extern int cf_listen_port;
 extern int cf_listen_backlog;
 extern int cf_peer_id;
+extern int cf_peer_link;
+extern char *cf_peer_link_secret;
 
 extern int cf_pool_mode;
+extern int cf_read_only_routing;
 extern int cf_max_client_conn;
 extern int cf_default_pool_size;
 extern int cf_min_pool_size;
@@ -870,6 +994,9 @@ extern usec_t cf_server_login_retry;
 extern usec_t cf_query_timeout;
 extern usec_t cf_query_wait_timeout;
 extern usec_t cf_cancel_wait_timeout;
+extern int cf_cancel_pool_size;
+extern usec_t cf_cancel_standby_lifetime;
+extern int cf_cancel_rate_limit;
 extern usec_t cf_client_idle_timeout;
 extern usec_t cf_pool_idle_timeout;
 extern usec_t cf_client_login_timeout;
@@ -888,6 +1015,9 @@ extern char *cf_resolv_conf;
 extern int cf_auth_type;
 extern char *cf_auth_file;
 extern char *cf_auth_query;
+extern usec_t cf_auth_query_cache_ttl;
+extern usec_t cf_auth_query_cache_negative_ttl;
+extern int cf_auth_query_cache_size;
 extern char *cf_auth_user;
 extern char *cf_auth_hba_file;
 extern char *cf_auth_dbname;
@@ -907,6 +1037,9 @@ extern int cf_shutdown;
 extern int cf_reboot;
 
 extern unsigned int cf_max_packet_size;
+extern unsigned int cf_result_spool_size;
+extern unsigned int cf_result_spool_file_size;
+extern unsigned int cf_result_spool_total_size;
 
 extern int cf_sbuf_loopcnt;
 extern int cf_so_reuseport;
@@ -923,6 +1056,8 @@ extern int cf_log_disconnections;
 extern int cf_log_pooler_errors;
 extern int cf_application_name_add_host;
 
+extern int cf_client_compression;
+
 extern int cf_client_tls_sslmode;
 extern char *cf_client_tls_protocols;
 extern char *cf_client_tls_ca_file;
@@ -932,6 +1067,8 @@ extern char *cf_client_tls_ciphers;
 extern char *cf_client_tls13_ciphers;
 extern char *cf_client_tls_dheparams;
 extern char *cf_client_tls_ecdhecurve;
+extern usec_t cf_client_tls_session_lifetime;
+extern int cf_client_tls_session_cache_size;
 
 extern int cf_server_tls_sslmode;
 extern char *cf_server_tls_protocols;
@@ -942,9 +1079,18 @@ extern char *cf_server_tls_ciphers;
 extern char *cf_server_tls13_ciphers;
 
 extern int cf_max_prepared_statements;
+extern unsigned int cf_prepared_statement_cache_size;
+extern int cf_prepared_statement_describe_cache;
+extern int cf_prepared_statement_preprepare;
+
+extern int cf_predictive_prewarm;
+extern usec_t cf_predictive_prewarm_lead;
+extern char *cf_predictive_prewarm_state_file;
 
 extern const struct CfLookup pool_mode_map[];
 extern const struct CfLookup load_balance_hosts_map[];
+extern const struct CfLookup server_compression_map[];
+extern const struct CfLookup read_only_routing_map[];
 
 extern usec_t g_suspend_start;
 
@@ -965,6 +1111,34 @@ static inline PgSocket *last_socket(struct StatList *slist)
 	return container_of(slist->head.prev, PgSocket, head);
 }
 
+/* number of requests the server has not answered yet */
+static inline unsigned outstanding_request_count(const PgSocket *server)
+{
+	return server->outstanding_requests.count;
+}
+
+/* n-th outstanding request, 0 is the oldest */
+static inline OutstandingRequest *outstanding_request_at(PgSocket *server, unsigned n)
+{
+	struct OutstandingQueue *q = &server->outstanding_requests;
+
+	if (n >= q->count)
+		return NULL;
+	if (q->heap_slots)
+		return &q->heap_slots[(q->head + n) & (q->heap_size - 1)];
+	return &q->inline_slots[(q->head + n) & (OUTSTANDING_INLINE_SLOTS - 1)];
+}
+
+static inline OutstandingRequest *first_outstanding_request(PgSocket *server)
+{
+	return outstanding_request_at(server, 0);
+}
+
+static inline OutstandingRequest *last_outstanding_request(PgSocket *server)
+{
+	return outstanding_request_at(server, server->outstanding_requests.count - 1);
+}
+
 
 /*
  * cstr_skip_ws returns a pointer to the first non whitespace character
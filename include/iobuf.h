@@ -45,11 +45,14 @@
  * 0 .. done_pos         -- sent
  * done_pos .. parse_pos -- parsed, to send
  * parse_pos .. recv_pos -- received, to parse
+ * recv_pos .. size      -- free
  */
 struct iobuf {
 	unsigned done_pos;
 	unsigned parse_pos;
 	unsigned recv_pos;
+	unsigned size;		/* length of buf, depends on size class */
+	unsigned size_class;	/* index into iobuf_caches */
 	uint8_t buf[FLEX_ARRAY];
 };
 typedef struct iobuf IOBuf;
@@ -59,7 +62,7 @@ static inline bool iobuf_sane(const IOBuf *io)
 	return (io == NULL) ||
 	       (io->parse_pos >= io->done_pos
 		&& io->recv_pos >= io->parse_pos
-		&& (unsigned)cf_sbuf_len >= io->recv_pos);
+		&& io->size >= io->recv_pos);
 }
 
 static inline bool iobuf_empty(const IOBuf *io)
@@ -82,7 +85,7 @@ static inline unsigned iobuf_amount_parse(const IOBuf *buf)
 /* max possible to recv */
 static inline unsigned iobuf_amount_recv(const IOBuf *buf)
 {
-	return cf_sbuf_len - buf->recv_pos;
+	return buf->size - buf->recv_pos;
 }
 
 /* put all unparsed to mbuf */
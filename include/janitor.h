@@ -20,6 +20,11 @@ void janitor_setup(void);
 void config_postprocess(void);
 void resume_all(void);
 void per_loop_maint(void);
+void pool_mark_ready(PgPool *pool);
+void mark_db_pools_ready(PgDatabase *db);
+void client_timeout_update(PgSocket *client);
+void server_timeout_update(PgSocket *server);
+void rearm_timeouts(void);
 bool suspend_socket(PgSocket *sk, bool force)  _MUSTCHECK;
 void kill_pool(PgPool *pool);
 void kill_peer_pool(PgPool *pool);
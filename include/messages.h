@@ -4,6 +4,7 @@ typedef struct PgParsePacket {
 	const char *name;
 	size_t query_and_parameters_len;
 	const char *query_and_parameters;
+	uint32_t query_hash;	/* xxhash of query_and_parameters */
 } PgParsePacket;
 
 /* The parsed contents of a Bind ('B') packet. */
@@ -32,10 +32,11 @@ extern struct Slab *peer_pool_cache;
 extern struct Slab *pool_cache;
 extern struct Slab *user_cache;
 extern struct Slab *credentials_cache;
-extern struct Slab *iobuf_cache;
-extern struct Slab *outstanding_request_cache;
+extern struct Slab *iobuf_caches[];
+extern int iobuf_class_count;
 extern struct Slab *var_list_cache;
 extern struct Slab *server_prepared_statement_cache;
+extern struct Slab *login_state_cache;
 extern PgPreparedStatement *prepared_statements;
 
 extern unsigned long long int last_pgsocket_id;
@@ -68,9 +69,12 @@ PgDatabase *register_auto_database(const char *name);
 PgCredentials * add_dynamic_credentials(PgDatabase *db, const char *name, const char *passwd) _MUSTCHECK;
 PgCredentials * force_user_credentials(PgDatabase *db, const char *username, const char *passwd) _MUSTCHECK;
 bool add_outstanding_request(PgSocket *client, char type, ResponseAction action) _MUSTCHECK;
+bool add_outstanding_describe_request(PgSocket *client, ResponseAction action, PgPreparedStatement *ps) _MUSTCHECK;
+void free_outstanding_request(OutstandingRequest *request);
+bool take_outstanding_request(PgSocket *server, OutstandingRequest *request);
 bool pop_outstanding_request(PgSocket *client, const char types[], bool *skip);
 bool clear_outstanding_requests_until(PgSocket *server, const char types[]) _MUSTCHECK;
-bool queue_fake_response(PgSocket *client, char request_type) _MUSTCHECK;
+bool queue_fake_response(PgSocket *client, char request_type, PgPreparedStatement *ps) _MUSTCHECK;
 
 PgGlobalUser * update_global_user_passwd(PgGlobalUser *user, const char *passwd) _MUSTCHECK;
 PgGlobalUser * find_or_add_new_global_user(const char *name, const char *passwd) _MUSTCHECK;
@@ -79,9 +83,13 @@ PgCredentials * find_or_add_new_global_credentials(const char *name, const char
 PgCredentials * add_pam_credentials(const char *name, const char *passwd) _MUSTCHECK;
 
 void accept_cancel_request(PgSocket *req);
+bool accept_peer_link_cancel_request(PgSocket *link, const uint8_t *key) _MUSTCHECK;
 void forward_cancel_request(PgSocket *server);
+bool open_peer_link(PgSocket *server);
+void start_waiting_cancel_requests(PgPool *pool);
 
 void launch_new_connection(PgPool *pool, bool evict_if_needed);
+void launch_cancel_standby(PgPool *pool);
 
 bool use_client_socket(int fd, PgAddr *addr, const char *dbname, const char *username, uint64_t ckey, int oldfd, int linkfd,
 		       const char *client_end, const char *std_string, const char *datestyle, const char *timezone,
@@ -95,6 +103,13 @@ bool use_server_socket(int fd, PgAddr *addr, const char *dbname, const char *use
 		       const char *scram_server_key, int scram_server_key_len) _MUSTCHECK;
 
 void activate_client(PgSocket *client);
+void switch_client_pool(PgSocket *client, PgPool *pool);
+
+IOBuf *iobuf_alloc(unsigned size_class) _MUSTCHECK;
+void iobuf_free(IOBuf *io);
+
+PgLoginState *socket_login_state(PgSocket *sk) _MUSTCHECK;
+void free_login_state(PgSocket *sk);
 
 void change_client_state(PgSocket *client, SocketState newstate);
 void change_server_state(PgSocket *server, SocketState newstate);
@@ -99,6 +99,9 @@ void pktbuf_write_ExtQuery(PktBuf *buf, const char *query, int nargs, ...);
 #define pktbuf_write_CancelRequest(buf, key) \
 	pktbuf_write_generic(buf, PKT_CANCEL, "b", key, 8)
 
+#define pktbuf_write_PeerLink(buf, peer_id, secret) \
+	pktbuf_write_generic(buf, PKT_PEER_LINK, "is", peer_id, secret)
+
 #define pktbuf_write_NegotiateProtocolVersion( \
 		buf, \
 		unsupported_protocol_extensions_count, \
@@ -121,6 +124,9 @@ void pktbuf_write_ExtQuery(PktBuf *buf, const char *query, int nargs, ...);
 #define pktbuf_write_SSLRequest(buf) \
 	pktbuf_write_generic(buf, PKT_SSLREQ, "")
 
+#define pktbuf_write_CompressionRequest(buf) \
+	pktbuf_write_generic(buf, PKT_COMPRESSREQ, "")
+
 #define pktbuf_write_Parse(buf, stmt, query_and_parameters, query_and_parameters_len) \
 	pktbuf_write_generic(buf, PqMsg_Parse, "sb", stmt, query_and_parameters, query_and_parameters_len)
 
@@ -11,6 +11,14 @@ typedef struct PgPreparedStatement {
 	UT_hash_handle hh;
 	uint64_t query_id;
 	uint32_t use_count;
+	struct List unused_node;	/* position in unused LRU while use_count is 0 */
+	int hot_index;		/* position in the hot statement list, or -1 */
+	/* ParameterDescription + RowDescription/NoData, if cached */
+	uint8_t *describe_response;
+	unsigned describe_len;
+	PgPool *describe_pool;	/* pool the response was received in */
+	struct PStr *describe_search_path;	/* search_path it was received with, if tracked */
+	uint64_t describe_generation;
 	size_t query_and_parameters_len;
 	uint8_t stmt_name_len;
 	char stmt_name[MAX_SERVER_PREPARED_STMT_NAME];
@@ -45,3 +53,22 @@ void unregister_prepared_statement(PgSocket *server, uint64_t query_id);
 bool add_prepared_statement(PgSocket *server, PgServerPreparedStatement *server_ps) _MUSTCHECK;
 void free_client_prepared_statements(PgSocket *client);
 void free_server_prepared_statements(PgSocket *server);
+void prepared_statement_mem_stats(unsigned *used_p, unsigned *unused_p, uint64_t *bytes_p);
+void acquire_prepared_statement(PgPreparedStatement *ps);
+void release_prepared_statement(PgPreparedStatement *ps);
+
+bool capture_describe_response(PgSocket *server, PktHdr *pkt) _MUSTCHECK;
+bool queue_cached_describe_response(PgSocket *client, PgSocket *server, PgPreparedStatement *ps) _MUSTCHECK;
+void check_describe_cache_error(PktHdr *pkt);
+void invalidate_describe_cache(void);
+
+int prepare_hot_statements(PgSocket *server) _MUSTCHECK;
+void hot_statement_prepared(PgSocket *server);
+void hot_statements_failed(PgSocket *server, PktHdr *pkt);
+
+void write_prepared_statement_rows(PktBuf *buf);
+void write_socket_prepared_statement_rows(PktBuf *buf, PgSocket *sk);
+bool takeover_load_prepared_statement(uint64_t query_id, const uint8_t *data, int len) _MUSTCHECK;
+bool takeover_load_server_prepared_statement(PgSocket *server, uint64_t query_id) _MUSTCHECK;
+bool takeover_load_client_prepared_statement(PgSocket *client, const char *name, uint64_t query_id) _MUSTCHECK;
+void takeover_prepared_statements_done(void);
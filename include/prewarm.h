@@ -0,0 +1,32 @@
+/*
+ * PgBouncer - Lightweight connection pooler for PostgreSQL.
+ *
+ * Copyright (c) 2007-2009  Marko Kreen, Skype Technologies OÜ
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* one slot per 15 minutes of the day */
+#define LOAD_PROFILE_SLOT_MINUTES       15
+#define LOAD_PROFILE_SLOTS              (24 * 60 / LOAD_PROFILE_SLOT_MINUTES)
+
+/* slot values are fixed point, in 1/LOAD_PROFILE_SCALE busy servers */
+#define LOAD_PROFILE_SCALE              16
+
+void prewarm_load(void);
+void prewarm_save(bool force);
+void prewarm_update_pool(PgPool *pool, usec_t period);
+void prewarm_attach_pool(PgPool *pool);
+void prewarm_detach_pool(PgPool *pool);
+int prewarm_pool_target(PgPool *pool) _MUSTCHECK;
+void prewarm_cleanup(void);
@@ -42,6 +42,14 @@ typedef enum {
  */
 #define SBUF_SMALL_PKT  64
 
+/*
+ * A socket moves to the next IOBuf size class after filling its buffer
+ * in this many main loops in a row, and back down one class after this
+ * many loops that did not fill it.
+ */
+#define IOBUF_GROW_FILLS	2
+#define IOBUF_SHRINK_IDLE	16
+
 struct tls;
 
 /* fwd def */
@@ -81,18 +89,39 @@ struct SBuf {
 	unsigned skip_remain;	/* the amount of data that still needs to be skipped before doing the pkt_action */
 	struct MBuf extra_packets;	/* extra packets that pgbouncer inserts into the packet stream */
 	bool extra_packet_queue_after;	/* if packets should be queued after the current packet that's being put on the queue */
+	unsigned extra_packets_batched;	/* extra_packets bytes of already handled packets, waiting to be sent */
 
 	sbuf_cb_t proto_cb;	/* protocol callback */
 
 	SBuf *dst;		/* target SBuf for current packet */
 
 	IOBuf *io;		/* data buffer, lazily allocated */
+	uint8_t io_class;	/* size class for the next data buffer */
+	uint8_t io_fills;	/* main loops in a row that filled the buffer */
+	uint8_t io_idle;	/* main loops in a row that did not */
 
-	const SBufIO *ops;	/* normal vs. TLS */
+	struct Spool *spool;	/* data for this socket that did not fit into it, lazily allocated */
+	bool spool_allowed;	/* writers may spool data instead of waiting for this socket */
+
+	const SBufIO *ops;	/* normal vs. TLS, possibly wrapped by compression */
 	struct tls *tls;	/* TLS context */
 	const char *tls_host;	/* target hostname */
+	bool tls_session_pending;	/* server TLS session not saved yet */
+	struct SBufCompress *compress;	/* compression state, if compressed */
 };
 
+/* totals over all compressed connections, see SHOW COMPRESSION */
+struct SBufCompressStats {
+	uint64_t send_raw_bytes;	/* data before compression */
+	uint64_t send_wire_bytes;	/* compressed data written to sockets */
+	uint64_t recv_wire_bytes;	/* compressed data read from sockets */
+	uint64_t recv_raw_bytes;	/* data after decompression */
+	usec_t send_time;		/* time spent in deflate() */
+	usec_t recv_time;		/* time spent in inflate() */
+};
+
+extern struct SBufCompressStats sbuf_compress_stats;
+
 #define sbuf_socket(sbuf) ((sbuf)->sock)
 
 void sbuf_init(SBuf *sbuf, sbuf_cb_t proto_fn);
@@ -117,6 +146,15 @@ extern int server_connect_sslmode;
 bool sbuf_tls_setup(void);
 bool sbuf_tls_accept(SBuf *sbuf)  _MUSTCHECK;
 bool sbuf_tls_connect(SBuf *sbuf, const char *hostname)  _MUSTCHECK;
+bool sbuf_tls_resumed(SBuf *sbuf);
+
+void sbuf_tls_rotate_ticket_keys(void);
+void sbuf_tls_write_ticket_keys(PktBuf *buf);
+bool sbuf_tls_load_ticket_key(const char *task, uint64_t keyrev, const uint8_t *key, int len);
+void sbuf_tls_ticket_keys_loaded(void);
+
+bool sbuf_compress_start(SBuf *sbuf)  _MUSTCHECK;
+bool sbuf_compress_pending(SBuf *sbuf);
 
 bool sbuf_pause(SBuf *sbuf) _MUSTCHECK;
 void sbuf_continue(SBuf *sbuf);
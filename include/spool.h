@@ -0,0 +1,53 @@
+/*
+ * PgBouncer - Lightweight connection pooler for PostgreSQL.
+ *
+ * Copyright (c) 2007-2009  Marko Kreen, Skype Technologies OÜ
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Bounded byte queue for data that could not be written to a slow client.
+ *
+ * Data is kept in memory up to result_spool_size bytes, the rest goes
+ * to an anonymous temp file up to result_spool_file_size bytes.  All
+ * spools together hold at most result_spool_total_size bytes.
+ */
+
+#include <usual/mbuf.h>
+
+struct Spool {
+	struct event ev;	/* EV_WRITE on the owner socket, used by sbuf.c */
+	struct MBuf mem;	/* in-memory part, always before the file part */
+	FILE *file;		/* spilled part, NULL until needed */
+	uint64_t file_read_pos;
+	uint64_t file_write_pos;
+	bool reader_paused;	/* owner stopped reading until spool is drained */
+};
+
+struct Spool *spool_new(void) _MUSTCHECK;
+void spool_free(struct Spool *spool);
+size_t spool_total_room(size_t len) _MUSTCHECK;
+size_t spool_append(struct Spool *spool, const void *data, size_t len) _MUSTCHECK;
+bool spool_peek(struct Spool *spool, const uint8_t **data_p, unsigned *len_p) _MUSTCHECK;
+void spool_consume(struct Spool *spool, unsigned len);
+
+static inline uint64_t spool_amount(const struct Spool *spool)
+{
+	return mbuf_avail_for_read(&spool->mem) + spool->file_write_pos - spool->file_read_pos;
+}
+
+static inline bool spool_empty(const struct Spool *spool)
+{
+	return spool_amount(spool) == 0;
+}
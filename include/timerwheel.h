@@ -0,0 +1,57 @@
+/*
+ * PgBouncer - Lightweight connection pooler for PostgreSQL.
+ *
+ * Copyright (c) 2007-2009  Marko Kreen, Skype Technologies OÜ
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Hierarchical timer wheel.
+ *
+ * Time is counted in ticks.  Level 0 has one slot per tick, every further
+ * level has slots that are TW_LEVEL_SIZE times wider.  Timers further away
+ * than the whole wheel covers are clamped to its end, so users must be
+ * prepared for a timer to fire before its deadline and re-arm it.
+ */
+
+#include <usual/list.h>
+
+#define TW_LEVEL_BITS   6
+#define TW_LEVEL_SIZE   (1 << TW_LEVEL_BITS)
+#define TW_LEVEL_MASK   (TW_LEVEL_SIZE - 1)
+#define TW_LEVELS       5
+
+struct TimerEntry {
+	struct List node;	/* slot membership, empty if not armed */
+	uint64_t expires;	/* tick at which the timer fires */
+};
+
+struct TimerWheel {
+	uint64_t tick;		/* last tick that was processed */
+	int count;		/* number of armed timers */
+	void (*fire)(struct TimerEntry *entry);
+	struct List slots[TW_LEVELS][TW_LEVEL_SIZE];
+};
+
+void timerwheel_init(struct TimerWheel *tw, uint64_t now, void (*fire)(struct TimerEntry *entry));
+void timerwheel_entry_init(struct TimerEntry *entry);
+void timerwheel_add(struct TimerWheel *tw, struct TimerEntry *entry, uint64_t expires);
+void timerwheel_del(struct TimerWheel *tw, struct TimerEntry *entry);
+void timerwheel_run(struct TimerWheel *tw, uint64_t now);
+uint64_t timerwheel_next_tick(const struct TimerWheel *tw) _MUSTCHECK;
+
+static inline bool timerwheel_armed(const struct TimerEntry *entry)
+{
+	return !list_empty(&entry->node);
+}
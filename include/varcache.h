@@ -13,11 +13,15 @@ typedef struct VarCache VarCache;
 
 struct VarCache {
 	struct PStr **var_list;
+	uint64_t fingerprint;	/* combined hash of all values */
 };
 
 void init_var_lookup(const char *cf_track_extra_parameters);
 int get_num_var_cached(void);
 bool varcache_set(VarCache *cache, const char *key, const char *value) /* _MUSTCHECK */;
+bool varcache_set_reported(VarCache *cache, const char *key, const char *value);
+const char *varcache_get(VarCache *cache, const char *key);
+struct PStr *varcache_get_pstr(VarCache *cache, const char *key);
 bool varcache_apply(PgSocket *server, PgSocket *client, bool *changes_p) _MUSTCHECK;
 void varcache_apply_startup(PktBuf *pkt, PgSocket *client);
 void varcache_fill_unset(VarCache *src, PgSocket *dst);
@@ -68,6 +68,7 @@ static inline int setgroups(int ngroups, const gid_t *gidsets)
 	errno = EINVAL; return -1;
 }
 #define chown(f, u, g) (-1)
+#define fsync(fd) _commit(fd)
 
 #define srandom(s) srand(s)
 #define random() rand()
@@ -22,28 +22,62 @@
 
 #include <usual/statlist.h>
 
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
 #ifndef USUAL_FAKE_SLAB
 
+#if defined(HAVE_MMAP) && !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#if defined(HAVE_MMAP) && defined(MAP_ANONYMOUS)
+#define SLAB_USE_MMAP
+#endif
+
+/* chunks are allocated in whole pages, so they can be given back whole */
+#define SLAB_PAGE_SIZE 4096
+
+/* preferred chunk size */
+#define SLAB_CHUNK_SIZE (64 * 1024)
+
+/* large objects get bigger chunks */
+#define SLAB_CHUNK_MIN_OBJS 8
+
 /*
  * Store for pre-initialized objects of one type.
+ *
+ * Objects are carved from fixed-size chunks.  Chunks with free objects
+ * are kept on partial_list, completely free ones at its end, so new
+ * objects are taken from the fullest chunks and the free ones can be
+ * released by slab_trim().
  */
 struct Slab {
 	struct List head;
-	struct StatList freelist;
-	struct StatList fraglist;
+	struct StatList partial_list;
+	struct StatList full_list;
 	char name[32];
 	unsigned final_size;
+	unsigned obj_offset;	/* room for chunk pointer before each object */
+	unsigned frag_size;	/* chunk header */
+	unsigned chunk_size;
+	unsigned chunk_count;	/* objects per chunk */
 	unsigned total_count;
+	unsigned free_count;
 	slab_init_fn init_func;
 	CxMem *cx;
 };
 
 
 /*
- * Header for each slab.
+ * Header for each chunk.
  */
 struct SlabFrag {
 	struct List head;
+	struct List freelist;
+	unsigned free_count;
+	bool mapped;
 };
 
 /* keep track of all active slabs */
@@ -63,17 +97,25 @@ static void slab_list_remove(struct Slab *slab)
 #endif
 }
 
+/* chunk an object was carved from */
+static inline struct SlabFrag **obj_frag_ptr(void *obj)
+{
+	return (struct SlabFrag **)((char *)obj - sizeof(struct SlabFrag *));
+}
+
 /* fill struct contents */
 static void init_slab(struct Slab *slab, const char *name, unsigned obj_size,
 		      unsigned align, slab_init_fn init_func,
 		      CxMem *cx)
 {
 	unsigned slen = strlen(name);
+	unsigned stride, count;
 
 	list_init(&slab->head);
-	statlist_init(&slab->freelist, name);
-	statlist_init(&slab->fraglist, name);
+	statlist_init(&slab->partial_list, name);
+	statlist_init(&slab->full_list, name);
 	slab->total_count = 0;
+	slab->free_count = 0;
 	slab->init_func = init_func;
 	slab->cx = cx;
 
@@ -87,15 +129,28 @@ static void init_slab(struct Slab *slab, const char *name, unsigned obj_size,
 		align = 0;
 
 	/* actual area for one object */
-	if (align == 0)
+	if (align == 0) {
 		slab->final_size = ALIGN(obj_size);
-	else
+		slab->obj_offset = ALIGN(sizeof(struct SlabFrag *));
+		slab->frag_size = ALIGN(sizeof(struct SlabFrag));
+	} else {
 		slab->final_size = CUSTOM_ALIGN(obj_size, align);
+		slab->obj_offset = CUSTOM_ALIGN(sizeof(struct SlabFrag *), align);
+		slab->frag_size = CUSTOM_ALIGN(sizeof(struct SlabFrag), align);
+	}
 
 	/* allow small structs */
 	if (slab->final_size < sizeof(struct List))
 		slab->final_size = sizeof(struct List);
 
+	/* chunk geometry, page multiple with as many objects as fit */
+	stride = slab->obj_offset + slab->final_size;
+	count = (SLAB_CHUNK_SIZE - slab->frag_size) / stride;
+	if (count < SLAB_CHUNK_MIN_OBJS)
+		count = SLAB_CHUNK_MIN_OBJS;
+	slab->chunk_size = CUSTOM_ALIGN(slab->frag_size + count * stride, SLAB_PAGE_SIZE);
+	slab->chunk_count = (slab->chunk_size - slab->frag_size) / stride;
+
 	slab_list_append(slab);
 }
 
@@ -113,72 +168,124 @@ struct Slab *slab_create(const char *name, unsigned obj_size, unsigned align,
 	return slab;
 }
 
-/* free all storage associated by slab */
-void slab_destroy(struct Slab *slab)
+/*
+ * Chunks of the default allocator are mapped directly, malloc() might
+ * keep them in its heap after free.
+ */
+static struct SlabFrag *chunk_alloc(struct Slab *slab)
+{
+	struct SlabFrag *frag;
+
+#ifdef SLAB_USE_MMAP
+	if (slab->cx == NULL || slab->cx == USUAL_ALLOC) {
+		void *p = mmap(NULL, slab->chunk_size, PROT_READ | PROT_WRITE,
+			       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			return NULL;
+		frag = p;
+		frag->mapped = true;
+		return frag;
+	}
+#endif
+	frag = cx_alloc0(slab->cx, slab->chunk_size);
+	if (frag)
+		frag->mapped = false;
+	return frag;
+}
+
+static void chunk_free(struct Slab *slab, struct SlabFrag *frag)
+{
+#ifdef SLAB_USE_MMAP
+	if (frag->mapped) {
+		munmap(frag, slab->chunk_size);
+		return;
+	}
+#endif
+	cx_free(slab->cx, frag);
+}
+
+static void free_chunk_list(struct Slab *slab, struct StatList *list)
 {
 	struct List *item, *tmp;
 	struct SlabFrag *frag;
 
+	statlist_for_each_safe(item, list, tmp) {
+		frag = container_of(item, struct SlabFrag, head);
+		statlist_remove(list, item);
+		chunk_free(slab, frag);
+	}
+}
+
+/* free all storage associated by slab */
+void slab_destroy(struct Slab *slab)
+{
 	if (!slab)
 		return;
 
 	slab_list_remove(slab);
-	statlist_for_each_safe(item, &slab->fraglist, tmp) {
-		frag = container_of(item, struct SlabFrag, head);
-		cx_free(slab->cx, frag);
-	}
+	free_chunk_list(slab, &slab->partial_list);
+	free_chunk_list(slab, &slab->full_list);
 	cx_free(slab->cx, slab);
 }
 
-/* add new block of objects to slab */
+/* add new chunk of objects to slab */
 static void grow(struct Slab *slab)
 {
-	unsigned count, i, size;
+	unsigned i, stride;
 	char *area;
 	struct SlabFrag *frag;
 
-	/* calc new slab size */
-	count = slab->total_count;
-	if (count < 50)
-		count = 16 * 1024 / slab->final_size;
-	if (count < 50)
-		count = 50;
-	size = count * slab->final_size;
-
 	/* allocate & init */
-	frag = cx_alloc0(slab->cx, size + sizeof(struct SlabFrag));
+	frag = chunk_alloc(slab);
 	if (!frag)
 		return;
 	list_init(&frag->head);
-	area = (char *)frag + sizeof(struct SlabFrag);
+	list_init(&frag->freelist);
+	frag->free_count = slab->chunk_count;
+	area = (char *)frag + slab->frag_size;
+	stride = slab->obj_offset + slab->final_size;
 
 	/* init objects */
-	for (i = 0; i < count; i++) {
-		void *obj = area + i * slab->final_size;
+	for (i = 0; i < slab->chunk_count; i++) {
+		void *obj = area + i * stride + slab->obj_offset;
 		struct List *head = (struct List *)obj;
+		*obj_frag_ptr(obj) = frag;
 		list_init(head);
-		statlist_append(&slab->freelist, head);
+		list_append(&frag->freelist, head);
 	}
 
 	/* register to slab */
-	slab->total_count += count;
-	statlist_append(&slab->fraglist, &frag->head);
+	slab->total_count += slab->chunk_count;
+	slab->free_count += slab->chunk_count;
+	statlist_append(&slab->partial_list, &frag->head);
 }
 
 /* get free object from slab */
 void *slab_alloc(struct Slab *slab)
 {
-	struct List *item = statlist_pop(&slab->freelist);
-	if (!item) {
+	struct List *item;
+	struct SlabFrag *frag;
+
+	if (statlist_empty(&slab->partial_list)) {
 		grow(slab);
-		item = statlist_pop(&slab->freelist);
+		if (statlist_empty(&slab->partial_list))
+			return NULL;
 	}
-	if (item) {
-		if (slab->init_func)
-			slab->init_func(item);
-		else
-			memset(item, 0, slab->final_size);
+
+	/* take from the fullest chunk */
+	frag = container_of(statlist_first(&slab->partial_list), struct SlabFrag, head);
+	item = list_pop(&frag->freelist);
+	frag->free_count--;
+	slab->free_count--;
+	if (frag->free_count == 0) {
+		statlist_remove(&slab->partial_list, &frag->head);
+		statlist_append(&slab->full_list, &frag->head);
 	}
+
+	if (slab->init_func)
+		slab->init_func(item);
+	else
+		memset(item, 0, slab->final_size);
 	return item;
 }
 
@@ -186,8 +293,62 @@ void *slab_alloc(struct Slab *slab)
 void slab_free(struct Slab *slab, void *obj)
 {
 	struct List *item = obj;
+	struct SlabFrag *frag = *obj_frag_ptr(obj);
+
 	list_init(item);
-	statlist_prepend(&slab->freelist, item);
+	list_prepend(&frag->freelist, item);
+	frag->free_count++;
+	slab->free_count++;
+
+	if (frag->free_count == 1) {
+		/* was full, fill it up again before the emptier ones */
+		statlist_remove(&slab->full_list, &frag->head);
+		statlist_prepend(&slab->partial_list, &frag->head);
+	} else if (frag->free_count == slab->chunk_count) {
+		/* all free, move it to the end for slab_trim() */
+		statlist_remove(&slab->partial_list, &frag->head);
+		statlist_append(&slab->partial_list, &frag->head);
+	}
+}
+
+/*
+ * Release completely free chunks, as long as at least keep_free_pct
+ * percent of the remaining objects stay free.  The last chunk is kept.
+ */
+void slab_trim(struct Slab *slab, unsigned keep_free_pct)
+{
+	struct List *item;
+	struct SlabFrag *frag;
+	unsigned count = slab->chunk_count;
+
+	if (keep_free_pct >= 100)
+		return;
+
+	while ((item = statlist_last(&slab->partial_list)) != NULL) {
+		frag = container_of(item, struct SlabFrag, head);
+		if (frag->free_count < count || slab->total_count == count)
+			break;
+		if ((uint64_t)(slab->free_count - count) * 100
+		    < (uint64_t)(slab->total_count - count) * keep_free_pct)
+			break;
+
+		statlist_remove(&slab->partial_list, &frag->head);
+		slab->total_count -= count;
+		slab->free_count -= count;
+		chunk_free(slab, frag);
+	}
+}
+
+/* trim all active slabs */
+void slab_trim_all(unsigned keep_free_pct)
+{
+	struct Slab *slab;
+	struct List *item;
+
+	statlist_for_each(item, &slab_list) {
+		slab = container_of(item, struct Slab, head);
+		slab_trim(slab, keep_free_pct);
+	}
 }
 
 /* total number of objects allocated from slab */
@@ -199,7 +360,7 @@ int slab_total_count(const struct Slab *slab)
 /* free objects in slab */
 int slab_free_count(const struct Slab *slab)
 {
-	return statlist_count(&slab->freelist);
+	return slab->free_count;
 }
 
 /* number of objects in use */
@@ -208,10 +369,17 @@ int slab_active_count(const struct Slab *slab)
 	return slab_total_count(slab) - slab_free_count(slab);
 }
 
+/* bytes taken from the allocator */
+size_t slab_reserved_bytes(const struct Slab *slab)
+{
+	size_t chunks = statlist_count(&slab->partial_list) + statlist_count(&slab->full_list);
+	return chunks * slab->chunk_size;
+}
+
 static void run_slab_stats(struct Slab *slab, slab_stat_fn cb_func, void *cb_arg)
 {
-	unsigned free = statlist_count(&slab->freelist);
-	cb_func(cb_arg, slab->name, slab->final_size, free, slab->total_count);
+	cb_func(cb_arg, slab->name, slab->final_size, slab->free_count,
+		slab->total_count, slab_reserved_bytes(slab));
 }
 
 /* call a function for all active slabs */
@@ -296,6 +464,16 @@ int slab_active_count(const struct Slab *slab)
 {
 	return 0;
 }
+size_t slab_reserved_bytes(const struct Slab *slab)
+{
+	return 0;
+}
+void slab_trim(struct Slab *slab, unsigned keep_free_pct)
+{
+}
+void slab_trim_all(unsigned keep_free_pct)
+{
+}
 void slab_stats(slab_stat_fn cb_func, void *cb_arg)
 {
 }
@@ -27,6 +27,9 @@
  * - init func gets either zeroed obj or old obj from _free().
  *   'struct List' on obj start is non-zero.
  *
+ * Objects are carved from page-multiple chunks, completely free
+ * chunks can be given back with slab_trim().
+ *
  * ATM custom 'align' larger than malloc() alignment does not work.
  */
 #ifndef _USUAL_SLAB_H_
@@ -63,10 +66,19 @@ int slab_free_count(const struct Slab *slab);
 /** Return number of used objects */
 int slab_active_count(const struct Slab *slab);
 
+/** Return bytes taken from the allocator, including chunk overhead */
+size_t slab_reserved_bytes(const struct Slab *slab);
+
+/** Release free chunks, except the last, while keep_free_pct percent of objects stay free */
+void slab_trim(struct Slab *slab, unsigned keep_free_pct);
+
+/** Run slab_trim() on all slabs */
+void slab_trim_all(unsigned keep_free_pct);
+
 /** Signature for stat info callback */
 typedef void (*slab_stat_fn)(void *arg, const char *slab_name,
 			     unsigned size, unsigned free,
-			     unsigned total);
+			     unsigned total, size_t reserved);
 
 /** Run stat info callback on all slabs */
 void slab_stats(slab_stat_fn cb_func, void *cb_arg);
@@ -536,6 +536,9 @@ void usual_tls_free(struct tls *ctx)
 
 void tls_reset(struct tls *ctx)
 {
+	/* the SSL_CTX may outlive ctx, see tls_server_ticket_cb() */
+	if (ctx->ssl_ctx != NULL && (ctx->flags & TLS_SERVER) != 0)
+		SSL_CTX_set_app_data(ctx->ssl_ctx, NULL);
 	SSL_CTX_free(ctx->ssl_ctx);
 	SSL_free(ctx->ssl_conn);
 	X509_free(ctx->ssl_peer_cert);
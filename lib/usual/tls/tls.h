@@ -41,6 +41,10 @@ extern "C" {
 #define TLS_NO_OCSP             -4
 #define TLS_NO_CERT             -5
 
+#define TLS_MAX_SESSION_ID_LENGTH               32
+#define TLS_TICKET_KEY_SIZE                     48
+#define TLS_NUM_TICKETS                         4
+
 #define TLS_OCSP_RESPONSE_SUCCESSFUL            0
 #define TLS_OCSP_RESPONSE_MALFORMED             1
 #define TLS_OCSP_RESPONSE_INTERNALERR           2
@@ -102,6 +106,13 @@ int tls_config_set_ocsp_stapling_mem(struct tls_config *_config, const uint8_t *
 void tls_config_set_protocols(struct tls_config *_config, uint32_t _protocols);
 void tls_config_set_verify_depth(struct tls_config *_config, int _verify_depth);
 
+int tls_config_set_session_id(struct tls_config *_config,
+			      const unsigned char *_session_id, size_t _len);
+int tls_config_set_session_lifetime(struct tls_config *_config, int _lifetime);
+void tls_config_set_session_cache_size(struct tls_config *_config, int _size);
+int tls_config_add_ticket_key(struct tls_config *_config, uint32_t _keyrev,
+			      const unsigned char *_key, size_t _keylen);
+
 void tls_config_prefer_ciphers_client(struct tls_config *_config);
 void tls_config_prefer_ciphers_server(struct tls_config *_config);
 
@@ -131,6 +142,8 @@ int tls_connect_fds(struct tls *_ctx, int _fd_read, int _fd_write,
 int tls_connect_servername(struct tls *_ctx, const char *_host,
 			   const char *_port, const char *_servername);
 int tls_connect_socket(struct tls *_ctx, int _s, const char *_servername);
+int tls_set_session(struct tls *_ctx, const uint8_t *_data, size_t _len);
+uint8_t *tls_conn_session(struct tls *_ctx, size_t *_len);
 int tls_handshake(struct tls *_ctx);
 ssize_t tls_read(struct tls *_ctx, void *_buf, size_t _buflen);
 ssize_t tls_write(struct tls *_ctx, const void *_buf, size_t _buflen);
@@ -147,6 +160,7 @@ time_t  tls_peer_cert_notafter(struct tls *_ctx);
 
 const char *tls_conn_version(struct tls *_ctx);
 const char *tls_conn_cipher(struct tls *_ctx);
+int tls_conn_session_resumed(struct tls *_ctx);
 
 uint8_t *tls_load_file(const char *_file, size_t *_len, char *_password);
 
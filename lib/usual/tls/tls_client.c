@@ -241,6 +241,65 @@ err:
 	return (rv);
 }
 
+/*
+ * Offer a session from tls_conn_session() of an earlier connection to the
+ * same server.  Call after tls_connect_fds() and before the handshake.  If
+ * the server does not accept it, a full handshake is done.
+ */
+int tls_set_session(struct tls *ctx, const uint8_t *data, size_t len)
+{
+	const unsigned char *p = data;
+	SSL_SESSION *ss;
+	int rv = -1;
+
+	if ((ctx->flags & TLS_CLIENT) == 0 || ctx->ssl_conn == NULL) {
+		tls_set_errorx(ctx, "not a connecting client context");
+		return (-1);
+	}
+	if (len > LONG_MAX ||
+	    (ss = d2i_SSL_SESSION(NULL, &p, (long)len)) == NULL) {
+		tls_set_errorx(ctx, "invalid session data");
+		return (-1);
+	}
+	if (SSL_set_session(ctx->ssl_conn, ss) == 1)
+		rv = 0;
+	else
+		tls_set_errorx(ctx, "failed to set session");
+	SSL_SESSION_free(ss);
+	return (rv);
+}
+
+/*
+ * Serialized session of the connection, if it can be resumed.  With TLS
+ * v1.3 that is only after the server has sent a session ticket, which
+ * comes after the handshake.  Returned buffer must be freed by caller.
+ */
+uint8_t *tls_conn_session(struct tls *ctx, size_t *len)
+{
+	SSL_SESSION *ss;
+	unsigned char *data, *p;
+	int n;
+
+	if (ctx->ssl_conn == NULL ||
+	    (ss = SSL_get_session(ctx->ssl_conn)) == NULL)
+		return (NULL);
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L && !defined(LIBRESSL_VERSION_NUMBER)
+	if (!SSL_SESSION_is_resumable(ss))
+		return (NULL);
+#endif
+	if ((n = i2d_SSL_SESSION(ss, NULL)) <= 0)
+		return (NULL);
+	if ((data = malloc(n)) == NULL)
+		return (NULL);
+	p = data;
+	if (i2d_SSL_SESSION(ss, &p) != n) {
+		free(data);
+		return (NULL);
+	}
+	*len = n;
+	return (data);
+}
+
 int tls_handshake_client(struct tls *ctx)
 {
 	X509 *cert = NULL;
@@ -552,6 +552,22 @@ void tls_config_set_verify_depth(struct tls_config *_config, int _verify_depth)
 {
 }
 
+int tls_config_set_session_id(struct tls_config *_config, const unsigned char *_session_id, size_t _len)
+{
+	return -1;
+}
+int tls_config_set_session_lifetime(struct tls_config *_config, int _lifetime)
+{
+	return -1;
+}
+void tls_config_set_session_cache_size(struct tls_config *_config, int _size)
+{
+}
+int tls_config_add_ticket_key(struct tls_config *_config, uint32_t _keyrev, const unsigned char *_key, size_t _keylen)
+{
+	return -1;
+}
+
 void tls_config_prefer_ciphers_client(struct tls_config *_config)
 {
 }
@@ -685,6 +701,18 @@ const char *tls_conn_cipher(struct tls *ctx)
 {
 	return "n/a";
 }
+int tls_conn_session_resumed(struct tls *ctx)
+{
+	return 0;
+}
+int tls_set_session(struct tls *_ctx, const uint8_t *_data, size_t _len)
+{
+	return -1;
+}
+uint8_t *tls_conn_session(struct tls *_ctx, size_t *_len)
+{
+	return NULL;
+}
 
 uint8_t *tls_load_file(const char *_file, size_t *_len, char *_password)
 {
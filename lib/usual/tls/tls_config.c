@@ -21,6 +21,8 @@
 
 #include <ctype.h>
 
+#include <openssl/rand.h>
+
 #include "tls_internal.h"
 
 static int set_string(const char **dest, const char *src)
@@ -132,6 +134,12 @@ struct tls_config *tls_config_new(void)
 	tls_config_set_protocols(config, TLS_PROTOCOLS_DEFAULT);
 	tls_config_set_verify_depth(config, 6);
 
+	if (RAND_bytes(config->session_id, sizeof(config->session_id)) != 1)
+		goto err;
+	if (tls_config_set_session_lifetime(config, TLS_DEFAULT_SESSION_LIFETIME) != 0)
+		goto err;
+	tls_config_set_session_cache_size(config, TLS_DEFAULT_SESSION_CACHE_SIZE);
+
 	tls_config_prefer_ciphers_server(config);
 
 	tls_config_verify(config);
@@ -163,6 +171,8 @@ void tls_config_free(struct tls_config *config)
 	free((char *)config->ciphers);
 	free((char *)config->cipher_suites);
 
+	explicit_bzero(config->ticket_keys, sizeof(config->ticket_keys));
+
 	free(config);
 }
 
@@ -416,6 +426,82 @@ void tls_config_set_verify_depth(struct tls_config *config, int verify_depth)
 	config->verify_depth = verify_depth;
 }
 
+int tls_config_set_session_id(struct tls_config *config,
+			      const unsigned char *session_id, size_t len)
+{
+	if (len > TLS_MAX_SESSION_ID_LENGTH) {
+		tls_config_set_errorx(config, "session ID too large");
+		return (-1);
+	}
+	memset(config->session_id, 0, sizeof(config->session_id));
+	memcpy(config->session_id, session_id, len);
+	return (0);
+}
+
+/*
+ * Lifetime of sessions in seconds.  0 disables both the session cache and
+ * session tickets.
+ */
+int tls_config_set_session_lifetime(struct tls_config *config, int lifetime)
+{
+	if (lifetime < 0) {
+		tls_config_set_errorx(config, "negative session lifetime");
+		return (-1);
+	}
+	config->session_lifetime = lifetime;
+	return (0);
+}
+
+void tls_config_set_session_cache_size(struct tls_config *config, int size)
+{
+	config->session_cache_size = size;
+}
+
+/*
+ * Add a key for encrypting session tickets.  The most recently added key
+ * is used for new tickets, tickets encrypted with one of the
+ * TLS_NUM_TICKETS - 1 previous keys are still accepted.  Without any key
+ * -lssl uses its own, which changes with every server context.
+ */
+int tls_config_add_ticket_key(struct tls_config *config, uint32_t keyrev,
+			      const unsigned char *key, size_t keylen)
+{
+	struct tls_ticket_key newkey;
+	int i;
+
+	if (keylen != TLS_TICKET_KEY_SIZE ||
+	    sizeof(newkey.aes_key) + sizeof(newkey.hmac_key) > keylen) {
+		tls_config_set_errorx(config, "wrong amount of ticket key data");
+		return (-1);
+	}
+
+	keyrev = htonl(keyrev);
+	memset(&newkey, 0, sizeof(newkey));
+	memcpy(newkey.key_name, &keyrev, sizeof(keyrev));
+	memcpy(newkey.aes_key, key, sizeof(newkey.aes_key));
+	memcpy(newkey.hmac_key, key + sizeof(newkey.aes_key),
+	       sizeof(newkey.hmac_key));
+
+	for (i = 0; i < TLS_NUM_TICKETS; i++) {
+		struct tls_ticket_key *tk = &config->ticket_keys[i];
+		if (memcmp(newkey.key_name, tk->key_name,
+			   sizeof(tk->key_name)) != 0)
+			continue;
+
+		/* allow re-entry of most recent key */
+		if (i == 0 && memcmp(&newkey, tk, sizeof(newkey)) == 0)
+			return (0);
+		tls_config_set_errorx(config, "ticket key already present");
+		return (-1);
+	}
+
+	memmove(&config->ticket_keys[1], &config->ticket_keys[0],
+		sizeof(config->ticket_keys) - sizeof(config->ticket_keys[0]));
+	config->ticket_keys[0] = newkey;
+
+	return (0);
+}
+
 void tls_config_prefer_ciphers_client(struct tls_config *config)
 {
 	config->ciphers_server = 0;
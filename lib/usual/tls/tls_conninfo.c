@@ -210,4 +210,11 @@ const char *tls_conn_version(struct tls *ctx)
 	return (ctx->conninfo->version);
 }
 
+int tls_conn_session_resumed(struct tls *ctx)
+{
+	if (ctx->ssl_conn == NULL)
+		return (0);
+	return (SSL_session_reused(ctx->ssl_conn));
+}
+
 #endif
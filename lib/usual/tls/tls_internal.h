@@ -25,6 +25,10 @@
 
 #define _PATH_SSL_CA_FILE USUAL_TLS_CA_FILE
 
+/* same as the defaults of -lssl */
+#define TLS_DEFAULT_SESSION_LIFETIME    300
+#define TLS_DEFAULT_SESSION_CACHE_SIZE  (1024 * 20)
+
 union tls_addr {
 	struct in_addr ip4;
 	struct in6_addr ip6;
@@ -46,6 +50,13 @@ struct tls_keypair {
 	size_t key_len;
 };
 
+struct tls_ticket_key {
+	/* The key_name must be 16 bytes according to -lssl */
+	unsigned char key_name[16];
+	unsigned char aes_key[32];
+	unsigned char hmac_key[16];
+};
+
 struct tls_config {
 	struct tls_error error;
 
@@ -63,6 +74,10 @@ struct tls_config {
 	char *ocsp_mem;
 	size_t ocsp_len;
 	uint32_t protocols;
+	unsigned char session_id[TLS_MAX_SESSION_ID_LENGTH];
+	int session_lifetime;
+	int session_cache_size;
+	struct tls_ticket_key ticket_keys[TLS_NUM_TICKETS];
 	int verify_cert;
 	int verify_client;
 	int verify_depth;
@@ -20,6 +20,8 @@
 #ifdef USUAL_LIBSSL_FOR_TLS
 
 #include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
 #include <openssl/ssl.h>
 #include <openssl/rand.h>
 #include <openssl/err.h>
@@ -91,11 +93,91 @@ static int alpn_cb(SSL *ssl, const unsigned char **out, unsigned char *outlen,
 	}
 }
 
+/*
+ * Find the ticket key with the given name, or the current one if keyname
+ * is NULL.  Unused slots of the key ring are all zeroes.
+ */
+static struct tls_ticket_key *tls_server_ticket_key(struct tls_config *config,
+						    unsigned char *keyname)
+{
+	struct tls_ticket_key *key = NULL;
+	static const unsigned char unused_name[16];
+	int i;
+
+	for (i = 0; i < TLS_NUM_TICKETS; i++) {
+		if (memcmp(config->ticket_keys[i].key_name, unused_name,
+			   sizeof(unused_name)) == 0)
+			break;
+		if (keyname == NULL ||
+		    memcmp(keyname, config->ticket_keys[i].key_name,
+			   sizeof(config->ticket_keys[i].key_name)) == 0) {
+			key = &config->ticket_keys[i];
+			break;
+		}
+	}
+	return (key);
+}
+
+/*
+ * Encrypt and decrypt session tickets with the keys of the configuration,
+ * so that they can be shared with other server contexts.
+ *
+ * The configuration is found through the server context, which is set as
+ * application data of the SSL_CTX.  Once the server context is freed,
+ * handshakes still running on its SSL_CTX get no ticket and cannot resume
+ * with one.
+ */
+static int tls_server_ticket_cb(SSL *ssl, unsigned char *keyname,
+				unsigned char *iv, EVP_CIPHER_CTX *ctx,
+				HMAC_CTX *hctx, int mode)
+{
+	struct tls_ticket_key *key;
+	struct tls *tls_ctx;
+
+	tls_ctx = SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+	if (tls_ctx == NULL)
+		return (0);
+
+	if (mode == 1) {
+		/* create new session */
+		key = tls_server_ticket_key(tls_ctx->config, NULL);
+		if (key == NULL)
+			return (0);
+
+		memcpy(keyname, key->key_name, sizeof(key->key_name));
+		if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1)
+			return (-1);
+		if (!EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), NULL,
+					key->aes_key, iv))
+			return (-1);
+		if (!HMAC_Init_ex(hctx, key->hmac_key, sizeof(key->hmac_key),
+				  EVP_sha256(), NULL))
+			return (-1);
+		return (1);
+	} else {
+		/* get key by name */
+		key = tls_server_ticket_key(tls_ctx->config, keyname);
+		if (key == NULL)
+			return (0);
+
+		if (!EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), NULL,
+					key->aes_key, iv))
+			return (-1);
+		if (!HMAC_Init_ex(hctx, key->hmac_key, sizeof(key->hmac_key),
+				  EVP_sha256(), NULL))
+			return (-1);
+
+		/* renew the ticket if it was not made with the current key */
+		if (key != &tls_ctx->config->ticket_keys[0])
+			return (2);
+		return (1);
+	}
+}
+
 int tls_configure_server(struct tls *ctx)
 {
 	EC_KEY *ecdh_key;
 	STACK_OF(X509_NAME) * cert_stack;
-	unsigned char sid[SSL_MAX_SSL_SESSION_ID_LENGTH];
 
 	if ((ctx->ssl_ctx = SSL_CTX_new(SSLv23_server_method())) == NULL) {
 		tls_set_errorx(ctx, "ssl context failure");
@@ -142,19 +224,32 @@ int tls_configure_server(struct tls *ctx)
 	}
 
 	/*
-	 * Set session ID context to a random value.  We don't support
-	 * persistent caching of sessions so it is OK to set a temporary
-	 * session ID context that is valid during run time.
+	 * The session ID context is random unless set by the caller, who can
+	 * keep it over configuration changes that do not affect which
+	 * sessions may be resumed.
 	 */
-	if (!RAND_bytes(sid, sizeof(sid))) {
-		tls_set_errorx(ctx, "failed to generate session id");
-		goto err;
-	}
-	if (!SSL_CTX_set_session_id_context(ctx->ssl_ctx, sid, sizeof(sid))) {
+	if (!SSL_CTX_set_session_id_context(ctx->ssl_ctx, ctx->config->session_id,
+					    sizeof(ctx->config->session_id))) {
 		tls_set_errorx(ctx, "failed to set session id context");
 		goto err;
 	}
 
+	if (ctx->config->session_lifetime > 0) {
+		SSL_CTX_set_timeout(ctx->ssl_ctx, ctx->config->session_lifetime);
+		SSL_CTX_sess_set_cache_size(ctx->ssl_ctx, ctx->config->session_cache_size);
+		if (tls_server_ticket_key(ctx->config, NULL) != NULL) {
+			SSL_CTX_set_app_data(ctx->ssl_ctx, ctx);
+			if (!SSL_CTX_set_tlsext_ticket_key_cb(ctx->ssl_ctx,
+							      tls_server_ticket_cb)) {
+				tls_set_errorx(ctx, "failed to set the TLS ticket callback");
+				goto err;
+			}
+		}
+	} else {
+		SSL_CTX_set_session_cache_mode(ctx->ssl_ctx, SSL_SESS_CACHE_OFF);
+		SSL_CTX_set_options(ctx->ssl_ctx, SSL_OP_NO_TICKET);
+	}
+
 	cert_stack = SSL_load_client_CA_file(ctx->config->ca_file);
 	SSL_CTX_set_client_CA_list(ctx->ssl_ctx, cert_stack);
 
@@ -227,6 +227,39 @@ static bool fake_set(PgSocket *admin, const char *key, const char *val)
 	return got;
 }
 
+/* settings that the deadlines in the timeout timer wheel depend on */
+static const char *const timeout_param_list[] = {
+	"client_idle_timeout",
+	"client_login_timeout",
+	"query_timeout",
+	"query_wait_timeout",
+	"cancel_wait_timeout",
+	"idle_transaction_timeout",
+	"transaction_timeout",
+	"server_connect_timeout",
+	"server_idle_timeout",
+	"server_lifetime",
+	"server_check_delay",
+	"server_check_query",
+	"server_fast_close",
+	"default_pool_size",
+	"min_pool_size",
+	"predictive_prewarm",
+	"predictive_prewarm_lead",
+	NULL
+};
+
+static bool is_timeout_param(const char *key)
+{
+	const char *const *p;
+
+	for (p = timeout_param_list; *p; p++) {
+		if (strcasecmp(key, *p) == 0)
+			return true;
+	}
+	return false;
+}
+
 /* Command: SET key = val; */
 static bool admin_set(PgSocket *admin, const char *key, const char *val)
 {
@@ -247,6 +280,8 @@ static bool admin_set(PgSocket *admin, const char *key, const char *val)
 				if (!sbuf_tls_setup())
 					pktbuf_write_Notice(buf, "TLS settings could not be applied, still using old configuration");
 			}
+			if (is_timeout_param(key))
+				rearm_timeouts();
 			snprintf(tmp, sizeof(tmp), "SET %s=%s", key, val);
 			return admin_flush(admin, buf, tmp);
 		} else {
@@ -343,8 +378,9 @@ static bool show_one_fd(PgSocket *admin, PgSocket *sk)
 	const char *password = NULL;
 	bool send_scram_keys = false;
 
-	/* Skip TLS sockets */
-	if (sk->sbuf.tls || (sk->link && sk->link->sbuf.tls))
+	/* Skip TLS and compressed sockets */
+	if (sk->sbuf.tls || sk->sbuf.compress
+	    || (sk->link && (sk->link->sbuf.tls || sk->link->sbuf.compress)))
 		return true;
 
 	mbuf_init_fixed_reader(&tmp, sk->cancel_key, 8);
@@ -811,6 +847,7 @@ static bool admin_show_servers(PgSocket *admin, const char *arg)
 		show_socket_list(buf, &pool->tested_server_list, "tested", false);
 		show_socket_list(buf, &pool->new_server_list, "new", false);
 		show_socket_list(buf, &pool->active_cancel_server_list, "active_cancel", false);
+		show_socket_list(buf, &pool->cancel_standby_server_list, "cancel_standby", false);
 		show_socket_list(buf, &pool->being_canceled_server_list, "being_canceled", false);
 	}
 	statlist_for_each(item, &peer_pool_list) {
@@ -992,30 +1029,161 @@ static bool admin_show_peer_pools(PgSocket *admin, const char *arg)
 	return true;
 }
 
+/* Command: SHOW COMPRESSION */
+static bool admin_show_compression(PgSocket *admin, const char *arg)
+{
+	const struct SBufCompressStats *st = &sbuf_compress_stats;
+	char send_ratio[32], recv_ratio[32];
+	PktBuf *buf;
+
+	snprintf(send_ratio, sizeof(send_ratio), "%.2f",
+		 st->send_wire_bytes ? (double)st->send_raw_bytes / st->send_wire_bytes : 0.0);
+	snprintf(recv_ratio, sizeof(recv_ratio), "%.2f",
+		 st->recv_wire_bytes ? (double)st->recv_raw_bytes / st->recv_wire_bytes : 0.0);
+
+	buf = pktbuf_dynamic(256);
+	if (!buf) {
+		admin_error(admin, "no mem");
+		return true;
+	}
+	pktbuf_write_RowDescription(buf, "sNNsN",
+				    "direction", "raw_bytes", "wire_bytes",
+				    "ratio", "time_us");
+	pktbuf_write_DataRow(buf, "sqqsq", "send",
+			     st->send_raw_bytes, st->send_wire_bytes,
+			     send_ratio, st->send_time);
+	pktbuf_write_DataRow(buf, "sqqsq", "recv",
+			     st->recv_raw_bytes, st->recv_wire_bytes,
+			     recv_ratio, st->recv_time);
+	admin_flush(admin, buf, "SHOW");
+	return true;
+}
 
 static void slab_stat_cb(void *arg, const char *slab_name,
 			 unsigned size, unsigned free,
-			 unsigned total)
+			 unsigned total, size_t reserved)
 {
 	PktBuf *buf = arg;
-	unsigned alloc = total * size;
-	pktbuf_write_DataRow(buf, "siiii", slab_name,
-			     size, total - free, free, alloc);
+	uint64_t alloc = (uint64_t)total * size;
+	uint64_t inuse = (uint64_t)(total - free) * size;
+	pktbuf_write_DataRow(buf, "siiiqqq", slab_name,
+			     size, total - free, free, alloc,
+			     inuse, (uint64_t)reserved);
 }
 
 /* Command: SHOW MEM */
 static bool admin_show_mem(PgSocket *admin, const char *arg)
 {
 	PktBuf *buf;
+	unsigned ps_used, ps_unused, ps_count;
+	uint64_t ps_bytes;
+	unsigned arena_page, arena_used, arena_free;
+	uint64_t arena_carved, arena_inuse, arena_reserved;
 
 	buf = pktbuf_dynamic(256);
 	if (!buf) {
 		admin_error(admin, "no mem");
 		return true;
 	}
-	pktbuf_write_RowDescription(buf, "siiii", "name",
-				    "size", "used", "free", "memtotal");
+	pktbuf_write_RowDescription(buf, "siiiqqq", "name",
+				    "size", "used", "free", "memtotal",
+				    "memused", "memreserved");
 	slab_stats(slab_stat_cb, buf);
+
+	/* global prepared statement hash, entries have varying size */
+	prepared_statement_mem_stats(&ps_used, &ps_unused, &ps_bytes);
+	ps_count = ps_used + ps_unused;
+	pktbuf_write_DataRow(buf, "siiiqqq", "prepared_statements",
+			     ps_count ? (int)(ps_bytes / ps_count) : 0,
+			     ps_used, ps_unused, ps_bytes,
+			     ps_count ? ps_bytes * ps_used / ps_count : 0,
+			     ps_bytes);
+
+	/* huge page arena, blocks of varying size */
+	if (arena_mem_stats(&arena_page, &arena_used, &arena_free,
+			    &arena_carved, &arena_inuse, &arena_reserved)) {
+		pktbuf_write_DataRow(buf, "siiiqqq", "huge_page_arena",
+				     arena_page, arena_used, arena_free,
+				     arena_carved, arena_inuse, arena_reserved);
+	}
+	admin_flush(admin, buf, "SHOW");
+	return true;
+}
+
+static void show_prepared_from_list(PktBuf *buf, struct StatList *list)
+{
+	struct List *item;
+	PgSocket *sk;
+
+	statlist_for_each(item, list) {
+		sk = container_of(item, PgSocket, head);
+		/* SHOW FDS does not pass these over */
+		if (sk->sbuf.tls || sk->sbuf.compress
+		    || (sk->link && (sk->link->sbuf.tls || sk->link->sbuf.compress)))
+			continue;
+		write_socket_prepared_statement_rows(buf, sk);
+	}
+}
+
+/*
+ * Command: SHOW PREPARED_STATEMENTS
+ *
+ * Used after SHOW FDS on online restart, refers to the sockets by the fd
+ * they were shown with.
+ */
+static bool admin_show_prepared_statements(PgSocket *admin, const char *arg)
+{
+	struct List *item;
+	PgPool *pool;
+	PktBuf *buf;
+
+	if (!admin->admin_user)
+		return admin_error(admin, "admin access needed");
+
+	buf = pktbuf_dynamic(1024);
+	if (!buf) {
+		admin_error(admin, "no mem");
+		return true;
+	}
+	pktbuf_write_RowDescription(buf, "siqsb", "task", "fd", "id", "name", "statement");
+	write_prepared_statement_rows(buf);
+
+	statlist_for_each(item, &pool_list) {
+		pool = container_of(item, PgPool, head);
+		if (pool->db->admin)
+			continue;
+		show_prepared_from_list(buf, &pool->active_client_list);
+		show_prepared_from_list(buf, &pool->waiting_client_list);
+		show_prepared_from_list(buf, &pool->active_server_list);
+		show_prepared_from_list(buf, &pool->idle_server_list);
+		show_prepared_from_list(buf, &pool->used_server_list);
+		show_prepared_from_list(buf, &pool->tested_server_list);
+		show_prepared_from_list(buf, &pool->new_server_list);
+	}
+	admin_flush(admin, buf, "SHOW");
+	return true;
+}
+
+/*
+ * Command: SHOW TLS_TICKET_KEYS
+ *
+ * Used on online restart after SHOW FDS, so that clients can resume their
+ * TLS sessions with the new process.
+ */
+static bool admin_show_tls_ticket_keys(PgSocket *admin, const char *arg)
+{
+	PktBuf *buf;
+
+	if (!admin->admin_user)
+		return admin_error(admin, "admin access needed");
+
+	buf = pktbuf_dynamic(256);
+	if (!buf) {
+		admin_error(admin, "no mem");
+		return true;
+	}
+	pktbuf_write_RowDescription(buf, "sqb", "task", "keyrev", "key");
+	sbuf_tls_write_ticket_keys(buf);
 	admin_flush(admin, buf, "SHOW");
 	return true;
 }
@@ -1112,6 +1280,10 @@ static bool admin_show_dns_zones(PgSocket *admin, const char *arg)
 static void show_one_param(void *arg, const char *name, const char *val, const char *defval, bool reloadable)
 {
 	PktBuf *buf = arg;
+
+	/* secrets are not shown, only whether one is set */
+	if (strcmp(name, "peer_link_secret") == 0 && *val)
+		val = "********";
 	pktbuf_write_DataRow(buf, "ssss", name, val, defval,
 			     reloadable ? "yes" : "no");
 }
@@ -1288,6 +1460,7 @@ static bool admin_cmd_pause(PgSocket *admin, const char *arg)
 		if (db == admin->pool->db)
 			return admin_error(admin, "cannot pause admin db: %s", arg);
 		db->db_paused = true;
+		mark_db_pools_ready(db);
 		if (count_db_active(db) > 0)
 			admin->wait_for_response = true;
 		else
@@ -1308,6 +1481,7 @@ static bool admin_cmd_reconnect(PgSocket *admin, const char *arg)
 		PgPool *pool;
 
 		log_info("RECONNECT command issued");
+		invalidate_describe_cache();
 		statlist_for_each(item, &pool_list) {
 			pool = container_of(item, PgPool, head);
 			if (pool->db->admin)
@@ -1323,6 +1497,7 @@ static bool admin_cmd_reconnect(PgSocket *admin, const char *arg)
 			return admin_error(admin, "no such database: %s", arg);
 		if (db == admin->pool->db)
 			return admin_error(admin, "cannot reconnect admin db: %s", arg);
+		invalidate_describe_cache();
 		tag_database_dirty(db);
 	}
 
@@ -1514,6 +1689,7 @@ static bool admin_cmd_wait_close(PgSocket *admin, const char *arg)
 			pool = container_of(item, PgPool, head);
 			db = pool->db;
 			db->db_wait_close = true;
+			pool_mark_ready(pool);
 			active += count_db_active(db);
 		}
 		if (active > 0)
@@ -1530,6 +1706,7 @@ static bool admin_cmd_wait_close(PgSocket *admin, const char *arg)
 		if (db == admin->pool->db)
 			return admin_error(admin, "cannot wait in admin db: %s", arg);
 		db->db_wait_close = true;
+		mark_db_pools_ready(db);
 		if (count_db_active(db) > 0)
 			admin->wait_for_response = true;
 		else
@@ -1589,7 +1766,7 @@ static bool admin_show_help(PgSocket *admin, const char *arg)
 		     "D\n\tSHOW HELP|CONFIG|DATABASES"
 		     "|POOLS|CLIENTS|SERVERS|USERS|VERSION\n"
 		     "\tSHOW PEERS|PEER_POOLS\n"
-		     "\tSHOW FDS|SOCKETS|ACTIVE_SOCKETS|LISTS|MEM|STATE\n"
+		     "\tSHOW FDS|PREPARED_STATEMENTS|TLS_TICKET_KEYS|SOCKETS|ACTIVE_SOCKETS|LISTS|MEM|STATE|COMPRESSION\n"
 		     "\tSHOW DNS_HOSTS|DNS_ZONES\n"
 		     "\tSHOW STATS|STATS_TOTALS|STATS_AVERAGES|TOTALS\n"
 		     "\tSET key = arg\n"
@@ -1651,6 +1828,7 @@ static bool admin_show_totals(PgSocket *admin, const char *arg)
 
 static struct cmd_lookup show_map [] = {
 	{"clients", admin_show_clients},
+	{"compression", admin_show_compression},
 	{"config", admin_show_config},
 	{"databases", admin_show_databases},
 	{"fds", admin_show_fds},
@@ -1659,12 +1837,14 @@ static struct cmd_lookup show_map [] = {
 	{"peers", admin_show_peers},
 	{"peer_pools", admin_show_peer_pools},
 	{"pools", admin_show_pools},
+	{"prepared_statements", admin_show_prepared_statements},
 	{"servers", admin_show_servers},
 	{"sockets", admin_show_sockets},
 	{"active_sockets", admin_show_active_sockets},
 	{"stats", admin_show_stats},
 	{"stats_totals", admin_show_stats_totals},
 	{"stats_averages", admin_show_stats_averages},
+	{"tls_ticket_keys", admin_show_tls_ticket_keys},
 	{"users", admin_show_users},
 	{"version", admin_show_version},
 	{"totals", admin_show_totals},
@@ -0,0 +1,293 @@
+/*
+ * PgBouncer - Lightweight connection pooler for PostgreSQL.
+ *
+ * Copyright (c) 2007-2009  Marko Kreen, Skype Technologies OÜ
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/*
+ * Huge-page memory arena.
+ *
+ * With many connections the socket and packet buffer slabs spread over a
+ * lot of 4 kB pages.  If huge_page_arena_size is set, their chunks are
+ * carved from one mapping backed by huge pages instead: explicit ones
+ * (MAP_HUGETLB) if the kernel has them reserved, otherwise transparent
+ * huge pages via madvise().  If neither works, or the arena is full, the
+ * normal allocator is used.
+ *
+ * Freed blocks are kept on per-size free lists for reuse, the memory of
+ * the arena is never given back to the system.
+ */
+
+#include "bouncer.h"
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#if defined(HAVE_MMAP) && !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* the usual default huge page size, the arena is aligned to it */
+#define ARENA_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/* freed blocks of one size */
+struct ArenaClass {
+	struct List head;
+	struct StatList freelist;
+	size_t size;
+};
+
+/* header before each block */
+struct ArenaBlock {
+	struct List head;
+	struct ArenaClass *cls;
+};
+
+#define BLOCK_HDR_SIZE CUSTOM_ALIGN(sizeof(struct ArenaBlock), 16)
+
+struct Arena {
+	char *base;
+	size_t size;
+	size_t used;		/* bytes carved from base */
+	size_t inuse;		/* bytes in live blocks */
+	unsigned live_count;
+	unsigned free_count;
+	void *map;		/* what to munmap() */
+	size_t map_size;
+	struct StatList class_list;
+};
+
+static struct Arena arena;
+static bool arena_active;
+
+static struct ArenaClass *find_class(size_t size)
+{
+	struct List *item;
+	struct ArenaClass *cls;
+
+	statlist_for_each(item, &arena.class_list) {
+		cls = container_of(item, struct ArenaClass, head);
+		if (cls->size == size)
+			return cls;
+	}
+
+	cls = calloc(1, sizeof(*cls));
+	if (!cls)
+		return NULL;
+	list_init(&cls->head);
+	statlist_init(&cls->freelist, "arena_freelist");
+	cls->size = size;
+	statlist_append(&arena.class_list, &cls->head);
+	return cls;
+}
+
+static bool in_arena(const void *p)
+{
+	const char *c = p;
+	return arena_active && c >= arena.base && c < arena.base + arena.size;
+}
+
+static void *arena_alloc(void *ctx, size_t len)
+{
+	struct ArenaClass *cls;
+	struct ArenaBlock *blk;
+	struct List *item;
+	size_t size = CUSTOM_ALIGN(len, 16);
+
+	cls = find_class(size);
+	if (!cls)
+		return NULL;
+
+	item = statlist_pop(&cls->freelist);
+	if (item) {
+		blk = container_of(item, struct ArenaBlock, head);
+		arena.free_count--;
+	} else if (arena.size - arena.used >= BLOCK_HDR_SIZE + size) {
+		blk = (struct ArenaBlock *)(arena.base + arena.used);
+		arena.used += BLOCK_HDR_SIZE + size;
+		list_init(&blk->head);
+		blk->cls = cls;
+	} else {
+		/* arena is full */
+		return malloc(len);
+	}
+
+	arena.live_count++;
+	arena.inuse += size;
+	return (char *)blk + BLOCK_HDR_SIZE;
+}
+
+static void arena_free(void *ctx, void *p)
+{
+	struct ArenaBlock *blk;
+
+	if (!in_arena(p)) {
+		free(p);
+		return;
+	}
+
+	blk = (struct ArenaBlock *)((char *)p - BLOCK_HDR_SIZE);
+	statlist_prepend(&blk->cls->freelist, &blk->head);
+	arena.live_count--;
+	arena.free_count++;
+	arena.inuse -= blk->cls->size;
+}
+
+static void *arena_realloc(void *ctx, void *p, size_t len)
+{
+	struct ArenaBlock *blk;
+	void *res;
+
+	if (!in_arena(p))
+		return realloc(p, len);
+
+	blk = (struct ArenaBlock *)((char *)p - BLOCK_HDR_SIZE);
+	if (len <= blk->cls->size)
+		return p;
+	res = arena_alloc(ctx, len);
+	if (res) {
+		memcpy(res, p, blk->cls->size);
+		arena_free(ctx, p);
+	}
+	return res;
+}
+
+static const struct CxOps arena_ops = {
+	arena_alloc,
+	arena_realloc,
+	arena_free,
+	NULL,
+};
+
+static const struct CxMem arena_mem = { &arena_ops, NULL };
+
+#ifdef HAVE_MMAP
+
+/* explicit huge pages, fails unless enough of them are reserved */
+static bool map_hugetlb(size_t size)
+{
+#ifdef MAP_HUGETLB
+	void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (p == MAP_FAILED) {
+		log_debug("huge_page_arena: MAP_HUGETLB failed: %s", strerror(errno));
+		return false;
+	}
+	arena.map = p;
+	arena.base = p;
+	arena.map_size = arena.size = size;
+	return true;
+#else
+	return false;
+#endif
+}
+
+/* normal mapping, aligned to huge pages, and ask for transparent ones */
+static bool map_thp(size_t size)
+{
+#ifdef MADV_HUGEPAGE
+	size_t map_size = size + ARENA_HUGE_PAGE_SIZE;
+	char *p = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		log_warning("huge_page_arena: mmap failed: %s", strerror(errno));
+		return false;
+	}
+	arena.map = p;
+	arena.map_size = map_size;
+	arena.base = (char *)CUSTOM_ALIGN(p, ARENA_HUGE_PAGE_SIZE);
+	arena.size = size;
+	if (madvise(arena.base, size, MADV_HUGEPAGE) < 0) {
+		log_warning("huge_page_arena: transparent huge pages not available: %s", strerror(errno));
+		munmap(p, map_size);
+		return false;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+#endif
+
+void arena_setup(void)
+{
+	size_t size = cf_huge_page_arena_size;
+
+	if (size == 0)
+		return;
+	size = CUSTOM_ALIGN(size, ARENA_HUGE_PAGE_SIZE);
+
+	memset(&arena, 0, sizeof(arena));
+	statlist_init(&arena.class_list, "arena_class_list");
+
+#ifdef HAVE_MMAP
+	if (map_hugetlb(size)) {
+		log_info("huge_page_arena: %zu MB of explicit huge pages", size >> 20);
+		arena_active = true;
+	} else if (map_thp(size)) {
+		log_info("huge_page_arena: %zu MB with transparent huge pages", size >> 20);
+		arena_active = true;
+	}
+#endif
+	if (!arena_active)
+		log_warning("huge_page_arena: huge pages not available, using normal memory");
+}
+
+void arena_cleanup(void)
+{
+	struct List *item, *tmp;
+	struct ArenaClass *cls;
+
+	if (!arena_active)
+		return;
+
+	statlist_for_each_safe(item, &arena.class_list, tmp) {
+		cls = container_of(item, struct ArenaClass, head);
+		statlist_remove(&arena.class_list, item);
+		free(cls);
+	}
+#ifdef HAVE_MMAP
+	munmap(arena.map, arena.map_size);
+#endif
+	memset(&arena, 0, sizeof(arena));
+	arena_active = false;
+}
+
+/* allocator for slabs that should live in the arena */
+CxMem *arena_cx(void)
+{
+	if (!arena_active)
+		return USUAL_ALLOC;
+	return &arena_mem;
+}
+
+/* returns false if the arena is not in use */
+bool arena_mem_stats(unsigned *page_size_p, unsigned *used_p, unsigned *free_p,
+		     uint64_t *carved_p, uint64_t *inuse_p, uint64_t *reserved_p)
+{
+	if (!arena_active)
+		return false;
+
+	*page_size_p = ARENA_HUGE_PAGE_SIZE;
+	*used_p = arena.live_count;
+	*free_p = arena.free_count;
+	*carved_p = arena.used;
+	*inuse_p = arena.inuse;
+	*reserved_p = arena.size;
+	return true;
+}
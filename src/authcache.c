@@ -0,0 +1,348 @@
+/*
+ * PgBouncer - Lightweight connection pooler for PostgreSQL.
+ *
+ * Copyright (c) 2007-2009  Marko Kreen, Skype Technologies OÜ
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Cache of auth_query results.
+ *
+ * Without it every login of a user that is not in auth_file needs a
+ * server connection from the auth pool and a round trip to run
+ * auth_query.  A positive entry keeps the secret the query returned for
+ * auth_query_cache_ttl, a negative entry remembers for
+ * auth_query_cache_negative_ttl that the query returned no row.
+ *
+ * Entries are keyed by database name rather than by PgDatabase, so that
+ * the cache does not have to follow databases being dropped.  At most
+ * auth_query_cache_size entries are kept, the least recently used one is
+ * evicted first.  RELOAD empties the cache.
+ *
+ * Independent of the cache, only one auth_query per database and user is
+ * run at a time.  Logins that arrive while it runs are paused on the
+ * waiter list of that lookup.  When it completes they get its result,
+ * when the client running it goes away they start over, and one of them
+ * runs the query again.  Waiters are resumed from per_loop_maint(), not
+ * from inside the callbacks of the lookup.
+ */
+
+#include "bouncer.h"
+
+struct AuthCacheEntry {
+	UT_hash_handle hh;
+	struct List lru_node;	/* in auth_cache_lru, most recently used last */
+	usec_t expires;
+	char *passwd;		/* NULL for a negative entry */
+	char key[];		/* "dbname\0username" */
+};
+
+struct AuthQueryFlight {
+	UT_hash_handle hh;
+	PgSocket *leader;	/* client that runs the auth_query */
+	struct List waiters;	/* PgLoginState.auth_query_node of paused logins */
+	char key[];
+};
+
+static struct AuthCacheEntry *auth_cache;
+static STATLIST(auth_cache_lru);
+
+static struct AuthQueryFlight *auth_query_flights;
+
+/* waiters whose lookup has ended, to be resumed by per_loop_maint() */
+static LIST(auth_query_ready_list);
+
+#define AUTH_CACHE_KEY_MAX (MAX_DBNAME + MAX_USERNAME)
+
+/* returns 0 if the names are too long to be cached */
+static size_t make_key(char *buf, const PgDatabase *db, const char *user)
+{
+	size_t dblen = strlen(db->name) + 1;
+	size_t userlen = strlen(user);
+
+	if (dblen > MAX_DBNAME || userlen >= MAX_USERNAME)
+		return 0;
+	memcpy(buf, db->name, dblen);
+	memcpy(buf + dblen, user, userlen);
+	return dblen + userlen;
+}
+
+static struct AuthCacheEntry *find_entry(PgDatabase *db, const char *user)
+{
+	struct AuthCacheEntry *entry;
+	char key[AUTH_CACHE_KEY_MAX];
+	size_t keylen = make_key(key, db, user);
+
+	if (!keylen)
+		return NULL;
+	HASH_FIND(hh, auth_cache, key, keylen, entry);
+	return entry;
+}
+
+static void drop_entry(struct AuthCacheEntry *entry)
+{
+	HASH_DELETE(hh, auth_cache, entry);
+	statlist_remove(&auth_cache_lru, &entry->lru_node);
+	free(entry->passwd);
+	free(entry);
+}
+
+enum AuthCacheResult auth_cache_lookup(PgDatabase *db, const char *user, const char **passwd_p)
+{
+	struct AuthCacheEntry *entry;
+
+	if (!auth_cache)
+		return AUTH_CACHE_MISS;
+
+	entry = find_entry(db, user);
+	if (!entry)
+		return AUTH_CACHE_MISS;
+	if (entry->expires <= get_cached_time()) {
+		drop_entry(entry);
+		return AUTH_CACHE_MISS;
+	}
+
+	statlist_remove(&auth_cache_lru, &entry->lru_node);
+	statlist_append(&auth_cache_lru, &entry->lru_node);
+
+	if (!entry->passwd)
+		return AUTH_CACHE_NOT_FOUND;
+	*passwd_p = entry->passwd;
+	return AUTH_CACHE_FOUND;
+}
+
+/*
+ * Remember the result of auth_query for the user.  passwd is NULL if the
+ * query returned no row.
+ */
+void auth_cache_store(PgDatabase *db, const char *user, const char *passwd)
+{
+	struct AuthCacheEntry *entry;
+	usec_t ttl = passwd ? cf_auth_query_cache_ttl : cf_auth_query_cache_negative_ttl;
+	char key[AUTH_CACHE_KEY_MAX];
+	char *copy = NULL;
+	size_t keylen;
+
+	entry = find_entry(db, user);
+	if (entry)
+		drop_entry(entry);
+
+	keylen = make_key(key, db, user);
+	if (!keylen || ttl <= 0 || cf_auth_query_cache_size <= 0)
+		return;
+
+	if (passwd) {
+		copy = strdup(passwd);
+		if (!copy)
+			return;
+	}
+	entry = malloc(sizeof(*entry) + keylen);
+	if (!entry) {
+		free(copy);
+		return;
+	}
+	memcpy(entry->key, key, keylen);
+	entry->passwd = copy;
+	entry->expires = get_cached_time() + ttl;
+
+	while (statlist_count(&auth_cache_lru) >= cf_auth_query_cache_size) {
+		struct List *item = statlist_first(&auth_cache_lru);
+		drop_entry(container_of(item, struct AuthCacheEntry, lru_node));
+	}
+
+	list_init(&entry->lru_node);
+	statlist_append(&auth_cache_lru, &entry->lru_node);
+	HASH_ADD(hh, auth_cache, key, keylen, entry);
+}
+
+/* drop the cached result, eg. because the cached secret did not work */
+void auth_cache_forget(PgDatabase *db, const char *user)
+{
+	struct AuthCacheEntry *entry;
+
+	entry = find_entry(db, user);
+	if (entry) {
+		log_debug("auth_query cache: forgetting %s/%s", db->name, user);
+		drop_entry(entry);
+	}
+}
+
+/* drop expired entries, called from janitor */
+void auth_cache_expire(void)
+{
+	struct AuthCacheEntry *entry, *tmp;
+	usec_t now = get_cached_time();
+
+	HASH_ITER(hh, auth_cache, entry, tmp) {
+		if (entry->expires <= now)
+			drop_entry(entry);
+	}
+}
+
+void auth_cache_reset(void)
+{
+	struct AuthCacheEntry *entry, *tmp;
+
+	HASH_ITER(hh, auth_cache, entry, tmp) {
+		drop_entry(entry);
+	}
+}
+
+static struct AuthQueryFlight *find_flight(PgDatabase *db, const char *user)
+{
+	struct AuthQueryFlight *flight;
+	char key[AUTH_CACHE_KEY_MAX];
+	size_t keylen = make_key(key, db, user);
+
+	if (!keylen)
+		return NULL;
+	HASH_FIND(hh, auth_query_flights, key, keylen, flight);
+	return flight;
+}
+
+static void unlink_waiter(PgLoginState *login_state)
+{
+	list_del(&login_state->auth_query_node);
+	login_state->auth_query_waiter = NULL;
+}
+
+/* end the lookup, its waiters are resumed on the next loop */
+static void land_flight(struct AuthQueryFlight *flight)
+{
+	struct List *item;
+	PgLoginState *login_state;
+
+	while ((item = list_pop(&flight->waiters)) != NULL) {
+		login_state = container_of(item, PgLoginState, auth_query_node);
+		list_append(&auth_query_ready_list, &login_state->auth_query_node);
+	}
+	flight->leader->login_state->auth_query_flight = NULL;
+	HASH_DELETE(hh, auth_query_flights, flight);
+	free(flight);
+}
+
+/*
+ * If another client is already looking up the user, pause this login
+ * until it is done.  Returns true if the client has been parked, or
+ * disconnected on failure.
+ */
+bool auth_query_join(PgSocket *client, const char *user)
+{
+	struct AuthQueryFlight *flight;
+	PgLoginState *login_state;
+
+	flight = find_flight(client->db, user);
+	if (!flight || flight->leader == client)
+		return false;
+
+	login_state = socket_login_state(client);
+	if (!login_state) {
+		disconnect_client(client, true, "out of memory");
+		return true;
+	}
+	if (!sbuf_pause(&client->sbuf)) {
+		disconnect_client(client, true, "pause failed");
+		return true;
+	}
+	slog_debug(client, "waiting for running auth_query of user %s", user);
+	client->wait_for_user = true;
+	login_state->auth_query_waiter = client;
+	list_append(&flight->waiters, &login_state->auth_query_node);
+	return true;
+}
+
+/* register the client as the one running auth_query for the user */
+void auth_query_lead(PgSocket *client, const char *user)
+{
+	struct AuthQueryFlight *flight;
+	char key[AUTH_CACHE_KEY_MAX];
+	size_t keylen;
+
+	if (client->login_state->auth_query_flight)
+		return;
+	keylen = make_key(key, client->db, user);
+	if (!keylen)
+		return;
+
+	/* without memory the query is just not shared */
+	flight = malloc(sizeof(*flight) + keylen);
+	if (!flight)
+		return;
+	memcpy(flight->key, key, keylen);
+	flight->leader = client;
+	list_init(&flight->waiters);
+	HASH_ADD(hh, auth_query_flights, key, keylen, flight);
+	client->login_state->auth_query_flight = flight;
+}
+
+/* auth_query has returned, hand its result to the waiters */
+void auth_query_done(PgSocket *client)
+{
+	struct AuthQueryFlight *flight = client->login_state->auth_query_flight;
+	struct List *item;
+	PgLoginState *login_state;
+
+	if (!flight)
+		return;
+	list_for_each(item, &flight->waiters) {
+		login_state = container_of(item, PgLoginState, auth_query_node);
+		login_state->auth_query_waiter->login_user_credentials = client->login_user_credentials;
+	}
+	land_flight(flight);
+}
+
+/* called when the login state of a socket goes away */
+void auth_query_abandon(PgSocket *sk)
+{
+	struct AuthQueryFlight *flight = sk->login_state->auth_query_flight;
+	struct List *item;
+	PgLoginState *login_state;
+
+	if (sk->login_state->auth_query_waiter)
+		unlink_waiter(sk->login_state);
+	if (!flight)
+		return;
+
+	/* no result, so the waiters have to start their login over */
+	list_for_each(item, &flight->waiters) {
+		login_state = container_of(item, PgLoginState, auth_query_node);
+		login_state->auth_query_waiter->wait_for_user = false;
+	}
+	land_flight(flight);
+}
+
+void auth_query_resume_waiters(void)
+{
+	struct List *item;
+	PgLoginState *login_state;
+	PgSocket *client;
+
+	while ((item = list_pop(&auth_query_ready_list)) != NULL) {
+		login_state = container_of(item, PgLoginState, auth_query_node);
+		client = login_state->auth_query_waiter;
+		login_state->auth_query_waiter = NULL;
+
+		if (client->wait_for_user) {
+			if (!client->login_user_credentials) {
+				if (cf_log_connections)
+					slog_info(client, "login failed: db=%s", client->db->name);
+				disconnect_client(client, true, "no such user");
+				continue;
+			}
+			if (!check_user_connection_count(client))
+				continue;
+		}
+		sbuf_continue(&client->sbuf);
+	}
+}
@@ -169,11 +169,22 @@ static void start_auth_query(PgSocket *client, const char *username)
 	int res;
 	PktBuf *buf;
 	const char *auth_query = client->db->auth_query ? client->db->auth_query : cf_auth_query;
+	PgLoginState *login_state;
 
 	/* have to fetch user info from db */
 	PgDatabase *auth_db = prepare_auth_database(client);
 	if (!auth_db)
 		return;
+
+	/* the response does not tell which user was asked for */
+	login_state = socket_login_state(client);
+	if (!login_state) {
+		disconnect_client(client, true, "out of memory");
+		return;
+	}
+	safe_strcpy(login_state->auth_query_user, username, sizeof(login_state->auth_query_user));
+	auth_query_lead(client, username);
+
 	client->pool = get_pool(auth_db, client->db->auth_user_credentials);
 	if (!client->pool) {
 		disconnect_client(client, true, "no memory for authentication pool");
@@ -218,6 +229,13 @@ static void start_auth_query(PgSocket *client, const char *username)
 		disconnect_server(client->link, false, "unable to send auth_query");
 }
 
+/* a cached secret that does not work may be outdated, so drop it */
+static void forget_cached_auth_query(PgSocket *client)
+{
+	if (client->auth_query_cached)
+		auth_cache_forget(client->db, client->login_user_credentials->name);
+}
+
 static bool login_via_cert(PgSocket *client, struct HBARule *rule)
 {
 	struct tls *tls = client->sbuf.tls;
@@ -386,8 +404,11 @@ static bool finish_set_pool(PgSocket *client, bool takeover)
 		if (cf_auth_ldap_options == NULL) {
 			disconnect_client(client, true, "auth_ldap_options is null");
 			return false;
+		} else if (!socket_login_state(client)) {
+			disconnect_client(client, true, "out of memory");
+			return false;
 		} else {
-			snprintf(client->ldap_options, MAX_LDAP_CONFIG, "%s", cf_auth_ldap_options);
+			snprintf(client->login_state->ldap_options, MAX_LDAP_CONFIG, "%s", cf_auth_ldap_options);
 			slog_noise(client, "The value of cf_auth_ldap_options is %s", cf_auth_ldap_options);
 		}
 	} else
@@ -409,7 +430,11 @@ static bool finish_set_pool(PgSocket *client, bool takeover)
 		auth = rule->rule_method;
 #ifdef HAVE_LDAP
 		if (auth == AUTH_TYPE_LDAP) {
-			snprintf(client->ldap_options, MAX_LDAP_CONFIG, "%s", rule->auth_options);
+			if (!socket_login_state(client)) {
+				disconnect_client(client, true, "out of memory");
+				return false;
+			}
+			snprintf(client->login_state->ldap_options, MAX_LDAP_CONFIG, "%s", rule->auth_options);
 		}
 #endif
 		slog_noise(client, "HBA Line %d is matched", rule->hba_linenr);
@@ -532,6 +557,42 @@ static bool check_if_need_ldap_authentication(PgSocket *client, const char *dbna
 }
 #endif
 
+/*
+ * Answer the auth_query from the cache if possible.  Returns false if the
+ * query has to be run, otherwise *res_p is what set_pool() returns.
+ */
+static bool use_cached_auth_query(PgSocket *client, const char *username, bool takeover, bool *res_p)
+{
+	const char *passwd;
+
+	switch (auth_cache_lookup(client->db, username, &passwd)) {
+	case AUTH_CACHE_FOUND:
+		slog_debug(client, "using cached auth_query result for user %s", username);
+		client->login_user_credentials = add_dynamic_credentials(client->db, username, passwd);
+		if (!client->login_user_credentials) {
+			disconnect_client(client, true, "bouncer resources exhaustion");
+			*res_p = false;
+			return true;
+		}
+		client->auth_query_cached = true;
+		if (!check_user_connection_count(client)) {
+			*res_p = false;
+			return true;
+		}
+		*res_p = finish_set_pool(client, takeover);
+		return true;
+	case AUTH_CACHE_NOT_FOUND:
+		if (cf_log_connections)
+			slog_info(client, "login failed: db=%s", client->db->name);
+		disconnect_client(client, true, "no such user");
+		*res_p = false;
+		return true;
+	case AUTH_CACHE_MISS:
+		break;
+	}
+	return false;
+}
+
 bool set_pool(PgSocket *client, const char *dbname, const char *username, const char *password, bool takeover)
 {
 	Assert((password && takeover) || (!password && !takeover));
@@ -626,6 +687,7 @@ bool set_pool(PgSocket *client, const char *dbname, const char *username, const
 
 		if (!client->login_user_credentials || client->login_user_credentials->dynamic_passwd) {
 			PgGlobalUser *global_user;
+			bool res;
 			/*
 			 * If the login user specified by the client
 			 * does not exist or if it has no entry in auth_file,
@@ -656,6 +718,10 @@ bool set_pool(PgSocket *client, const char *dbname, const char *username, const
 
 						return finish_set_pool(client, takeover);
 					}
+					if (use_cached_auth_query(client, username, takeover, &res))
+						return res;
+					if (auth_query_join(client, username))
+						return false;
 					start_auth_query(client, username);
 					return false;
 				}
@@ -757,13 +823,13 @@ bool handle_auth_query_response(PgSocket *client, PktHdr *pkt)
 
 		slog_debug(client, "successfully parsed auth_query response for user %s", credentials.name);
 		client->login_user_credentials = add_dynamic_credentials(client->db, credentials.name, credentials.passwd);
-		if (!check_user_connection_count(client)) {
-			return false;
-		}
 		if (!client->login_user_credentials) {
 			disconnect_server(server, false, "unable to allocate new user for auth");
 			return false;
 		}
+		if (!check_user_connection_count(client)) {
+			return false;
+		}
 		break;
 	case PqMsg_NoticeResponse:
 		break;
@@ -777,6 +843,9 @@ bool handle_auth_query_response(PgSocket *client, PktHdr *pkt)
 		break;
 	case PqMsg_ReadyForQuery:
 		sbuf_prepare_skip(&client->link->sbuf, pkt->len);
+		auth_cache_store(client->db, client->login_state->auth_query_user,
+				 client->login_user_credentials ? client->login_user_credentials->passwd : NULL);
+		auth_query_done(client);
 		if (!client->login_user_credentials) {
 			if (cf_log_connections)
 				slog_info(client, "login failed: db=%s", client->db->name);
@@ -1142,14 +1211,14 @@ static bool scram_client_first(PgSocket *client, uint32_t datalen, const uint8_t
 		}
 	}
 
-	if (!build_server_first_message(&client->scram_state, user, user->mock_auth ? NULL : user->passwd))
+	if (!build_server_first_message(&client->login_state->scram_state, user, user->mock_auth ? NULL : user->passwd))
 		goto failed;
-	slog_debug(client, "SCRAM server-first-message = \"%s\"", client->scram_state.server_first_message);
+	slog_debug(client, "SCRAM server-first-message = \"%s\"", client->login_state->scram_state.server_first_message);
 
 	SEND_generic(res, client, PqMsg_AuthenticationRequest, "ib",
 		     AUTH_REQ_SASL_CONT,
-		     client->scram_state.server_first_message,
-		     strlen(client->scram_state.server_first_message));
+		     client->login_state->scram_state.server_first_message,
+		     strlen(client->login_state->scram_state.server_first_message));
 
 	free(ibuf);
 	return res;
@@ -1180,9 +1249,9 @@ static bool scram_client_final(PgSocket *client, uint32_t datalen, const uint8_t
 				       &proof))
 		goto failed;
 	slog_debug(client, "SCRAM client-final-message-without-proof = \"%s\"",
-		   client->scram_state.client_final_message_without_proof);
+		   client->login_state->scram_state.client_final_message_without_proof);
 
-	if (!verify_final_nonce(&client->scram_state, client_final_nonce)) {
+	if (!verify_final_nonce(&client->login_state->scram_state, client_final_nonce)) {
 		slog_error(client, "invalid SCRAM response (nonce does not match)");
 		goto failed;
 	}
@@ -1213,11 +1282,55 @@ failed:
 	return false;
 }
 
+/*
+ * A peer link is only accepted from a peer listed in [peers] that connects
+ * from the host given for it there and knows peer_link_secret.
+ */
+/*
+ * Compare a received secret with the configured one.  The time taken only
+ * depends on the length of the configured secret, so it cannot be guessed
+ * byte by byte from the response times.
+ */
+static bool secret_matches(const char *received, const char *secret)
+{
+	size_t received_len = strlen(received);
+	size_t secret_len = strlen(secret);
+	unsigned char diff = received_len != secret_len;
+	size_t i;
+
+	for (i = 0; i < secret_len; i++)
+		diff |= (unsigned char)(secret[i] ^ (i < received_len ? received[i] : 0));
+	return diff == 0;
+}
+
+static bool peer_link_allowed(PgSocket *client, uint32_t peer_id, const char *secret)
+{
+	PgDatabase *peer;
+	PgAddr addr;
+
+	if (cf_peer_id == 0 || !*cf_peer_link_secret || peer_id == (uint32_t)cf_peer_id)
+		return false;
+	if (!secret_matches(secret, cf_peer_link_secret))
+		return false;
+
+	peer = find_peer(peer_id);
+	if (!peer)
+		return false;
+	if (peer->host[0] == '/' || peer->host[0] == '@')
+		return pga_is_unix(&client->remote_addr);
+	/* a host name cannot be matched without a DNS lookup */
+	if (!pga_pton(&addr, peer->host, 0))
+		return false;
+	return pga_cmp_addr(&addr, &client->remote_addr) == 0;
+}
+
 /* decide on packets of client in login phase */
 static bool handle_client_startup(PgSocket *client, PktHdr *pkt)
 {
 	const char *passwd;
 	const uint8_t *key;
+	const char *secret;
+	uint32_t peer_id;
 	bool ok;
 	bool is_unix = pga_is_unix(&client->remote_addr);
 
@@ -1259,6 +1372,12 @@ static bool handle_client_startup(PgSocket *client, PktHdr *pkt)
 		}
 	}
 
+	/* a peer link carries nothing but cancel requests */
+	if (client->peer_link && pkt->type != PKT_CANCEL) {
+		disconnect_client(client, false, "bad packet on peer link");
+		return false;
+	}
+
 	switch (pkt->type) {
 	case PKT_SSLREQ:
 		slog_noise(client, "C: req SSL");
@@ -1287,6 +1406,35 @@ static bool handle_client_startup(PgSocket *client, PktHdr *pkt)
 			return false;
 		}
 		break;
+	case PKT_COMPRESSREQ:
+		slog_noise(client, "C: req compression");
+
+		if (client->sbuf.compress) {
+			disconnect_client(client, false, "compression req inside compression");
+			return false;
+		}
+#ifdef HAVE_ZLIB
+		if (cf_client_compression) {
+			slog_noise(client, "P: compression ack");
+			if (!sbuf_answer(&client->sbuf, "Z", 1)) {
+				disconnect_client(client, false, "failed to ack compression");
+				return false;
+			}
+			if (!sbuf_compress_start(&client->sbuf)) {
+				disconnect_client(client, false, "failed to start compression");
+				return false;
+			}
+			break;
+		}
+#endif
+
+		/* reject compression attempt */
+		slog_noise(client, "P: nak");
+		if (!sbuf_answer(&client->sbuf, "N", 1)) {
+			disconnect_client(client, false, "failed to nak compression");
+			return false;
+		}
+		break;
 	case PKT_GSSENCREQ:
 		/* reject GSS encryption attempt */
 		slog_noise(client, "C: req GSS enc");
@@ -1332,7 +1480,12 @@ static bool handle_client_startup(PgSocket *client, PktHdr *pkt)
 			uint32_t length;
 			const uint8_t *data;
 
-			if (!client->scram_state.server_nonce) {
+			if (!socket_login_state(client)) {
+				disconnect_client(client, true, "out of memory");
+				return false;
+			}
+
+			if (!client->login_state->scram_state.server_nonce) {
 				/* process as SASLInitialResponse */
 				if (!mbuf_get_string(&pkt->data, &mech))
 					return false;
@@ -1346,6 +1499,7 @@ static bool handle_client_startup(PgSocket *client, PktHdr *pkt)
 				if (!mbuf_get_bytes(&pkt->data, length, &data))
 					return false;
 				if (!scram_client_first(client, length, data)) {
+					forget_cached_auth_query(client);
 					disconnect_client(client, true, "SASL authentication failed");
 					return false;
 				}
@@ -1356,20 +1510,22 @@ static bool handle_client_startup(PgSocket *client, PktHdr *pkt)
 					return false;
 				if (scram_client_final(client, length, data)) {
 					/* save SCRAM keys for user */
-					if (!client->scram_state.adhoc && !client->db->fake) {
+					ScramState *state = &client->login_state->scram_state;
+
+					if (!state->adhoc && !client->db->fake) {
 						memcpy(client->pool->user_credentials->scram_ClientKey,
-						       client->scram_state.ClientKey,
-						       sizeof(client->scram_state.ClientKey));
+						       state->ClientKey,
+						       sizeof(state->ClientKey));
 						memcpy(client->pool->user_credentials->scram_ServerKey,
-						       client->scram_state.ServerKey,
-						       sizeof(client->scram_state.ServerKey));
+						       state->ServerKey,
+						       sizeof(state->ServerKey));
 						client->pool->user_credentials->scram_passthrough_valid = true;
 					}
 
-					free_scram_state(&client->scram_state);
 					if (!finish_client_login(client))
 						return false;
 				} else {
+					forget_cached_auth_query(client);
 					disconnect_client(client, true, "SASL authentication failed");
 					return false;
 				}
@@ -1410,15 +1566,40 @@ static bool handle_client_startup(PgSocket *client, PktHdr *pkt)
 					if (!finish_client_login(client))
 						return false;
 				} else {
+					forget_cached_auth_query(client);
 					disconnect_client(client, true, "password authentication failed");
 					return false;
 				}
 			}
 		}
 		break;
+	case PKT_PEER_LINK:
+		if (client_accept_sslmode >= SSLMODE_REQUIRE && !client->sbuf.tls && !is_unix) {
+			disconnect_client(client, false, "SSL required");
+			return false;
+		}
+		if (!mbuf_get_uint32be(&pkt->data, &peer_id) || !mbuf_get_string(&pkt->data, &secret)) {
+			disconnect_client(client, false, "bad peer link request");
+			return false;
+		}
+		if (!peer_link_allowed(client, peer_id, secret)) {
+			disconnect_client(client, false, "peer link refused");
+			return false;
+		}
+		slog_debug(client, "peer %u opened a peer link", peer_id);
+		client->peer_link = true;
+		break;
 	case PKT_CANCEL:
 		if (mbuf_avail_for_read(&pkt->data) == BACKENDKEY_LEN
 		    && mbuf_get_bytes(&pkt->data, BACKENDKEY_LEN, &key)) {
+			if (client->peer_link) {
+				/* the link stays open for the next request */
+				if (!accept_peer_link_cancel_request(client, key)) {
+					disconnect_client(client, false, "out of memory");
+					return false;
+				}
+				break;
+			}
 			memcpy(client->cancel_key, key, BACKENDKEY_LEN);
 			accept_cancel_request(client);
 		} else {
@@ -1619,6 +1800,8 @@ static bool handle_client_work(PgSocket *client, PktHdr *pkt)
 		}
 	}
 
+	/* a new transaction may go to a replica */
+	route_client(client, pkt);
 
 	/* update stats */
 	if (!client->query_start) {
@@ -1651,7 +1834,8 @@ static bool handle_client_work(PgSocket *client, PktHdr *pkt)
 		 * into the packet queue through the extra_packets field of SBuf. This
 		 * requires that all previous data in the iobuf is flushed. So lets
 		 * just do that now, so that these functions don't have to worry about
-		 * doing that.
+		 * doing that. The flushed data is batched with the inserted packets
+		 * and sent once the whole input has been processed.
 		 */
 		if (!sbuf_flush(sbuf))
 			return false;
@@ -1814,6 +1998,10 @@ bool client_proto(SBuf *sbuf, SBufEvent evtype, struct MBuf *data)
 			disconnect_client(client, true, "received unencrypted data after GSSAPI encryption request");
 			return false;
 		}
+		if (pkt.type == PKT_COMPRESSREQ && mbuf_avail_for_read(data) > 0) {
+			disconnect_client(client, true, "received uncompressed data after compression request");
+			return false;
+		}
 
 		client->request_time = get_cached_time();
 		if (in_connection_startup_phase(client)) {
@@ -53,12 +53,25 @@ static void close_client_list(struct StatList *sk_list, const char *reason)
 	}
 }
 
+/* clients that were routed away from their own database, see route.c */
+static void close_routed_client_list(struct StatList *sk_list, PgDatabase *db, const char *reason)
+{
+	struct List *item, *tmp;
+	PgSocket *client;
+
+	statlist_for_each_safe(item, sk_list, tmp) {
+		client = container_of(item, PgSocket, head);
+		if (client->db == db)
+			disconnect_client(client, true, "%s", reason);
+	}
+}
+
 bool suspend_socket(PgSocket *sk, bool force_suspend)
 {
 	if (sk->suspended)
 		return true;
 
-	if (sbuf_is_empty(&sk->sbuf)) {
+	if (sbuf_is_empty(&sk->sbuf) && !sk->sbuf.spool) {
 		if (sbuf_pause(&sk->sbuf))
 			sk->suspended = true;
 	}
@@ -120,11 +133,14 @@ static void resume_sockets(void)
 	}
 }
 
+static void resume_timeouts(void);
+
 /* resume pools and listen sockets */
 void resume_all(void)
 {
 	resume_sockets();
 	resume_pooler();
+	resume_timeouts();
 }
 
 /*
@@ -181,9 +197,9 @@ static void per_loop_activate(PgPool *pool)
 	PgSocket *client;
 	int sv_tested, sv_used;
 
-	/* if there is a cancel request waiting, open a new connection */
+	/* if there is a cancel request waiting, send it or open a new connection */
 	if (!statlist_empty(&pool->waiting_cancel_req_list)) {
-		launch_new_connection(pool, /* evict_if_needed= */ true);
+		start_waiting_cancel_requests(pool);
 		return;
 	}
 
@@ -331,221 +347,639 @@ static int per_loop_wait_close(PgPool *pool)
 	return count;
 }
 
+/* per-loop counters for finishing PAUSE, SUSPEND and WAIT_CLOSE */
+struct PerLoopState {
+	int active_count;
+	int waiting_count;
+	bool partial_pause;
+	bool partial_wait;
+	bool force_suspend;
+};
+
+/*
+ * Pools that per_loop_maint() needs to visit while the pooler is not
+ * paused or suspended.  Pools are added when something happens that might
+ * need per-loop work and dropped once pool_needs_per_loop() says there is
+ * nothing left to do.
+ */
+static LIST(ready_pool_list);
+
+static bool pool_needs_per_loop(PgPool *pool)
+{
+	return !statlist_empty(&pool->waiting_client_list)
+	       || !statlist_empty(&pool->waiting_cancel_req_list)
+	       || pool->db->db_paused
+	       || pool->db->db_wait_close;
+}
+
+void pool_mark_ready(PgPool *pool)
+{
+	if (pool->db->admin || pool->db->peer_id)
+		return;
+	if (list_empty(&pool->ready_head))
+		list_append(&ready_pool_list, &pool->ready_head);
+}
+
+/* mark all pools of the database, after PAUSE or WAIT_CLOSE */
+void mark_db_pools_ready(PgDatabase *db)
+{
+	struct List *item;
+	PgPool *pool;
+
+	statlist_for_each(item, &pool_list) {
+		pool = container_of(item, PgPool, head);
+		if (pool->db == db)
+			pool_mark_ready(pool);
+	}
+}
+
+static void per_loop_pool(PgPool *pool, struct PerLoopState *st)
+{
+	switch (cf_pause_mode) {
+	case P_NONE:
+		if (pool->db->db_paused) {
+			st->partial_pause = true;
+			st->active_count += per_loop_pause(pool);
+		} else {
+			per_loop_activate(pool);
+		}
+		break;
+	case P_PAUSE:
+		st->active_count += per_loop_pause(pool);
+		break;
+	case P_SUSPEND:
+		st->active_count += per_loop_suspend(pool, st->force_suspend);
+		break;
+	}
+
+	if (pool->db->db_wait_close) {
+		st->partial_wait = true;
+		st->waiting_count += per_loop_wait_close(pool);
+	}
+}
+
 /*
  * this function is called for each event loop.
  */
 void per_loop_maint(void)
 {
-	struct List *item;
+	struct List *item, *tmp;
 	PgPool *pool;
-	int active_count = 0;
-	int waiting_count = 0;
-	bool partial_pause = false;
-	bool partial_wait = false;
-	bool force_suspend = false;
+	struct PerLoopState st = { 0 };
+
+	auth_query_resume_waiters();
 
 	if (cf_pause_mode == P_SUSPEND && cf_suspend_timeout > 0) {
 		usec_t stime = get_cached_time() - g_suspend_start;
 		if (stime >= cf_suspend_timeout)
-			force_suspend = true;
+			st.force_suspend = true;
 	}
 
-	statlist_for_each(item, &pool_list) {
-		pool = container_of(item, PgPool, head);
-		if (pool->db->admin)
-			continue;
-		switch (cf_pause_mode) {
-		case P_NONE:
-			if (pool->db->db_paused) {
-				partial_pause = true;
-				active_count += per_loop_pause(pool);
-			} else {
-				per_loop_activate(pool);
-			}
-			break;
-		case P_PAUSE:
-			active_count += per_loop_pause(pool);
-			break;
-		case P_SUSPEND:
-			active_count += per_loop_suspend(pool, force_suspend);
-			break;
+	if (cf_pause_mode == P_NONE) {
+		list_for_each_safe(item, &ready_pool_list, tmp) {
+			pool = container_of(item, PgPool, ready_head);
+			per_loop_pool(pool, &st);
+			if (!pool_needs_per_loop(pool))
+				list_del(&pool->ready_head);
 		}
-
-		if (pool->db->db_wait_close) {
-			partial_wait = true;
-			waiting_count += per_loop_wait_close(pool);
+	} else {
+		statlist_for_each(item, &pool_list) {
+			pool = container_of(item, PgPool, head);
+			if (pool->db->admin)
+				continue;
+			per_loop_pool(pool, &st);
 		}
 	}
 
 	switch (cf_pause_mode) {
 	case P_SUSPEND:
-		if (force_suspend) {
+		if (st.force_suspend) {
 			close_client_list(&login_client_list, "suspend_timeout");
 		} else {
-			active_count += statlist_count(&login_client_list);
+			st.active_count += statlist_count(&login_client_list);
 		}
 	/* fallthrough */
 	case P_PAUSE:
-		if (!active_count)
+		if (!st.active_count)
 			admin_pause_done();
 		break;
 	case P_NONE:
-		if (partial_pause && !active_count)
+		if (st.partial_pause && !st.active_count)
 			admin_pause_done();
 		break;
 	}
 
-	if (partial_wait && !waiting_count)
+	if (st.partial_wait && !st.waiting_count)
 		admin_wait_close_done();
 }
 
-/* maintaining clients in pool */
-static void pool_client_maint(PgPool *pool)
+/*
+ * Client and server timeouts are kept in a timer wheel with millisecond
+ * ticks.  A socket's timer is re-armed on every state change for the
+ * nearest timeout of its new state.  Timestamps like request_time only
+ * move forward, so a timer may fire early; the socket is then checked and
+ * the timer re-armed for the new deadline.  Nothing fires while the pooler
+ * is suspended.
+ */
+#define TIMEOUT_TICK_USEC 1000
+
+static struct TimerWheel timeouts;
+static struct event timeout_ev;
+static uint64_t timeout_ev_tick;	/* tick the event fires at, 0 if not pending */
+static bool timeouts_ready;
+
+static usec_t client_idle_timeout_for(PgSocket *client)
 {
-	struct List *item, *tmp;
-	usec_t now = get_cached_time();
-	PgSocket *client;
-	PgGlobalUser *user;
-	usec_t age;
-	usec_t effective_client_idle_timeout;
-	usec_t effective_query_wait_timeout;
+	PgGlobalUser *user = client->login_user_credentials->global_user;
 
-	/* force client_idle_timeout */
-	if (cf_client_idle_timeout > 0 || any_user_level_client_timeout_set) {
-		statlist_for_each_safe(item, &pool->active_client_list, tmp) {
-			client = container_of(item, PgSocket, head);
-			Assert(client->state == CL_ACTIVE);
-			if (client->link)
-				continue;
+	if (user->client_idle_timeout > 0)
+		return user->client_idle_timeout;
+	return cf_client_idle_timeout;
+}
 
-			user = client->login_user_credentials->global_user;
-			effective_client_idle_timeout = cf_client_idle_timeout;
+static usec_t query_wait_timeout_for(PgSocket *client)
+{
+	usec_t timeout = cf_query_wait_timeout;
+	PgGlobalUser *user;
 
-			if (user->client_idle_timeout > 0)
-				effective_client_idle_timeout = user->client_idle_timeout;
+	if (client->db->query_wait_timeout_set)
+		timeout = client->db->query_wait_timeout;
 
-			if (now - client->request_time > effective_client_idle_timeout)
-				disconnect_client(client, true, "client_idle_timeout");
-		}
+	if (client->login_user_credentials) {
+		user = client->login_user_credentials->global_user;
+		if (user->query_wait_timeout_set)
+			timeout = user->query_wait_timeout;
 	}
+	return timeout;
+}
 
+static usec_t earlier_deadline(usec_t deadline, usec_t candidate)
+{
+	if (deadline == 0 || candidate < deadline)
+		return candidate;
+	return deadline;
+}
 
-	/* force timeouts for waiting queries */
-	if (cf_query_timeout > 0 || cf_query_wait_timeout > 0 || any_user_level_client_timeout_set || any_database_level_client_timeout_set) {
-		PgDatabase *db;
-		statlist_for_each_safe(item, &pool->waiting_client_list, tmp) {
-			client = container_of(item, PgSocket, head);
-			Assert(client->state == CL_WAITING || client->state == CL_WAITING_LOGIN);
-			if (client->query_start == 0) {
-				age = now - client->request_time;
-				/* log_warning("query_start==0"); */
-			} else {
-				age = now - client->query_start;
-			}
+/* when the client could hit one of the timeouts of its state, 0 if never */
+static usec_t client_timeout_deadline(PgSocket *client)
+{
+	usec_t deadline = 0;
+	usec_t timeout, start;
 
-			db = client->db;
+	/* the admin console is not subject to timeouts */
+	if (!client->pool || client->pool->db->admin)
+		return 0;
 
-			effective_query_wait_timeout = cf_query_wait_timeout;
-			if (db->query_wait_timeout_set)
-				effective_query_wait_timeout = db->query_wait_timeout;
+	switch (client->state) {
+	case CL_ACTIVE:
+		timeout = client_idle_timeout_for(client);
+		if (timeout == 0)
+			break;
+		/* not idle while linked, look again after a full timeout */
+		if (client->link)
+			deadline = get_cached_time() + timeout;
+		else
+			deadline = client->request_time + timeout;
+		break;
+	case CL_WAITING:
+	case CL_WAITING_LOGIN:
+		start = client->query_start ? client->query_start : client->request_time;
+		if (cf_query_timeout > 0)
+			deadline = earlier_deadline(deadline, start + cf_query_timeout);
+		timeout = query_wait_timeout_for(client);
+		if (timeout > 0)
+			deadline = earlier_deadline(deadline, start + timeout);
+		if (cf_client_login_timeout > 0 && client->wait_for_welcome && !client->pool->welcome_msg_ready)
+			deadline = earlier_deadline(deadline, client->connect_time + cf_client_login_timeout);
+		break;
+	case CL_WAITING_CANCEL:
+		if (cf_cancel_wait_timeout > 0)
+			deadline = client->request_time + cf_cancel_wait_timeout;
+		break;
+	default:
+		break;
+	}
+	return deadline;
+}
 
-			if (client->login_user_credentials) {
-				user = client->login_user_credentials->global_user;
-				if (user->query_wait_timeout_set) {
-					effective_query_wait_timeout = user->query_wait_timeout;
-				}
-			}
+/* disconnect the client if a timeout is over, returns true if it was */
+static bool check_client_timeouts(PgSocket *client)
+{
+	usec_t now = get_cached_time();
+	usec_t age, timeout;
 
-			if (cf_shutdown == SHUTDOWN_WAIT_FOR_SERVERS) {
-				disconnect_client(client, true, "server shutting down");
-			} else if (cf_query_timeout > 0 && age > cf_query_timeout) {
-				disconnect_client(client, true, "query_timeout");
-			} else if (effective_query_wait_timeout > 0 && age > effective_query_wait_timeout) {
-				disconnect_client(client, true, "query_wait_timeout");
-			}
+	switch (client->state) {
+	case CL_ACTIVE:
+		if (client->link)
+			break;
+		timeout = client_idle_timeout_for(client);
+		if (timeout > 0 && now - client->request_time > timeout) {
+			disconnect_client(client, true, "client_idle_timeout");
+			return true;
 		}
-	}
-
-	/* apply cancel_wait_timeout for cancel connections */
-	if (cf_cancel_wait_timeout > 0) {
-		statlist_for_each_safe(item, &pool->waiting_cancel_req_list, tmp) {
-			client = container_of(item, PgSocket, head);
-			Assert(client->state == CL_WAITING_CANCEL);
+		break;
+	case CL_WAITING:
+	case CL_WAITING_LOGIN:
+		if (client->query_start == 0)
 			age = now - client->request_time;
-
-			if (age > cf_cancel_wait_timeout)
-				disconnect_client(client, false, "cancel_wait_timeout");
+		else
+			age = now - client->query_start;
+		timeout = query_wait_timeout_for(client);
+
+		if (cf_query_timeout > 0 && age > cf_query_timeout) {
+			disconnect_client(client, true, "query_timeout");
+			return true;
+		} else if (timeout > 0 && age > timeout) {
+			disconnect_client(client, true, "query_wait_timeout");
+			return true;
 		}
-	}
 
-	/* apply client_login_timeout to clients waiting for welcome pkt */
-	if (cf_client_login_timeout > 0 && !pool->welcome_msg_ready) {
-		statlist_for_each_safe(item, &pool->waiting_client_list, tmp) {
-			client = container_of(item, PgSocket, head);
-			if (!client->wait_for_welcome)
-				continue;
+		/* apply client_login_timeout to clients waiting for welcome pkt */
+		if (cf_client_login_timeout > 0 && client->wait_for_welcome && !client->pool->welcome_msg_ready) {
 			age = now - client->connect_time;
-			if (age > cf_client_login_timeout)
+			if (age > cf_client_login_timeout) {
 				disconnect_client(client, true, "client_login_timeout (server down)");
+				return true;
+			}
 		}
+		break;
+	case CL_WAITING_CANCEL:
+		age = now - client->request_time;
+		if (cf_cancel_wait_timeout > 0 && age > cf_cancel_wait_timeout) {
+			disconnect_client(client, false, "cancel_wait_timeout");
+			return true;
+		}
+		break;
+	default:
+		break;
 	}
+	return false;
 }
 
-/* maintaining clients in peer pool */
-static void peer_pool_client_maint(PgPool *pool)
+/*
+ * Number of servers that server_idle_timeout leaves open: min_pool_size or
+ * whatever the load profile predicts for the near future, if that is more.
+ */
+static int pool_idle_floor(PgPool *pool)
+{
+	int min_size = pool_min_pool_size(pool);
+	int predicted = prewarm_pool_target(pool);
+
+	return predicted > min_size ? predicted : min_size;
+}
+
+/* server_idle_timeout would close the server, but min_pool_size keeps it */
+static bool idle_floor_reached(PgPool *pool)
+{
+	int idle_floor = pool_idle_floor(pool);
+
+	return idle_floor > 0 && pool_connected_server_count(pool) <= idle_floor;
+}
+
+/* when life_over() will let the server go */
+static usec_t server_lifetime_deadline(PgSocket *server)
+{
+	PgPool *pool = server->pool;
+	usec_t server_lifetime = pool_server_lifetime(pool);
+	usec_t lifetime_kill_gap = 0;
+
+	if (server->connect_time + server_lifetime > get_cached_time())
+		return server->connect_time + server_lifetime;
+
+	/* over, but disconnects are spaced out */
+	if (pool_pool_size(pool) > 0)
+		lifetime_kill_gap = server_lifetime / pool_pool_size(pool);
+	return pool->last_lifetime_disconnect + lifetime_kill_gap;
+}
+
+/* the query_timeout, idle_transaction_timeout and transaction_timeout of the server */
+static void server_active_timeouts(PgSocket *server, usec_t *query_timeout,
+				   usec_t *idle_transaction_timeout, usec_t *transaction_timeout)
+{
+	PgGlobalUser *user = server->login_user_credentials->global_user;
+
+	*query_timeout = user->query_timeout > 0 ? user->query_timeout : cf_query_timeout;
+	*idle_transaction_timeout = user->idle_transaction_timeout > 0 ?
+				    user->idle_transaction_timeout : cf_idle_transaction_timeout;
+	*transaction_timeout = user->transaction_timeout > 0 ?
+			       user->transaction_timeout : cf_transaction_timeout;
+}
+
+static bool close_needed_now(PgSocket *server)
+{
+	if (!server->close_needed)
+		return false;
+	if (server->state != SV_ACTIVE)
+		return true;
+	/*
+	 * Active servers are only closed early with server_fast_close, once
+	 * they are done with the query, and replication servers always, as
+	 * their session may never end.
+	 */
+	return server->replication || (cf_server_fast_close && server->ready);
+}
+
+/* when the server could hit one of the timeouts of its state, 0 if never */
+static usec_t server_timeout_deadline(PgSocket *server)
 {
-	struct List *item, *tmp;
 	usec_t now = get_cached_time();
+	usec_t deadline = 0;
+	usec_t query_timeout, idle_transaction_timeout, transaction_timeout;
+	usec_t idle_deadline, lifetime_deadline;
 	PgSocket *client;
-	usec_t age;
 
-	if (cf_cancel_wait_timeout > 0) {
-		statlist_for_each_safe(item, &pool->waiting_cancel_req_list, tmp) {
-			client = container_of(item, PgSocket, head);
-			Assert(client->state == CL_WAITING_CANCEL);
-			age = now - client->request_time;
+	if (!server->pool || server->pool->db->admin)
+		return 0;
 
-			if (age > cf_cancel_wait_timeout)
-				disconnect_client(client, false, "cancel_wait_timeout");
+	switch (server->state) {
+	case SV_LOGIN:
+		if (cf_server_connect_timeout > 0)
+			deadline = server->connect_time + cf_server_connect_timeout;
+		/* peer pools only send cancel requests */
+		if (server->pool->db->peer_id && cf_cancel_wait_timeout > 0)
+			deadline = earlier_deadline(deadline, server->connect_time + cf_cancel_wait_timeout);
+		break;
+	case SV_IDLE:
+	case SV_USED:
+	case SV_TESTED:
+		if (close_needed_now(server) || (server->state != SV_TESTED && !server->ready))
+			return now;
+		if (cf_server_idle_timeout > 0) {
+			idle_deadline = server->request_time + cf_server_idle_timeout;
+			if (idle_deadline <= now) {
+				if (!idle_floor_reached(server->pool))
+					return now;
+				/* kept for min_pool_size, look again after a full timeout */
+				idle_deadline = now + cf_server_idle_timeout;
+			}
+			deadline = idle_deadline;
 		}
+		lifetime_deadline = server_lifetime_deadline(server);
+		deadline = earlier_deadline(deadline, lifetime_deadline);
+		/* the lifetime check shadows the server_check_delay one */
+		if (server->connect_time + pool_server_lifetime(server->pool) <= now)
+			break;
+		if (server->state == SV_IDLE && *cf_server_check_query)
+			deadline = earlier_deadline(deadline, server->request_time + cf_server_check_delay);
+		break;
+	case SV_ACTIVE:
+		if (close_needed_now(server))
+			return now;
+		server_active_timeouts(server, &query_timeout, &idle_transaction_timeout, &transaction_timeout);
+		client = server->link;
+		if (server->ready || !client) {
+			/* not busy, look again after a full timeout */
+			if (query_timeout > 0)
+				deadline = earlier_deadline(deadline, now + query_timeout);
+			if (idle_transaction_timeout > 0)
+				deadline = earlier_deadline(deadline, now + idle_transaction_timeout);
+			if (transaction_timeout > 0)
+				deadline = earlier_deadline(deadline, now + transaction_timeout);
+			break;
+		}
+		if (query_timeout > 0)
+			deadline = earlier_deadline(deadline, (client->query_start ? client->query_start : now) + query_timeout);
+		if (idle_transaction_timeout > 0)
+			deadline = earlier_deadline(deadline, (server->idle_tx ? server->request_time : now) + idle_transaction_timeout);
+		if (transaction_timeout > 0)
+			deadline = earlier_deadline(deadline, client->xact_start + transaction_timeout);
+		break;
+	default:
+		break;
 	}
+	return deadline;
 }
 
-static void check_unused_servers(PgPool *pool, struct StatList *slist, bool idle_test)
+/* maintain unused servers, returns true if the server was disconnected */
+static bool check_unused_server(PgSocket *server)
 {
+	PgPool *pool = server->pool;
 	usec_t now = get_cached_time();
-	usec_t server_lifetime = pool_server_lifetime(pool);
+	usec_t idle = now - server->request_time;
+	usec_t age = now - server->connect_time;
+
+	if (server->close_needed) {
+		disconnect_server(server, true, "database configuration changed");
+	} else if (server->state == SV_IDLE && !server->ready) {
+		disconnect_server(server, true, "SV_IDLE server got dirty");
+	} else if (server->state == SV_USED && !server->ready) {
+		disconnect_server(server, true, "SV_USED server got dirty");
+	} else if (cf_server_idle_timeout > 0 && idle > cf_server_idle_timeout
+		   && !idle_floor_reached(pool)) {
+		disconnect_server(server, true, "server idle timeout");
+	} else if (age >= pool_server_lifetime(pool)) {
+		if (!life_over(server))
+			return false;
+		disconnect_server(server, true, "server lifetime over");
+		pool->last_lifetime_disconnect = now;
+	} else {
+		if (server->state == SV_IDLE && *cf_server_check_query && idle > cf_server_check_delay)
+			change_server_state(server, SV_USED);
+		return false;
+	}
+	return true;
+}
 
-	struct List *item, *tmp;
-	usec_t idle, age;
+/* disconnect the server if a timeout is over, returns true if it was */
+static bool check_server_timeouts(PgSocket *server)
+{
+	usec_t now = get_cached_time();
+	usec_t query_timeout, idle_transaction_timeout, transaction_timeout;
+	usec_t age_query, age_server, age_transaction;
+	usec_t age = now - server->connect_time;
+
+	switch (server->state) {
+	case SV_LOGIN:
+		if (cf_server_connect_timeout > 0 && age > cf_server_connect_timeout) {
+			disconnect_server(server, true, "connect timeout");
+			return true;
+		} else if (server->pool->db->peer_id && cf_cancel_wait_timeout > 0 && age > cf_cancel_wait_timeout) {
+			disconnect_server(server, true, "cancel_wait_timeout");
+			return true;
+		}
+		break;
+	case SV_IDLE:
+	case SV_USED:
+	case SV_TESTED:
+		return check_unused_server(server);
+	case SV_ACTIVE:
+		if (close_needed_now(server)) {
+			disconnect_server(server, true, "database configuration changed");
+			return true;
+		}
+		if (server->ready || !server->link)
+			break;
+
+		server_active_timeouts(server, &query_timeout, &idle_transaction_timeout, &transaction_timeout);
+
+		/*
+		 * Note the different age calculations: query_timeout counts
+		 * from when the query started (only applies when a query is
+		 * actually running), idle_transaction_timeout counts from the
+		 * last request of the server (the server sent the idle
+		 * information).
+		 */
+		age_query = server->link->query_start ? now - server->link->query_start : 0;
+		age_server = now - server->request_time;
+		age_transaction = now - server->link->xact_start;
+
+		if (query_timeout > 0 && age_query > 0 && age_query > query_timeout) {
+			disconnect_server(server, true, "query timeout");
+			return true;
+		} else if (idle_transaction_timeout > 0 && server->idle_tx &&
+			   age_server > idle_transaction_timeout) {
+			disconnect_server(server, true, "idle transaction timeout");
+			return true;
+		} else if (transaction_timeout > 0 && age_transaction > transaction_timeout) {
+			disconnect_server(server, true, "transaction timeout");
+			return true;
+		}
+		break;
+	default:
+		break;
+	}
+	return false;
+}
+
+static void schedule_timeouts(uint64_t tick)
+{
+	usec_t now = get_cached_time();
+	usec_t at = tick * TIMEOUT_TICK_USEC;
+	struct timeval tv;
+
+	if (tick == UINT64_MAX)
+		return;
+	if (timeout_ev_tick != 0 && timeout_ev_tick <= tick)
+		return;
+
+	at = at > now ? at - now : 0;
+	tv.tv_sec = at / USEC;
+	tv.tv_usec = at % USEC;
+	timeout_ev_tick = tick;
+	safe_evtimer_add(&timeout_ev, &tv);
+}
+
+static void run_timeouts(evutil_socket_t sock, short flags, void *arg)
+{
+	timeout_ev_tick = 0;
+
+	/* avoid doing anything that may surprise the other pgbouncer, see resume_all() */
+	if (cf_pause_mode == P_SUSPEND)
+		return;
+
+	timerwheel_run(&timeouts, get_cached_time() / TIMEOUT_TICK_USEC);
+	schedule_timeouts(timerwheel_next_tick(&timeouts));
+}
+
+/* catch up with the timeouts that were held back during SUSPEND */
+static void resume_timeouts(void)
+{
+	if (timeouts_ready)
+		schedule_timeouts(timerwheel_next_tick(&timeouts));
+}
+
+static void fire_timeout(struct TimerEntry *entry)
+{
+	PgSocket *sk = container_of(entry, PgSocket, timeout);
+
+	if (is_server_socket(sk)) {
+		if (!check_server_timeouts(sk))
+			server_timeout_update(sk);
+	} else {
+		if (!check_client_timeouts(sk))
+			client_timeout_update(sk);
+	}
+}
+
+static void timeout_update(PgSocket *sk, usec_t deadline)
+{
+	if (deadline == 0) {
+		timerwheel_del(&timeouts, &sk->timeout);
+		return;
+	}
+
+	/* timeouts fire once the age is strictly over the limit */
+	timerwheel_add(&timeouts, &sk->timeout, deadline / TIMEOUT_TICK_USEC + 1);
+	schedule_timeouts(sk->timeout.expires);
+}
+
+/* arm or disarm the timeout of the client for its current state */
+void client_timeout_update(PgSocket *client)
+{
+	if (timeouts_ready)
+		timeout_update(client, client_timeout_deadline(client));
+}
+
+/* arm or disarm the timeout of the server for its current state */
+void server_timeout_update(PgSocket *server)
+{
+	if (timeouts_ready)
+		timeout_update(server, server_timeout_deadline(server));
+}
+
+static void update_client_list_timeouts(struct StatList *list)
+{
+	struct List *item;
+	PgSocket *client;
+
+	statlist_for_each(item, list) {
+		client = container_of(item, PgSocket, head);
+		client_timeout_update(client);
+	}
+}
+
+static void update_server_list_timeouts(struct StatList *list)
+{
+	struct List *item;
 	PgSocket *server;
 
-	/* disconnect idle servers if needed */
-	statlist_for_each_safe(item, slist, tmp) {
+	statlist_for_each(item, list) {
 		server = container_of(item, PgSocket, head);
+		server_timeout_update(server);
+	}
+}
 
-		age = now - server->connect_time;
-		idle = now - server->request_time;
+/* timeout settings changed, re-arm timeouts of all clients and servers */
+void rearm_timeouts(void)
+{
+	struct List *item;
+	PgPool *pool;
 
-		if (server->close_needed) {
-			disconnect_server(server, true, "database configuration changed");
-		} else if (server->state == SV_IDLE && !server->ready) {
-			disconnect_server(server, true, "SV_IDLE server got dirty");
-		} else if (server->state == SV_USED && !server->ready) {
-			disconnect_server(server, true, "SV_USED server got dirty");
-		} else if (cf_server_idle_timeout > 0 && idle > cf_server_idle_timeout
-			   && (pool_min_pool_size(pool) == 0 || pool_connected_server_count(pool) > pool_min_pool_size(pool))) {
-			disconnect_server(server, true, "server idle timeout");
-		} else if (age >= server_lifetime) {
-			if (life_over(server)) {
-				disconnect_server(server, true, "server lifetime over");
-				pool->last_lifetime_disconnect = now;
-			}
-		} else if (cf_pause_mode == P_PAUSE) {
-			disconnect_server(server, true, "pause mode");
-		} else if (idle_test && *cf_server_check_query) {
-			if (idle > cf_server_check_delay)
-				change_server_state(server, SV_USED);
+	if (!timeouts_ready)
+		return;
+
+	statlist_for_each(item, &pool_list) {
+		pool = container_of(item, PgPool, head);
+		update_client_list_timeouts(&pool->active_client_list);
+		update_client_list_timeouts(&pool->waiting_client_list);
+		update_client_list_timeouts(&pool->waiting_cancel_req_list);
+		update_server_list_timeouts(&pool->new_server_list);
+		update_server_list_timeouts(&pool->cancel_standby_server_list);
+		update_server_list_timeouts(&pool->idle_server_list);
+		update_server_list_timeouts(&pool->used_server_list);
+		update_server_list_timeouts(&pool->tested_server_list);
+		update_server_list_timeouts(&pool->active_server_list);
+	}
+	statlist_for_each(item, &peer_pool_list) {
+		pool = container_of(item, PgPool, head);
+		update_client_list_timeouts(&pool->waiting_cancel_req_list);
+		update_server_list_timeouts(&pool->new_server_list);
+	}
+}
+
+/* maintaining clients in pool, timeouts are handled by the timer wheel */
+static void pool_client_maint(PgPool *pool)
+{
+	struct List *item, *tmp;
+	PgSocket *client;
+
+	if (cf_shutdown != SHUTDOWN_WAIT_FOR_SERVERS)
+		return;
+
+	if (cf_query_timeout > 0 || cf_query_wait_timeout > 0 || any_user_level_client_timeout_set || any_database_level_client_timeout_set) {
+		statlist_for_each_safe(item, &pool->waiting_client_list, tmp) {
+			client = container_of(item, PgSocket, head);
+			disconnect_client(client, true, "server shutting down");
 		}
 	}
 }
@@ -583,147 +1017,65 @@ static void check_pool_size(PgPool *pool)
 	    (pool_client_count(pool) > 0 || pool->db->forced_user_credentials != NULL)) {
 		log_debug("launching new connection to satisfy min_pool_size");
 		launch_new_connection(pool, /* evict_if_needed= */ false);
+		return;
+	}
+
+	/*
+	 * Open connections ahead of the load the profile predicts.  Without
+	 * clients this is only done once a server login has succeeded for the
+	 * pool (or the user is forced), as the credentials might otherwise not
+	 * be usable for logging in to the server.
+	 */
+	if (cur < pool_pool_size(pool) &&
+	    cf_pause_mode == P_NONE &&
+	    cf_reboot == 0 &&
+	    (pool_client_count(pool) > 0 || pool->db->forced_user_credentials != NULL || pool->welcome_msg_ready) &&
+	    cur < prewarm_pool_target(pool)) {
+		log_debug("launching new connection to prewarm pool for expected load");
+		launch_new_connection(pool, /* evict_if_needed= */ false);
 	}
 }
 
-/* maintain servers in a pool */
-static void pool_server_maint(PgPool *pool)
+/*
+ * Keep cancel_pool_size connections ready for cancel requests while they
+ * come in.  Each of them costs a backend process, so they are only opened
+ * once a request arrived, and no longer replaced when there was none for
+ * cancel_standby_lifetime.  PostgreSQL closes connections that send no
+ * startup packet within authentication_timeout, they are replaced before.
+ */
+static void cancel_standby_maint(PgPool *pool)
 {
 	struct List *item, *tmp;
 	usec_t now = get_cached_time();
+	bool wanted = cf_cancel_pool_size > 0 && cf_cancel_standby_lifetime > 0
+		      && pool->last_cancel_time > 0
+		      && now - pool->last_cancel_time < cf_cancel_standby_lifetime
+		      && pool_client_count(pool) > 0
+		      && !cf_shutdown && cf_pause_mode == P_NONE && cf_reboot == 0;
 	PgSocket *server;
 
-	/* find and disconnect idle servers */
-	check_unused_servers(pool, &pool->used_server_list, 0);
-	check_unused_servers(pool, &pool->tested_server_list, 0);
-	check_unused_servers(pool, &pool->idle_server_list, 1);
-
-	statlist_for_each_safe(item, &pool->active_server_list, tmp) {
+	statlist_for_each_safe(item, &pool->cancel_standby_server_list, tmp) {
 		server = container_of(item, PgSocket, head);
-		Assert(server->state == SV_ACTIVE);
-		/*
-		 * Disconnect active servers without outstanding requests if
-		 * server_fast_close is set. This only applies to session
-		 * pooling.
-		 */
-		if (cf_server_fast_close && server->ready && server->close_needed)
-			disconnect_server(server, true, "database configuration changed");
-		/*
-		 * Always disconnect close_needed replication servers. These
-		 * connections are expected to be very long lived (possibly
-		 * indefinitely), so waiting until the session/transaction is
-		 * over is not an option.
-		 */
-		if (server->replication && server->close_needed)
-			disconnect_server(server, true, "database configuration changed");
-	}
-
-	/* handle query_timeout and idle_transaction_timeout */
-	if (cf_query_timeout > 0 || cf_idle_transaction_timeout > 0 || cf_transaction_timeout > 0 || any_user_level_timeout_set) {
-		statlist_for_each_safe(item, &pool->active_server_list, tmp) {
-			usec_t age_query, age_server, age_transaction;
-			usec_t effective_query_timeout;
-			usec_t effective_idle_transaction_timeout;
-			usec_t user_query_timeout;
-			usec_t user_idle_transaction_timeout;
-			usec_t user_transaction_timeout;
-			usec_t effective_transaction_timeout;
-
-			server = container_of(item, PgSocket, head);
-			Assert(server->state == SV_ACTIVE);
-			if (server->ready)
-				continue;
-
-			/*
-			 * Note the different age calculations:
-			 * query_timeout counts from when the query started
-			 * (only applies when a query is actually running),
-			 * idle_transaction_timeout counts from the last
-			 * request of the server (the server sent the idle
-			 * information).
-			 */
-			age_query = (server->link->query_start != 0) ? now - server->link->query_start : 0;
-			age_server = now - server->request_time;
-			age_transaction = now - server->link->xact_start;
-
-			user_idle_transaction_timeout = server->login_user_credentials->global_user->idle_transaction_timeout;
-			user_transaction_timeout = server->login_user_credentials->global_user->transaction_timeout;
-			user_query_timeout = server->login_user_credentials->global_user->query_timeout;
-
-			effective_idle_transaction_timeout = cf_idle_transaction_timeout;
-			effective_query_timeout = cf_query_timeout;
-			effective_transaction_timeout = cf_transaction_timeout;
-
-			if (user_idle_transaction_timeout > 0)
-				effective_idle_transaction_timeout = user_idle_transaction_timeout;
-
-			if (user_query_timeout > 0)
-				effective_query_timeout = user_query_timeout;
-
-			if (user_transaction_timeout > 0)
-				effective_transaction_timeout = user_transaction_timeout;
-
-			if (effective_query_timeout > 0 && age_query > 0 && age_query > effective_query_timeout) {
-				disconnect_server(server, true, "query timeout");
-			} else if (effective_idle_transaction_timeout > 0 &&
-				   server->idle_tx &&
-				   age_server > effective_idle_transaction_timeout) {
-				disconnect_server(server, true, "idle transaction timeout");
-			} else if (effective_transaction_timeout > 0 &&
-				   age_transaction > effective_transaction_timeout) {
-				disconnect_server(server, true, "transaction timeout");
-			}
-		}
+		if (!wanted)
+			disconnect_server(server, false, "cancel standby connection not needed");
+		else if (now - server->connect_time > cf_cancel_standby_lifetime)
+			disconnect_server(server, false, "cancel standby connection expired");
 	}
 
-	/* find connections that got connect, but could not log in */
-	if (cf_server_connect_timeout > 0) {
-		statlist_for_each_safe(item, &pool->new_server_list, tmp) {
-			usec_t age;
-
-			server = container_of(item, PgSocket, head);
-			Assert(server->state == SV_LOGIN);
-
-			age = now - server->connect_time;
-			if (age > cf_server_connect_timeout)
-				disconnect_server(server, true, "connect timeout");
-		}
-	}
-
-	check_pool_size(pool);
+	if (wanted)
+		launch_cancel_standby(pool);
 }
 
-/* maintain servers in a peer pool */
-static void peer_pool_server_maint(PgPool *pool)
+/*
+ * maintain servers in a pool, the time based checks are done by the
+ * timer wheel
+ */
+static void pool_server_maint(PgPool *pool)
 {
-	struct List *item, *tmp;
-	usec_t now = get_cached_time();
-	PgSocket *server;
-
-	/*
-	 * find connections that got connected, but could not log in. For normal
-	 * pools we only compare against server_connect_timeout for these servers,
-	 * but since peer pools are only for sending cancellations we also compare
-	 * against cancel_wait_timeout here.
-	 */
-	if (cf_server_connect_timeout > 0 || cf_cancel_wait_timeout > 0) {
-		statlist_for_each_safe(item, &pool->new_server_list, tmp) {
-			usec_t age;
-
-			server = container_of(item, PgSocket, head);
-			Assert(server->state == SV_LOGIN);
-
-			age = now - server->connect_time;
-			if (cf_server_connect_timeout > 0 && age > cf_server_connect_timeout) {
-				disconnect_server(server, true, "connect timeout");
-			} else if (cf_cancel_wait_timeout > 0 && age > cf_cancel_wait_timeout) {
-				disconnect_server(server, true, "cancel_wait_timeout");
-			}
-		}
-	}
+	check_pool_size(pool);
+	cancel_standby_maint(pool);
 }
 
-
 static void cleanup_client_logins(void)
 {
 	struct List *item, *tmp;
@@ -731,11 +1083,19 @@ static void cleanup_client_logins(void)
 	usec_t age;
 	usec_t now = get_cached_time();
 
-	if (cf_client_login_timeout <= 0)
+	if (cf_client_login_timeout <= 0 && !cf_shutdown)
 		return;
 
 	statlist_for_each_safe(item, &login_client_list, tmp) {
 		client = container_of(item, PgSocket, head);
+		/* peer links stay open until shutdown */
+		if (client->peer_link) {
+			if (cf_shutdown)
+				disconnect_client(client, false, "pooler is shutting down");
+			continue;
+		}
+		if (cf_client_login_timeout <= 0)
+			continue;
 		age = now - client->connect_time;
 		if (age > cf_client_login_timeout)
 			disconnect_client(client, true, "client_login_timeout");
@@ -850,6 +1210,12 @@ static void do_full_maint(evutil_socket_t sock, short flags, void *arg)
 		pool = container_of(item, PgPool, head);
 		if (pool->db->admin)
 			continue;
+
+		/* nothing to maintain in a pool without any connections */
+		if (pool_server_count(pool) == 0 && pool_client_count(pool) == 0
+		    && pool_min_pool_size(pool) == 0 && prewarm_pool_target(pool) == 0)
+			continue;
+
 		pool_server_maint(pool);
 		pool_client_maint(pool);
 
@@ -860,12 +1226,6 @@ static void do_full_maint(evutil_socket_t sock, short flags, void *arg)
 		}
 	}
 
-	statlist_for_each_safe(item, &peer_pool_list, tmp) {
-		pool = container_of(item, PgPool, head);
-		peer_pool_server_maint(pool);
-		peer_pool_client_maint(pool);
-	}
-
 	/* find inactive autodbs */
 	statlist_for_each_safe(item, &database_list, tmp) {
 		db = container_of(item, PgDatabase, head);
@@ -884,6 +1244,13 @@ static void do_full_maint(evutil_socket_t sock, short flags, void *arg)
 
 	cleanup_client_logins();
 
+	auth_cache_expire();
+
+	sbuf_tls_rotate_ticket_keys();
+
+	/* give memory of connection storms back */
+	slab_trim_all(cf_slab_free_target < 0 ? 0 : cf_slab_free_target);
+
 	if (cf_shutdown == SHUTDOWN_WAIT_FOR_SERVERS && get_active_server_count() == 0) {
 		log_info("server connections dropped, exiting");
 		cf_shutdown = SHUTDOWN_IMMEDIATE;
@@ -910,12 +1277,23 @@ void janitor_setup(void)
 	event_assign(&full_maint_ev, pgb_event_base, -1, EV_PERSIST, do_full_maint, NULL);
 	if (event_add(&full_maint_ev, &full_maint_period) < 0)
 		log_warning("event_add failed: %s", strerror(errno));
+
+	/* timer wheel for client and server timeouts */
+	timerwheel_init(&timeouts, get_cached_time() / TIMEOUT_TICK_USEC, fire_timeout);
+	evtimer_assign(&timeout_ev, pgb_event_base, run_timeouts, NULL);
+	timeouts_ready = true;
+
+	/* sockets taken over from the old process */
+	rearm_timeouts();
 }
 
 void kill_pool(PgPool *pool)
 {
 	const char *reason = "database removed";
 
+	/* a new pool at the same address must not see old responses */
+	invalidate_describe_cache();
+
 	close_client_list(&pool->active_client_list, reason);
 	close_client_list(&pool->waiting_client_list, reason);
 
@@ -924,6 +1302,7 @@ void kill_pool(PgPool *pool)
 
 	close_server_list(&pool->active_server_list, reason);
 	close_server_list(&pool->active_cancel_server_list, reason);
+	close_server_list(&pool->cancel_standby_server_list, reason);
 	close_server_list(&pool->being_canceled_server_list, reason);
 	close_server_list(&pool->idle_server_list, reason);
 	close_server_list(&pool->used_server_list, reason);
@@ -932,6 +1311,9 @@ void kill_pool(PgPool *pool)
 
 	pktbuf_free(pool->welcome_msg);
 
+	prewarm_detach_pool(pool);
+
+	list_del(&pool->ready_head);
 	list_del(&pool->map_head);
 	statlist_remove(&pool_list, &pool->head);
 	varcache_clean(&pool->orig_vars);
@@ -967,8 +1349,12 @@ void kill_database(PgDatabase *db)
 
 	statlist_for_each_safe(item, &pool_list, tmp) {
 		pool = container_of(item, PgPool, head);
-		if (pool->db == db)
+		if (pool->db == db) {
 			kill_pool(pool);
+		} else {
+			close_routed_client_list(&pool->active_client_list, db, "database removed");
+			close_routed_client_list(&pool->waiting_client_list, db, "database removed");
+		}
 	}
 
 	pktbuf_free(db->startup_params);
@@ -989,6 +1375,10 @@ void kill_database(PgDatabase *db)
 	if (db->auth_query)
 		free((void *)db->auth_query);
 
+	free(db->replicas);
+	free(db->replica_list);
+	forget_replica(db);
+
 	/* Cleanup cached scram keys stored with PgCredentials */
 	clear_user_tree_cached_scram_keys(&db->user_tree);
 	aatree_destroy(&db->user_tree);
@@ -1036,6 +1426,10 @@ void config_postprocess(void)
 			continue;
 		}
 	}
+
+	resolve_all_replicas();
+
+	rearm_timeouts();
 }
 
 static void clean_cached_scram(struct AANode *n, void *arg)
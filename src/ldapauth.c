@@ -73,6 +73,9 @@ struct ldap_auth_request {
 	/* password we should check for validity together with the socket's username */
 	char password[MAX_PASSWORD];
 
+	/* options from the hba rule or auth_ldap_options, parsed by the worker */
+	char auth_options[MAX_LDAP_CONFIG];
+
 	char ldap_options[MAX_LDAP_CONFIG];
 	int option_pos;
 	/* LDAP specific options */
@@ -473,6 +476,7 @@ void ldap_auth_begin(PgSocket *client, const char *passwd)
 	memcpy(&request->remote_addr, &client->remote_addr, sizeof(client->remote_addr));
 	safe_strcpy(request->username, client->login_user_credentials->name, MAX_USERNAME);
 	safe_strcpy(request->password, passwd, MAX_PASSWORD);
+	safe_strcpy(request->auth_options, client->login_state->ldap_options, MAX_LDAP_CONFIG);
 	/* Reset value of LDAP options */
 	free_ldap_options(request);
 
@@ -766,7 +770,7 @@ static bool check_ldap_auth(struct ldap_auth_request *request)
 	int r;
 	char *fulluser;
 
-	if (!initialize_ldap_options(request, request->client->ldap_options)) {
+	if (!initialize_ldap_options(request, request->auth_options)) {
 		return false;
 	}
 	if ((!request->ldapserver || request->ldapserver[0] == '\0') &&
@@ -252,6 +252,7 @@ bool parse_database(void *base, const char *name, const char *connstr)
 	PgDatabase *db;
 	struct CfValue cv;
 	struct CfValue load_balance_hosts_lookup;
+	struct CfValue server_compression_lookup;
 	int pool_size = -1;
 	int min_pool_size = -1;
 	int res_pool_size = -1;
@@ -265,6 +266,7 @@ bool parse_database(void *base, const char *name, const char *connstr)
 	int dbname_ofs;
 	int pool_mode = POOL_INHERIT;
 	enum LoadBalanceHosts load_balance_hosts = LOAD_BALANCE_HOSTS_ROUND_ROBIN;
+	enum ServerCompression server_compression = SERVER_COMPRESSION_DISABLE;
 
 	char *tmp_connstr;
 	const char *dbname = name;
@@ -280,6 +282,7 @@ bool parse_database(void *base, const char *name, const char *connstr)
 	char *connect_query = NULL;
 	char *appname = NULL;
 	char *auth_query = NULL;
+	char *replicas = NULL;
 
 	cv.value_p = &pool_mode;
 	cv.extra = (const void *)pool_mode_map;
@@ -287,6 +290,9 @@ bool parse_database(void *base, const char *name, const char *connstr)
 	load_balance_hosts_lookup.value_p = &load_balance_hosts;
 	load_balance_hosts_lookup.extra = (const void *)load_balance_hosts_map;
 
+	server_compression_lookup.value_p = &server_compression;
+	server_compression_lookup.extra = (const void *)server_compression_map;
+
 	if (!check_reserved_database(name)) {
 		log_error("database name \"%s\" is reserved", name);
 		return false;
@@ -361,6 +367,11 @@ bool parse_database(void *base, const char *name, const char *connstr)
 				log_error("invalid load_balance_hosts: %s", val);
 				goto fail;
 			}
+		} else if (strcmp("server_compression", key) == 0) {
+			if (!cf_set_lookup(&server_compression_lookup, val)) {
+				log_error("invalid server_compression: %s", val);
+				goto fail;
+			}
 		} else if (strcmp("pool_mode", key) == 0) {
 			if (!cf_set_lookup(&cv, val)) {
 				log_error("invalid pool mode: %s", val);
@@ -373,6 +384,8 @@ bool parse_database(void *base, const char *name, const char *connstr)
 			appname = val;
 		} else if (strcmp("auth_query", key) == 0) {
 			auth_query = val;
+		} else if (strcmp("replicas", key) == 0) {
+			replicas = val;
 		} else {
 			log_error("unrecognized connection parameter: %s", key);
 			goto fail;
@@ -414,6 +427,8 @@ bool parse_database(void *base, const char *name, const char *connstr)
 			changed = true;
 		} else if (load_balance_hosts != db->load_balance_hosts) {
 			changed = true;
+		} else if (server_compression != db->server_compression) {
+			changed = true;
 		}
 		if (changed)
 			tag_database_dirty(db);
@@ -435,6 +450,7 @@ bool parse_database(void *base, const char *name, const char *connstr)
 	db->max_db_connections = max_db_connections;
 	db->server_lifetime = server_lifetime;
 	db->load_balance_hosts = load_balance_hosts;
+	db->server_compression = server_compression;
 	free(db->connect_query);
 	db->connect_query = connect_query;
 	connect_query = NULL;
@@ -445,6 +461,9 @@ bool parse_database(void *base, const char *name, const char *connstr)
 	if (!set_param_value(&db->auth_query, auth_query))
 		goto fail;
 
+	if (!set_param_value(&db->replicas, replicas))
+		goto fail;
+
 	if (db->startup_params) {
 		msg = db->startup_params;
 		pktbuf_reset(msg);
@@ -98,11 +98,17 @@ char *cf_unix_socket_dir;
 int cf_unix_socket_mode;
 char *cf_unix_socket_group;
 int cf_peer_id;
+int cf_peer_link;
+char *cf_peer_link_secret;
 
 int cf_pool_mode = POOL_SESSION;
+int cf_read_only_routing = READ_ONLY_ROUTING_EXPLICIT;
 
 /* sbuf config */
 int cf_sbuf_len;
+int cf_sbuf_len_max;
+int cf_slab_free_target;
+unsigned int cf_huge_page_arena_size;
 int cf_sbuf_loopcnt;
 int cf_so_reuseport;
 int cf_tcp_socket_buffer;
@@ -125,6 +131,9 @@ char *cf_auth_ident_file;
 char *cf_auth_ldap_options;
 char *cf_auth_user;
 char *cf_auth_query;
+usec_t cf_auth_query_cache_ttl;
+usec_t cf_auth_query_cache_negative_ttl;
+int cf_auth_query_cache_size;
 char *cf_auth_dbname;
 char *cf_track_extra_parameters;
 
@@ -151,6 +160,9 @@ usec_t cf_dns_nxdomain_ttl;
 usec_t cf_dns_zone_check_period;
 char *cf_resolv_conf;
 unsigned int cf_max_packet_size;
+unsigned int cf_result_spool_size;
+unsigned int cf_result_spool_file_size;
+unsigned int cf_result_spool_total_size;
 
 char *cf_ignore_startup_params;
 
@@ -165,6 +177,9 @@ usec_t cf_server_login_retry;
 usec_t cf_query_timeout;
 usec_t cf_query_wait_timeout;
 usec_t cf_cancel_wait_timeout;
+int cf_cancel_pool_size;
+usec_t cf_cancel_standby_lifetime;
+int cf_cancel_rate_limit;
 usec_t cf_client_idle_timeout;
 usec_t cf_client_login_timeout;
 usec_t cf_pool_idle_timeout;
@@ -189,6 +204,8 @@ int cf_log_disconnections;
 int cf_log_pooler_errors;
 int cf_application_name_add_host;
 
+int cf_client_compression;
+
 int cf_client_tls_sslmode;
 char *cf_client_tls_protocols;
 char *cf_client_tls_ca_file;
@@ -198,6 +215,8 @@ char *cf_client_tls_ciphers;
 char *cf_client_tls13_ciphers;
 char *cf_client_tls_dheparams;
 char *cf_client_tls_ecdhecurve;
+usec_t cf_client_tls_session_lifetime;
+int cf_client_tls_session_cache_size;
 
 int cf_server_tls_sslmode;
 char *cf_server_tls_protocols;
@@ -208,6 +227,13 @@ char *cf_server_tls_ciphers;
 char *cf_server_tls13_ciphers;
 
 int cf_max_prepared_statements;
+unsigned int cf_prepared_statement_cache_size;
+int cf_prepared_statement_describe_cache;
+int cf_prepared_statement_preprepare;
+
+int cf_predictive_prewarm;
+usec_t cf_predictive_prewarm_lead;
+char *cf_predictive_prewarm_state_file;
 
 int cf_scram_iterations;
 
@@ -258,6 +284,19 @@ const struct CfLookup load_balance_hosts_map[] = {
 	{ NULL }
 };
 
+const struct CfLookup server_compression_map[] = {
+	{ "disable", SERVER_COMPRESSION_DISABLE },
+	{ "enable", SERVER_COMPRESSION_ENABLE },
+	{ "always", SERVER_COMPRESSION_ALWAYS },
+	{ NULL }
+};
+
+const struct CfLookup read_only_routing_map[] = {
+	{ "explicit", READ_ONLY_ROUTING_EXPLICIT },
+	{ "select", READ_ONLY_ROUTING_SELECT },
+	{ NULL }
+};
+
 /*
  * Add new parameters in alphabetical order. This order is used by SHOW CONFIG.
  */
@@ -270,10 +309,17 @@ static const struct CfKey bouncer_params [] = {
 	CF_ABS("auth_ident_file", CF_STR, cf_auth_ident_file, 0, NULL),
 	CF_ABS("auth_ldap_options", CF_STR, cf_auth_ldap_options, 0, NULL),
 	CF_ABS("auth_query", CF_STR, cf_auth_query, 0, "SELECT rolname, CASE WHEN rolvaliduntil < now() THEN NULL ELSE rolpassword END FROM pg_authid WHERE rolname=$1 AND rolcanlogin"),
+	CF_ABS("auth_query_cache_negative_ttl", CF_TIME_USEC, cf_auth_query_cache_negative_ttl, 0, "0"),
+	CF_ABS("auth_query_cache_size", CF_INT, cf_auth_query_cache_size, 0, "1000"),
+	CF_ABS("auth_query_cache_ttl", CF_TIME_USEC, cf_auth_query_cache_ttl, 0, "0"),
 	CF_ABS("auth_type", CF_LOOKUP(auth_type_map), cf_auth_type, 0, "md5"),
 	CF_ABS("auth_user", CF_STR, cf_auth_user, 0, NULL),
 	CF_ABS("autodb_idle_timeout", CF_TIME_USEC, cf_autodb_idle_timeout, 0, "3600"),
+	CF_ABS("cancel_pool_size", CF_INT, cf_cancel_pool_size, 0, "0"),
+	CF_ABS("cancel_standby_lifetime", CF_TIME_USEC, cf_cancel_standby_lifetime, 0, "30"),
+	CF_ABS("cancel_rate_limit", CF_INT, cf_cancel_rate_limit, 0, "0"),
 	CF_ABS("cancel_wait_timeout", CF_TIME_USEC, cf_cancel_wait_timeout, 0, "10"),
+	CF_ABS("client_compression", CF_INT, cf_client_compression, 0, "0"),
 	CF_ABS("client_idle_timeout", CF_TIME_USEC, cf_client_idle_timeout, 0, "0"),
 	CF_ABS("client_login_timeout", CF_TIME_USEC, cf_client_login_timeout, 0, "60"),
 	CF_ABS("client_tls13_ciphers", CF_STR, cf_client_tls13_ciphers, 0, NULL),
@@ -284,6 +330,8 @@ static const struct CfKey bouncer_params [] = {
 	CF_ABS("client_tls_ecdhcurve", CF_STR, cf_client_tls_ecdhecurve, 0, "auto"),
 	CF_ABS("client_tls_key_file", CF_STR, cf_client_tls_key_file, 0, ""),
 	CF_ABS("client_tls_protocols", CF_STR, cf_client_tls_protocols, 0, "secure"),
+	CF_ABS("client_tls_session_cache_size", CF_INT, cf_client_tls_session_cache_size, 0, "20480"),
+	CF_ABS("client_tls_session_lifetime", CF_TIME_USEC, cf_client_tls_session_lifetime, 0, "300"),
 	CF_ABS("client_tls_sslmode", CF_LOOKUP(sslmode_map), cf_client_tls_sslmode, 0, "disable"),
 	CF_ABS("conffile", CF_STR, cf_config_file, 0, NULL),
 	CF_ABS("default_pool_size", CF_INT, cf_default_pool_size, 0, "20"),
@@ -291,6 +339,7 @@ static const struct CfKey bouncer_params [] = {
 	CF_ABS("dns_max_ttl", CF_TIME_USEC, cf_dns_max_ttl, 0, "15"),
 	CF_ABS("dns_nxdomain_ttl", CF_TIME_USEC, cf_dns_nxdomain_ttl, 0, "15"),
 	CF_ABS("dns_zone_check_period", CF_TIME_USEC, cf_dns_zone_check_period, 0, "0"),
+	CF_ABS("huge_page_arena_size", CF_UINT, cf_huge_page_arena_size, CF_NO_RELOAD, "0"),
 	CF_ABS("idle_transaction_timeout", CF_TIME_USEC, cf_idle_transaction_timeout, 0, "0"),
 	CF_ABS("ignore_startup_parameters", CF_STR, cf_ignore_startup_params, 0, ""),
 	CF_ABS("job_name", CF_STR, cf_jobname, CF_NO_RELOAD, "pgbouncer"),
@@ -312,16 +361,29 @@ static const struct CfKey bouncer_params [] = {
 	CF_ABS("max_user_connections", CF_INT, cf_max_user_connections, 0, "0"),
 	CF_ABS("min_pool_size", CF_INT, cf_min_pool_size, 0, "0"),
 	CF_ABS("peer_id", CF_INT, cf_peer_id, 0, "0"),
+	CF_ABS("peer_link", CF_INT, cf_peer_link, 0, "0"),
+	CF_ABS("peer_link_secret", CF_STR, cf_peer_link_secret, 0, ""),
 	CF_ABS("pidfile", CF_STR, cf_pidfile, CF_NO_RELOAD, ""),
 	CF_ABS("pkt_buf", CF_INT, cf_sbuf_len, CF_NO_RELOAD, "4096"),
+	CF_ABS("pkt_buf_max", CF_INT, cf_sbuf_len_max, CF_NO_RELOAD, "0"),
 	CF_ABS("pool_mode", CF_LOOKUP(pool_mode_map), cf_pool_mode, 0, "session"),
 	CF_ABS("pool_idle_timeout", CF_TIME_USEC, cf_pool_idle_timeout, 0, "0"),
+	CF_ABS("predictive_prewarm", CF_INT, cf_predictive_prewarm, 0, "0"),
+	CF_ABS("predictive_prewarm_lead", CF_TIME_USEC, cf_predictive_prewarm_lead, 0, "900"),
+	CF_ABS("predictive_prewarm_state_file", CF_STR, cf_predictive_prewarm_state_file, 0, ""),
+	CF_ABS("prepared_statement_cache_size", CF_UINT, cf_prepared_statement_cache_size, 0, "0"),
+	CF_ABS("prepared_statement_describe_cache", CF_INT, cf_prepared_statement_describe_cache, 0, "0"),
+	CF_ABS("prepared_statement_preprepare", CF_INT, cf_prepared_statement_preprepare, 0, "0"),
 	CF_ABS("query_timeout", CF_TIME_USEC, cf_query_timeout, 0, "0"),
 	CF_ABS("query_wait_notify", CF_INT, cf_query_wait_notify, 0, "5"),
 	CF_ABS("query_wait_timeout", CF_TIME_USEC, cf_query_wait_timeout, 0, "120"),
+	CF_ABS("read_only_routing", CF_LOOKUP(read_only_routing_map), cf_read_only_routing, 0, "explicit"),
 	CF_ABS("reserve_pool_size", CF_INT, cf_res_pool_size, 0, "0"),
 	CF_ABS("reserve_pool_timeout", CF_TIME_USEC, cf_res_pool_timeout, 0, "5"),
 	CF_ABS("resolv_conf", CF_STR, cf_resolv_conf, CF_NO_RELOAD, ""),
+	CF_ABS("result_spool_file_size", CF_UINT, cf_result_spool_file_size, 0, "0"),
+	CF_ABS("result_spool_size", CF_UINT, cf_result_spool_size, 0, "0"),
+	CF_ABS("result_spool_total_size", CF_UINT, cf_result_spool_total_size, 0, "268435456"),
 	CF_ABS("sbuf_loopcnt", CF_INT, cf_sbuf_loopcnt, 0, "5"),
 	CF_ABS("scram_iterations", CF_INT, cf_scram_iterations, 0, SCRAM_DEFAULT_ITERATIONS),
 	CF_ABS("server_check_delay", CF_TIME_USEC, cf_server_check_delay, 0, "30"),
@@ -344,6 +406,7 @@ static const struct CfKey bouncer_params [] = {
 #ifdef WIN32
 	CF_ABS("service_name", CF_STR, cf_jobname, CF_NO_RELOAD, NULL),	/* alias for job_name */
 #endif
+	CF_ABS("slab_free_target", CF_INT, cf_slab_free_target, 0, "25"),
 	CF_ABS("so_reuseport", CF_INT, cf_so_reuseport, CF_NO_RELOAD, "0"),
 	CF_ABS("stats_period", CF_INT, cf_stats_period, 0, "60"),
 	CF_ABS("stats_users", CF_STR, cf_stats_users, 0, ""),
@@ -522,6 +585,9 @@ bool load_config(void)
 	/* kill dbs */
 	config_postprocess();
 
+	/* secrets may have changed along with auth_user or auth_query */
+	auth_cache_reset();
+
 	/* reopen logfile */
 	if (main_config.loaded)
 		reset_logging();
@@ -834,9 +900,9 @@ static void check_limits(void)
 	struct List *item;
 	PgDatabase *db;
 
-	log_noise("event: %d, SBuf: %d, PgSocket: %d, IOBuf: %d",
+	log_noise("event: %d, SBuf: %d, PgSocket: %d, PgLoginState: %d, IOBuf: %d",
 		  (int)sizeof(struct event), (int)sizeof(SBuf),
-		  (int)sizeof(PgSocket), (int)IOBUF_SIZE);
+		  (int)sizeof(PgSocket), (int)sizeof(PgLoginState), (int)IOBUF_SIZE);
 
 	/* load limits */
 	err = getrlimit(RLIMIT_NOFILE, &lim);
@@ -981,6 +1047,7 @@ static void cleanup(void)
 
 	tls_deinit();
 	varcache_deinit();
+	auth_cache_reset();
 	pktbuf_cleanup();
 
 	reset_logging();
@@ -1024,6 +1091,9 @@ static void cleanup(void)
 	xfree((char **)&cf_syslog_facility);
 
 	xfree(&cf_track_extra_parameters);
+	xfree(&cf_predictive_prewarm_state_file);
+
+	prewarm_cleanup();
 }
 
 /* boot everything */
@@ -1106,6 +1176,7 @@ int main(int argc, char *argv[])
 	main_config.loaded = true;
 	init_var_lookup(cf_track_extra_parameters);
 	init_caches();
+	prewarm_load();
 	logging_prefix_cb = log_socket_prefix;
 
 	if (!sbuf_tls_setup())
@@ -1185,5 +1256,7 @@ int main(int argc, char *argv[])
 	while (cf_shutdown != SHUTDOWN_IMMEDIATE)
 		main_loop_once();
 
+	prewarm_save(true);
+
 	return 0;
 }
@@ -1,5 +1,7 @@
 #include "bouncer.h"
 
+#include <usual/hashing/xxhash.h>
+
 /* Inspect Parse packet to see if it defines a named prepared statement */
 PreparedStatementAction inspect_parse_packet(PgSocket *client, PktHdr *pkt)
 {
@@ -96,12 +98,11 @@ bool unmarshall_parse_packet(PgSocket *client, PktHdr *pkt, PgParsePacket *parse
 
 	parse_packet->len = pkt->len;
 	parse_packet->name = statement;
+	/* query, \0, num_parameters and the types are contiguous in the packet */
 	parse_packet->query_and_parameters_len =
-		strlen(query)
-		+ 1	/* \0 */
-		+ sizeof(num_parameters)
-		+ parameters_length;
+		(const char *)parameter_types_bytes + parameters_length - query;
 	parse_packet->query_and_parameters = query;
+	parse_packet->query_hash = xxhash(query, parse_packet->query_and_parameters_len, 0);
 
 	return true;
 
@@ -67,10 +67,11 @@ struct Slab *peer_pool_cache;
 struct Slab *pool_cache;
 struct Slab *user_cache;
 struct Slab *credentials_cache;
-struct Slab *iobuf_cache;
-struct Slab *outstanding_request_cache;
+struct Slab *iobuf_caches[MAX_IOBUF_CLASSES];
+int iobuf_class_count;
 struct Slab *var_list_cache;
 struct Slab *server_prepared_statement_cache;
+struct Slab *login_state_cache;
 unsigned long long int last_pgsocket_id;
 
 /*
@@ -107,6 +108,7 @@ static void construct_client(void *obj)
 	PgSocket *client = obj;
 	memset(client, 0, sizeof(PgSocket));
 	list_init(&client->head);
+	timerwheel_entry_init(&client->timeout);
 	sbuf_init(&client->sbuf, client_proto);
 	client->vars.var_list = slab_alloc(var_list_cache);
 	client->state = CL_FREE;
@@ -121,12 +123,14 @@ static void construct_server(void *obj)
 
 	memset(server, 0, sizeof(PgSocket));
 	list_init(&server->head);
+	list_init(&server->evict_db_head);
+	list_init(&server->evict_user_head);
+	timerwheel_entry_init(&server->timeout);
 	sbuf_init(&server->sbuf, server_proto);
 	server->vars.var_list = slab_alloc(var_list_cache);
 	server->state = SV_FREE;
 	server->server_prepared_statements = NULL;
 	server->host = NULL;
-	statlist_init(&server->outstanding_requests, "outstanding_requests");
 
 	server->id = ++last_pgsocket_id;
 }
@@ -165,7 +169,6 @@ void init_objects(void)
 	peer_cache = slab_create("peer_cache", sizeof(PgDatabase), 0, NULL, USUAL_ALLOC);
 	peer_pool_cache = slab_create("peer_pool_cache", sizeof(PgPool), 0, NULL, USUAL_ALLOC);
 	pool_cache = slab_create("pool_cache", sizeof(PgPool), 0, NULL, USUAL_ALLOC);
-	outstanding_request_cache = slab_create("outstanding_request_cache", sizeof(OutstandingRequest), 0, NULL, USUAL_ALLOC);
 
 	if (!user_cache || !db_cache || !peer_cache || !peer_pool_cache || !pool_cache)
 		fatal("cannot create initial caches");
@@ -177,14 +180,81 @@ static void do_iobuf_reset(void *arg)
 	iobuf_reset(io);
 }
 
+/* one cache per size class, the first one keeps the old name */
+static void init_iobuf_caches(void)
+{
+	char name[32];
+	unsigned size = cf_sbuf_len;
+	int i;
+
+	for (i = 0; i < MAX_IOBUF_CLASSES; i++) {
+		if (i > 0) {
+			if (size * 2 > (unsigned)cf_sbuf_len_max)
+				break;
+			size *= 2;
+			snprintf(name, sizeof(name), "iobuf_cache_%u", size);
+		} else {
+			snprintf(name, sizeof(name), "iobuf_cache");
+		}
+		iobuf_caches[i] = slab_create(name, RAW_IOBUF_SIZE + size, 0, do_iobuf_reset, arena_cx());
+		if (!iobuf_caches[i])
+			fatal("cannot create iobuf cache");
+	}
+	iobuf_class_count = i;
+}
+
+IOBuf *iobuf_alloc(unsigned size_class)
+{
+	IOBuf *io;
+
+	Assert(size_class < (unsigned)iobuf_class_count);
+
+	io = slab_alloc(iobuf_caches[size_class]);
+	if (io) {
+		io->size = (unsigned)cf_sbuf_len << size_class;
+		io->size_class = size_class;
+	}
+	return io;
+}
+
+void iobuf_free(IOBuf *io)
+{
+	slab_free(iobuf_caches[io->size_class], io);
+}
+
 /* initialization after config loading */
 void init_caches(void)
 {
-	server_cache = slab_create("server_cache", sizeof(PgSocket), 0, construct_server, USUAL_ALLOC);
-	client_cache = slab_create("client_cache", sizeof(PgSocket), 0, construct_client, USUAL_ALLOC);
-	iobuf_cache = slab_create("iobuf_cache", IOBUF_SIZE, 0, do_iobuf_reset, USUAL_ALLOC);
+	/* the big ones go to the huge page arena, if there is one */
+	arena_setup();
+	server_cache = slab_create("server_cache", sizeof(PgSocket), 0, construct_server, arena_cx());
+	client_cache = slab_create("client_cache", sizeof(PgSocket), 0, construct_client, arena_cx());
+	init_iobuf_caches();
 	var_list_cache = slab_create("var_list_cache", sizeof(struct PStr *) * get_num_var_cached(), 0, NULL, USUAL_ALLOC);
 	server_prepared_statement_cache = slab_create("server_prepared_statement_cache", sizeof(PgServerPreparedStatement), 0, NULL, USUAL_ALLOC);
+	login_state_cache = slab_create("login_state_cache", sizeof(PgLoginState), 0, NULL, USUAL_ALLOC);
+}
+
+/*
+ * Get the login-only state of a socket, allocating it on first use.
+ * Returns NULL if out of memory.
+ */
+PgLoginState *socket_login_state(PgSocket *sk)
+{
+	if (!sk->login_state)
+		sk->login_state = slab_alloc(login_state_cache);
+	return sk->login_state;
+}
+
+/* release login-only state once it is not needed anymore */
+void free_login_state(PgSocket *sk)
+{
+	if (!sk->login_state)
+		return;
+	auth_query_abandon(sk);
+	free_scram_state(&sk->login_state->scram_state);
+	slab_free(login_state_cache, sk->login_state);
+	sk->login_state = NULL;
 }
 
 /* free all memory related to the given client */
@@ -199,16 +269,15 @@ static void client_free(PgSocket *client)
 /* free all memory related to the given server */
 static void server_free(PgSocket *server)
 {
-	struct List *el, *tmp_l;
-	OutstandingRequest *request;
+	OutstandingRequest request;
 
-	statlist_for_each_safe(el, &server->outstanding_requests, tmp_l) {
-		request = container_of(el, OutstandingRequest, node);
-		statlist_remove(&server->canceling_clients, el);
-		if (request->server_ps)
-			free_server_prepared_statement(request->server_ps);
-		slab_free(outstanding_request_cache, request);
+	while (take_outstanding_request(server, &request)) {
+		if (request.server_ps)
+			free_server_prepared_statement(request.server_ps);
+		free_outstanding_request(&request);
 	}
+	free(server->outstanding_requests.heap_slots);
+	server->outstanding_requests.heap_slots = NULL;
 
 	free_server_prepared_statements(server);
 	free(server->host);
@@ -258,6 +327,8 @@ void change_client_state(PgSocket *client, SocketState newstate)
 
 	client->state = newstate;
 
+	client_timeout_update(client);
+
 	/* put to new location */
 	switch (client->state) {
 	case CL_FREE:
@@ -273,6 +344,7 @@ void change_client_state(PgSocket *client, SocketState newstate)
 	case CL_WAITING_LOGIN:
 		client->wait_start = get_cached_time();
 		statlist_append(&pool->waiting_client_list, &client->head);
+		pool_mark_ready(pool);
 		break;
 	case CL_ACTIVE:
 		statlist_append(&pool->active_client_list, &client->head);
@@ -282,12 +354,46 @@ void change_client_state(PgSocket *client, SocketState newstate)
 		break;
 	case CL_WAITING_CANCEL:
 		statlist_append(&pool->waiting_cancel_req_list, &client->head);
+		pool_mark_ready(pool);
 		break;
 	default:
 		fatal("bad new client state: %d", client->state);
 	}
 }
 
+/*
+ * Servers that may be evicted to make room for a new connection are also
+ * kept in per-database and per-user lists, in the order they became
+ * evictable, so that eviction does not need to look at every pool.
+ */
+static void evict_lists_remove(PgSocket *server, bool idle)
+{
+	PgDatabase *db = server->pool->db;
+	PgGlobalUser *user = server->pool->user_credentials->global_user;
+
+	if (idle) {
+		statlist_remove(&db->evict_idle_server_list, &server->evict_db_head);
+		statlist_remove(&user->evict_idle_server_list, &server->evict_user_head);
+	} else {
+		statlist_remove(&db->evict_used_server_list, &server->evict_db_head);
+		statlist_remove(&user->evict_used_server_list, &server->evict_user_head);
+	}
+}
+
+static void evict_lists_append(PgSocket *server, bool idle)
+{
+	PgDatabase *db = server->pool->db;
+	PgGlobalUser *user = server->pool->user_credentials->global_user;
+
+	if (idle) {
+		statlist_append(&db->evict_idle_server_list, &server->evict_db_head);
+		statlist_append(&user->evict_idle_server_list, &server->evict_user_head);
+	} else {
+		statlist_append(&db->evict_used_server_list, &server->evict_db_head);
+		statlist_append(&user->evict_used_server_list, &server->evict_user_head);
+	}
+}
+
 /* state change means moving between lists */
 void change_server_state(PgSocket *server, SocketState newstate)
 {
@@ -301,25 +407,34 @@ void change_server_state(PgSocket *server, SocketState newstate)
 		statlist_remove(&justfree_server_list, &server->head);
 		break;
 	case SV_LOGIN:
-		statlist_remove(&pool->new_server_list, &server->head);
+		if (server->cancel_standby)
+			statlist_remove(&pool->cancel_standby_server_list, &server->head);
+		else
+			statlist_remove(&pool->new_server_list, &server->head);
 		break;
 	case SV_USED:
 		statlist_remove(&pool->used_server_list, &server->head);
+		evict_lists_remove(server, false);
 		break;
 	case SV_TESTED:
 		statlist_remove(&pool->tested_server_list, &server->head);
+		evict_lists_remove(server, false);
 		break;
 	case SV_BEING_CANCELED:
 		statlist_remove(&pool->being_canceled_server_list, &server->head);
 		break;
 	case SV_IDLE:
 		statlist_remove(&pool->idle_server_list, &server->head);
+		evict_lists_remove(server, true);
 		break;
 	case SV_ACTIVE:
 		statlist_remove(&pool->active_server_list, &server->head);
 		break;
 	case SV_ACTIVE_CANCEL:
-		statlist_remove(&pool->active_cancel_server_list, &server->head);
+		if (server->cancel_standby)
+			statlist_remove(&pool->cancel_standby_server_list, &server->head);
+		else
+			statlist_remove(&pool->active_cancel_server_list, &server->head);
 		break;
 	default:
 		fatal("bad old server state: %d", server->state);
@@ -327,6 +442,8 @@ void change_server_state(PgSocket *server, SocketState newstate)
 
 	server->state = newstate;
 
+	server_timeout_update(server);
+
 	/* put to new location */
 	switch (server->state) {
 	case SV_FREE:
@@ -336,14 +453,19 @@ void change_server_state(PgSocket *server, SocketState newstate)
 		statlist_append(&justfree_server_list, &server->head);
 		break;
 	case SV_LOGIN:
-		statlist_append(&pool->new_server_list, &server->head);
+		if (server->cancel_standby)
+			statlist_append(&pool->cancel_standby_server_list, &server->head);
+		else
+			statlist_append(&pool->new_server_list, &server->head);
 		break;
 	case SV_USED:
 		/* use LIFO */
 		statlist_prepend(&pool->used_server_list, &server->head);
+		evict_lists_append(server, false);
 		break;
 	case SV_TESTED:
 		statlist_append(&pool->tested_server_list, &server->head);
+		evict_lists_append(server, false);
 		break;
 	case SV_BEING_CANCELED:
 		statlist_append(&pool->being_canceled_server_list, &server->head);
@@ -356,12 +478,16 @@ void change_server_state(PgSocket *server, SocketState newstate)
 			/* otherwise use LIFO */
 			statlist_prepend(&pool->idle_server_list, &server->head);
 		}
+		evict_lists_append(server, true);
 		break;
 	case SV_ACTIVE:
 		statlist_append(&pool->active_server_list, &server->head);
 		break;
 	case SV_ACTIVE_CANCEL:
-		statlist_append(&pool->active_cancel_server_list, &server->head);
+		if (server->cancel_standby)
+			statlist_append(&pool->cancel_standby_server_list, &server->head);
+		else
+			statlist_append(&pool->active_cancel_server_list, &server->head);
 		break;
 	default:
 		fatal("bad server state: %d", server->state);
@@ -478,6 +604,8 @@ PgDatabase *add_database(const char *name)
 			return NULL;
 		}
 		aatree_init(&db->user_tree, credentials_node_cmp, credentials_node_release);
+		statlist_init(&db->evict_idle_server_list, "evict_idle_server_list");
+		statlist_init(&db->evict_used_server_list, "evict_used_server_list");
 		put_in_order(&db->head, &database_list, cmp_database);
 	}
 
@@ -498,6 +626,7 @@ PgDatabase *register_auto_database(const char *name)
 	db = find_database(name);
 	if (db) {
 		db->db_auto = true;
+		resolve_replicas(db);
 	}
 
 	return db;
@@ -523,6 +652,8 @@ static PgGlobalUser *add_new_global_user(const char *name, const char *passwd)
 
 	list_init(&user->head);
 	list_init(&user->pool_list);
+	statlist_init(&user->evict_idle_server_list, "evict_idle_server_list");
+	statlist_init(&user->evict_used_server_list, "evict_used_server_list");
 	safe_strcpy(user->credentials.name, name, sizeof(user->credentials.name));
 	put_in_order(&user->head, &user_list, cmp_user);
 
@@ -707,6 +838,7 @@ static PgPool *new_pool(PgDatabase *db, PgCredentials *user_credentials)
 
 	list_init(&pool->head);
 	list_init(&pool->map_head);
+	list_init(&pool->ready_head);
 	pool->orig_vars.var_list = slab_alloc(var_list_cache);
 
 	pool->user_credentials = user_credentials;
@@ -723,6 +855,7 @@ static PgPool *new_pool(PgDatabase *db, PgCredentials *user_credentials)
 	statlist_init(&pool->waiting_cancel_req_list, "waiting_cancel_req_list");
 	statlist_init(&pool->active_cancel_req_list, "active_cancel_req_list");
 	statlist_init(&pool->active_cancel_server_list, "active_cancel_server_list");
+	statlist_init(&pool->cancel_standby_server_list, "cancel_standby_server_list");
 	statlist_init(&pool->being_canceled_server_list, "being_canceled_server_list");
 
 	list_append(&user_credentials->global_user->pool_list, &pool->map_head);
@@ -730,6 +863,11 @@ static PgPool *new_pool(PgDatabase *db, PgCredentials *user_credentials)
 	/* keep pools in db/user order to make stats faster */
 	put_in_order(&pool->head, &pool_list, cmp_pool);
 
+	prewarm_attach_pool(pool);
+
+	/* the database might be paused or waiting for close already */
+	pool_mark_ready(pool);
+
 	return pool;
 }
 
@@ -751,6 +889,7 @@ static PgPool *new_peer_pool(PgDatabase *db)
 
 	list_init(&pool->head);
 	list_init(&pool->map_head);
+	list_init(&pool->ready_head);
 	pool->orig_vars.var_list = slab_alloc(var_list_cache);
 
 	pool->db = db;
@@ -759,6 +898,7 @@ static PgPool *new_peer_pool(PgDatabase *db)
 	statlist_init(&pool->waiting_cancel_req_list, "waiting_cancel_req_list");
 	statlist_init(&pool->active_cancel_req_list, "active_cancel_req_list");
 	statlist_init(&pool->active_cancel_server_list, "active_cancel_server_list");
+	statlist_init(&pool->cancel_standby_server_list, "cancel_standby_server_list");
 
 	/* keep pools in peer_id order to make stats faster */
 	put_in_order(&pool->head, &peer_pool_list, cmp_peer_pool);
@@ -822,7 +962,8 @@ static void pause_cancel_request(PgSocket *client)
 
 	slog_debug(client, "pause_cancel_request");
 	change_client_state(client, CL_WAITING_CANCEL);
-	if (!sbuf_pause(&client->sbuf))
+	/* requests that came over a peer link have no socket */
+	if (sbuf_socket(&client->sbuf) != 0 && !sbuf_pause(&client->sbuf))
 		disconnect_client(client, true, "pause cancel request failed");
 }
 
@@ -842,6 +983,17 @@ void activate_client(PgSocket *client)
 	sbuf_continue(&client->sbuf);
 }
 
+/* move an idle client to another pool, see route_client() */
+void switch_client_pool(PgSocket *client, PgPool *pool)
+{
+	Assert(client->state == CL_ACTIVE);
+	Assert(!client->link);
+
+	statlist_remove(&client->pool->active_client_list, &client->head);
+	client->pool = pool;
+	statlist_append(&pool->active_client_list, &client->head);
+}
+
 /*
  * Don't let clients queue at all if there is no working server connection.
  *
@@ -965,6 +1117,13 @@ bool find_server(PgSocket *client)
 		client->link = server;
 		server->link = client;
 		server->pool->stats.server_assignment_count++;
+		/*
+		 * Let results that the client does not read fast enough be
+		 * spooled, so the server can be released on ReadyForQuery.
+		 * Pointless in session mode, where it is not released anyway.
+		 */
+		client->sbuf.spool_allowed = connection_pool_mode(client) != POOL_SESSION
+					     && !client->replication;
 		change_server_state(server, SV_ACTIVE);
 		if (varchange) {
 			server->setting_vars = true;
@@ -1006,13 +1165,20 @@ static bool reuse_on_release(PgSocket *server)
 	return res;
 }
 
-bool queue_fake_response(PgSocket *client, char request_type)
+/*
+ * Queue the response to a request that was not sent to the server.  For
+ * Describe, ps is the statement whose cached response to send.
+ */
+bool queue_fake_response(PgSocket *client, char request_type, PgPreparedStatement *ps)
 {
 	bool res = true;
 	PgSocket *server = client->link;
 	Assert(server);
 
-	if (request_type == PqMsg_Parse) {
+	if (request_type == PqMsg_Describe) {
+		slog_debug(client, "Queuing cached Describe response");
+		res = queue_cached_describe_response(client, server, ps);
+	} else if (request_type == PqMsg_Parse) {
 		slog_debug(client, "Queuing fake ParseComplete packet");
 		QUEUE_ParseComplete(res, server, client);
 	} else if (request_type == PqMsg_Close) {
@@ -1046,20 +1212,72 @@ PgCredentials *find_or_add_new_global_credentials(const char *name, const char *
 	return &user->credentials;
 }
 
+/* move the requests to a ring twice as large */
+static bool grow_outstanding_queue(PgSocket *server)
+{
+	struct OutstandingQueue *q = &server->outstanding_requests;
+	unsigned size = q->heap_slots ? q->heap_size * 2 : OUTSTANDING_INLINE_SLOTS * 2;
+	OutstandingRequest *slots;
+	unsigned i;
+
+	slots = malloc(size * sizeof(*slots));
+	if (!slots)
+		return false;
+	for (i = 0; i < q->count; i++)
+		slots[i] = *outstanding_request_at(server, i);
+	free(q->heap_slots);
+	q->heap_slots = slots;
+	q->heap_size = size;
+	q->head = 0;
+	return true;
+}
+
+/* returns a zeroed slot at the end of the queue, NULL if out of memory */
+static OutstandingRequest *push_outstanding_request(PgSocket *server)
+{
+	struct OutstandingQueue *q = &server->outstanding_requests;
+	unsigned size = q->heap_slots ? q->heap_size : OUTSTANDING_INLINE_SLOTS;
+	OutstandingRequest *ring, *request;
+
+	if (q->count == size) {
+		if (!grow_outstanding_queue(server))
+			return NULL;
+		size = q->heap_size;
+	}
+	ring = q->heap_slots ? q->heap_slots : q->inline_slots;
+	request = &ring[(q->head + q->count) & (size - 1)];
+	q->count++;
+	memset(request, 0, sizeof(*request));
+	return request;
+}
+
 /*
- * Adds a request to the outstanding requests queue, and schedule the given
- * action (see comments on ResponseAction for details).
- *
- * returns false if the required allocations failed
+ * Remove the oldest request from the queue, its contents are copied to
+ * *request.  Returns false if the queue is empty.
  */
-bool add_outstanding_request(PgSocket *client, char type, ResponseAction action)
+bool take_outstanding_request(PgSocket *server, OutstandingRequest *request)
+{
+	struct OutstandingQueue *q = &server->outstanding_requests;
+	OutstandingRequest *first = first_outstanding_request(server);
+
+	if (!first)
+		return false;
+	*request = *first;
+	q->head++;
+	q->count--;
+	if (q->count == 0)
+		q->head = 0;
+	return true;
+}
+
+static bool add_request(PgSocket *client, char type, ResponseAction action, PgPreparedStatement *ps)
 {
 	OutstandingRequest *request = NULL;
 
 	PgSocket *server = client->link;
 	Assert(server);
 
-	if (action == RA_FAKE && statlist_empty(&server->outstanding_requests)) {
+	if (action == RA_FAKE && outstanding_request_count(server) == 0) {
 		/*
 		 * If there's no outstanding requests, we can send the response
 		 * right away. And we're actually required to do that to make
@@ -1070,20 +1288,52 @@ bool add_outstanding_request(PgSocket *client, char type, ResponseAction action)
 		 */
 		slog_noise(client, "add_outstanding_request: queueing fake response right away %c",
 			   type);
-		return queue_fake_response(client, type);
+		return queue_fake_response(client, type, ps);
 	}
 
-	request = slab_alloc(outstanding_request_cache);
+	request = push_outstanding_request(server);
 	if (request == NULL)
 		return false;
 	request->type = type;
 	request->action = action;
-	statlist_append(&server->outstanding_requests, &request->node);
-	slog_noise(client, "add_outstanding_request: added %c, still outstanding %d",
-		   type, statlist_count(&client->link->outstanding_requests));
+	if (ps) {
+		request->describe_ps = ps;
+		acquire_prepared_statement(ps);
+	}
+	slog_noise(client, "add_outstanding_request: added %c, still outstanding %u",
+		   type, outstanding_request_count(server));
 	return true;
 }
 
+/*
+ * Adds a request to the outstanding requests queue, and schedule the given
+ * action (see comments on ResponseAction for details).
+ *
+ * returns false if the required allocations failed
+ */
+bool add_outstanding_request(PgSocket *client, char type, ResponseAction action)
+{
+	return add_request(client, type, action, NULL);
+}
+
+/*
+ * Same as add_outstanding_request for a Describe of the given statement,
+ * whose response is put into the Describe cache (RA_FORWARD) or taken from
+ * it (RA_FAKE).
+ */
+bool add_outstanding_describe_request(PgSocket *client, ResponseAction action, PgPreparedStatement *ps)
+{
+	return add_request(client, PqMsg_Describe, action, ps);
+}
+
+/* release what a request that was taken off the queue holds */
+void free_outstanding_request(OutstandingRequest *request)
+{
+	if (request->describe_ps)
+		release_prepared_statement(request->describe_ps);
+	free(request->describe_buf);
+}
+
 /*
  * If the next outstanding request is of one of the given types, pop it off the
  * queue. If it is of a different type, don't do anything.
@@ -1092,12 +1342,12 @@ bool add_outstanding_request(PgSocket *client, char type, ResponseAction action)
  */
 bool pop_outstanding_request(PgSocket *server, const char types[], bool *skip)
 {
-	OutstandingRequest *request;
-	struct List *item = statlist_first(&server->outstanding_requests);
-	if (!item)
+	OutstandingRequest *request = first_outstanding_request(server);
+	OutstandingRequest popped;
+
+	if (!request)
 		return false;
 
-	request = container_of(item, OutstandingRequest, node);
 	if (request->action == RA_FAKE) {
 		/*
 		 * This is weird, normally we should have already processed all fake
@@ -1110,15 +1360,15 @@ bool pop_outstanding_request(PgSocket *server, const char types[], bool *skip)
 	if (strchr(types, request->type) == NULL)
 		return false;
 
-	statlist_pop(&server->outstanding_requests);
+	take_outstanding_request(server, &popped);
 	if (skip)
-		*skip = request->action == RA_SKIP;
-	slog_noise(server, "pop_outstanding_request: popped %c, still outstanding %d, skip %d",
-		   request->type, statlist_count(&server->outstanding_requests), request->action == RA_SKIP);
-	if (request->server_ps != NULL) {
-		free_server_prepared_statement(request->server_ps);
+		*skip = popped.action == RA_SKIP;
+	slog_noise(server, "pop_outstanding_request: popped %c, still outstanding %u, skip %d",
+		   popped.type, outstanding_request_count(server), popped.action == RA_SKIP);
+	if (popped.server_ps != NULL) {
+		free_server_prepared_statement(popped.server_ps);
 	}
-	slab_free(outstanding_request_cache, request);
+	free_outstanding_request(&popped);
 	return true;
 }
 
@@ -1129,9 +1379,9 @@ bool pop_outstanding_request(PgSocket *server, const char types[], bool *skip)
  */
 bool clear_outstanding_requests_until(PgSocket *server, const char types[])
 {
-	struct List *item, *tmp;
-	statlist_for_each_safe(item, &server->outstanding_requests, tmp) {
-		OutstandingRequest *request = container_of(item, OutstandingRequest, node);
+	OutstandingRequest *request, cleared;
+
+	while ((request = first_outstanding_request(server)) != NULL) {
 		char type = request->type;
 		if (type == PqMsg_Parse && request->server_ps_query_id > 0) {
 			unregister_prepared_statement(server, request->server_ps_query_id);
@@ -1151,13 +1401,13 @@ bool clear_outstanding_requests_until(PgSocket *server, const char types[])
 				   request->server_ps->ps->stmt_name,
 				   HASH_COUNT(server->server_prepared_statements));
 		}
-		statlist_remove(&server->outstanding_requests, item);
-		slab_free(outstanding_request_cache, request);
+		take_outstanding_request(server, &cleared);
+		free_outstanding_request(&cleared);
 
 		if (strchr(types, type))
 			break;
 	}
-	slog_noise(server, "clear_outstanding_requests_until_sync: still outstanding %d", statlist_count(&server->outstanding_requests));
+	slog_noise(server, "clear_outstanding_requests_until_sync: still outstanding %u", outstanding_request_count(server));
 	return true;
 }
 
@@ -1217,6 +1467,9 @@ bool release_server(PgSocket *server)
 		if (server->link) {
 			server->link->copy_mode = false;
 			server->link->link = NULL;
+			route_client_home(server->link);
+			/* client_idle_timeout starts counting now */
+			client_timeout_update(server->link);
 			server->link = NULL;
 		}
 
@@ -1264,7 +1517,7 @@ bool release_server(PgSocket *server)
 		return false;
 	}
 
-	if (statlist_count(&server->outstanding_requests) > 0) {
+	if (outstanding_request_count(server) > 0) {
 		/*
 		 * We can't release the server if there are outstanding requests
 		 * that haven't been responded to yet, otherwise the server
@@ -1368,6 +1621,9 @@ void disconnect_server(PgSocket *server, bool send_term, const char *reason, ...
 	case SV_ACTIVE_CANCEL:
 	case SV_ACTIVE:
 		unlink_server(server, reason);
+		/* the peer only expects cancel requests */
+		if (server->peer_link || server->cancel_standby)
+			send_term = false;
 		break;
 	case SV_TESTED:
 	case SV_USED:
@@ -1420,11 +1676,14 @@ void disconnect_server(PgSocket *server, bool send_term, const char *reason, ...
 		server->dns_token = NULL;
 	}
 
-	free_scram_state(&server->scram_state);
+	free_login_state(server);
 
-	server->pool->db->connection_count--;
-	if (server->pool->user_credentials)
-		server->pool->user_credentials->global_user->connection_count--;
+	/* standby connections are not counted, see connect_new_server() */
+	if (!server->cancel_standby) {
+		server->pool->db->connection_count--;
+		if (server->pool->user_credentials)
+			server->pool->user_credentials->global_user->connection_count--;
+	}
 
 	change_server_state(server, SV_JUSTFREE);
 	if (!sbuf_close(&server->sbuf))
@@ -1502,7 +1761,7 @@ void disconnect_client_sqlstate(PgSocket *client, bool notify, const char *sqlst
 				 * precise and less scary.
 				 */
 				disconnect_server(server, true, "client disconnect while server was not ready");
-			} else if (statlist_count(&server->outstanding_requests) > 0) {
+			} else if (outstanding_request_count(server) > 0) {
 				server->link = NULL;
 				client->link = NULL;
 				/*
@@ -1592,7 +1851,7 @@ void disconnect_client_sqlstate(PgSocket *client, bool notify, const char *sqlst
 	}
 
 	free_header(&client->packet_cb_state.pkt);
-	free_scram_state(&client->scram_state);
+	free_login_state(client);
 	if (client->login_user_credentials && client->login_user_credentials->mock_auth) {
 		free(client->login_user_credentials);
 		client->login_user_credentials = NULL;
@@ -1781,24 +2040,34 @@ PgSocket *compare_connections_by_time(PgSocket *lhs, PgSocket *rhs)
 	return lhs->request_time < rhs->request_time ? lhs : rhs;
 }
 
-/* evict the single most idle connection from among all pools to make room in the db */
-bool evict_connection(PgDatabase *db)
+/*
+ * Oldest server of an eviction list.  Used and tested servers are only
+ * evicted if nobody is waiting for them in their pool.
+ */
+static PgSocket *oldest_evictable(struct StatList *list, bool user_list, bool check_waiting)
 {
 	struct List *item;
-	PgPool *pool;
-	PgSocket *oldest_connection = NULL;
+	PgSocket *server;
 
-	statlist_for_each(item, &pool_list) {
-		pool = container_of(item, PgPool, head);
-		if (pool->db != db)
-			continue;
-		oldest_connection = compare_connections_by_time(oldest_connection, last_socket(&pool->idle_server_list));
-		/* only evict testing connections if nobody's waiting */
-		if (statlist_empty(&pool->waiting_client_list)) {
-			oldest_connection = compare_connections_by_time(oldest_connection, last_socket(&pool->used_server_list));
-			oldest_connection = compare_connections_by_time(oldest_connection, last_socket(&pool->tested_server_list));
-		}
+	statlist_for_each(item, list) {
+		if (user_list)
+			server = container_of(item, PgSocket, evict_user_head);
+		else
+			server = container_of(item, PgSocket, evict_db_head);
+		if (!check_waiting || statlist_empty(&server->pool->waiting_client_list))
+			return server;
 	}
+	return NULL;
+}
+
+/* evict the single most idle connection from among all pools to make room in the db */
+bool evict_connection(PgDatabase *db)
+{
+	PgSocket *oldest_connection;
+
+	oldest_connection = compare_connections_by_time(
+		oldest_evictable(&db->evict_idle_server_list, false, false),
+		oldest_evictable(&db->evict_used_server_list, false, true));
 
 	if (oldest_connection) {
 		disconnect_server(oldest_connection, true, "evicted");
@@ -1825,21 +2094,12 @@ bool evict_pool_connection(PgPool *pool)
 /* evict the single most idle connection from among all pools to make room in the user */
 bool evict_user_connection(PgCredentials *user_credentials)
 {
-	struct List *item;
-	PgPool *pool;
-	PgSocket *oldest_connection = NULL;
+	PgGlobalUser *user = user_credentials->global_user;
+	PgSocket *oldest_connection;
 
-	statlist_for_each(item, &pool_list) {
-		pool = container_of(item, PgPool, head);
-		if (pool->user_credentials != user_credentials)
-			continue;
-		oldest_connection = compare_connections_by_time(oldest_connection, last_socket(&pool->idle_server_list));
-		/* only evict testing connections if nobody's waiting */
-		if (statlist_empty(&pool->waiting_client_list)) {
-			oldest_connection = compare_connections_by_time(oldest_connection, last_socket(&pool->used_server_list));
-			oldest_connection = compare_connections_by_time(oldest_connection, last_socket(&pool->tested_server_list));
-		}
-	}
+	oldest_connection = compare_connections_by_time(
+		oldest_evictable(&user->evict_idle_server_list, true, false),
+		oldest_evictable(&user->evict_used_server_list, true, true));
 
 	if (oldest_connection) {
 		disconnect_server(oldest_connection, true, "evicted");
@@ -1848,6 +2108,61 @@ bool evict_user_connection(PgCredentials *user_credentials)
 	return false;
 }
 
+/*
+ * Whether the pool has opened cancel_rate_limit connections for cancel
+ * requests in the current second already.
+ */
+static bool cancel_rate_exceeded(PgPool *pool)
+{
+	usec_t now = get_cached_time();
+
+	if (cf_cancel_rate_limit <= 0)
+		return false;
+	if (now - pool->cancel_rate_start >= USEC) {
+		pool->cancel_rate_start = now;
+		pool->cancel_rate_count = 0;
+	}
+	return pool->cancel_rate_count >= cf_cancel_rate_limit;
+}
+
+/* the connection takes a place in the database and user limits */
+static void count_server_connection(PgSocket *server)
+{
+	server->pool->db->connection_count++;
+	if (server->pool->user_credentials)
+		server->pool->user_credentials->global_user->connection_count++;
+}
+
+/*
+ * Start connecting a new server connection, all limits have been checked.
+ * A standby connection for cancel requests is not counted until it is used.
+ */
+static void connect_new_server(PgPool *pool, bool cancel_standby)
+{
+	PgSocket *server;
+
+	/* get free conn object */
+	server = slab_alloc(server_cache);
+	if (!server) {
+		log_debug("launch_new_connection: no memory");
+		return;
+	}
+
+	/* initialize it */
+	server->pool = pool;
+	server->login_user_credentials = server->pool->user_credentials;
+	server->connect_time = get_cached_time();
+	server->cancel_standby = cancel_standby;
+	statlist_init(&server->canceling_clients, "canceling_clients");
+	pool->last_connect_time = get_cached_time();
+	pool->last_active_time = get_cached_time();
+	change_server_state(server, SV_LOGIN);
+	if (!cancel_standby)
+		count_server_connection(server);
+
+	dns_connect(server);
+}
+
 /*
  * Launches a new connection if possible.
  *
@@ -1859,7 +2174,7 @@ bool evict_user_connection(PgCredentials *user_credentials)
  */
 void launch_new_connection(PgPool *pool, bool evict_if_needed)
 {
-	PgSocket *server;
+	bool for_cancel = !statlist_empty(&pool->waiting_cancel_req_list);
 	int max;
 
 	log_debug("launch_new_connection: start");
@@ -1887,6 +2202,16 @@ void launch_new_connection(PgPool *pool, bool evict_if_needed)
 		}
 	}
 
+	/*
+	 * A new connection is used for waiting cancel requests first (see
+	 * handle_connect), so it counts against cancel_rate_limit.  Requests
+	 * over the limit stay queued until the next second.
+	 */
+	if (for_cancel && cancel_rate_exceeded(pool)) {
+		log_debug("launch_new_connection: cancel_rate_limit reached");
+		return;
+	}
+
 	max = pool_server_count(pool);
 
 	/*
@@ -1910,7 +2235,7 @@ void launch_new_connection(PgPool *pool, bool evict_if_needed)
 	 * this works just fine, because we only ever open a single connection at
 	 * once (see top of this function).
 	 */
-	if (!statlist_empty(&pool->waiting_cancel_req_list) && max < (2 * pool_pool_size(pool))) {
+	if (for_cancel && max < (2 * pool_pool_size(pool))) {
 		log_debug("launch_new_connection: bypass pool limitations for cancel request");
 		goto force_new;
 	}
@@ -1976,26 +2301,50 @@ allow_new:
 	}
 
 force_new:
-	/* get free conn object */
-	server = slab_alloc(server_cache);
-	if (!server) {
-		log_debug("launch_new_connection: no memory");
-		return;
+	if (for_cancel)
+		pool->cancel_rate_count++;
+	connect_new_server(pool, false);
+}
+
+/* whether a standby connection is still connecting */
+static bool cancel_standby_connecting(PgPool *pool)
+{
+	struct List *item;
+	PgSocket *server;
+
+	statlist_for_each(item, &pool->cancel_standby_server_list) {
+		server = container_of(item, PgSocket, head);
+		if (server->state == SV_LOGIN)
+			return true;
 	}
+	return false;
+}
 
-	/* initialize it */
-	server->pool = pool;
-	server->login_user_credentials = server->pool->user_credentials;
-	server->connect_time = get_cached_time();
-	statlist_init(&server->canceling_clients, "canceling_clients");
-	pool->last_connect_time = get_cached_time();
-	pool->last_active_time = get_cached_time();
-	change_server_state(server, SV_LOGIN);
-	pool->db->connection_count++;
-	if (pool->user_credentials)
-		pool->user_credentials->global_user->connection_count++;
+/*
+ * Open another connection to be kept ready for cancel requests, if the
+ * pool has less than cancel_pool_size of them.  They are kept apart from
+ * the pool, so they never take the place of a server connection in
+ * pool_size or in the database and user limits.
+ */
+void launch_cancel_standby(PgPool *pool)
+{
+	if (cf_cancel_pool_size <= 0 || pool->db->admin || pool->db->peer_id)
+		return;
 
-	dns_connect(server);
+	/* one connection attempt at a time */
+	if (cancel_standby_connecting(pool))
+		return;
+	if (pool->last_connect_failed)
+		return;
+	if (statlist_count(&pool->cancel_standby_server_list) >= cf_cancel_pool_size)
+		return;
+
+	if (cancel_rate_exceeded(pool))
+		return;
+	pool->cancel_rate_count++;
+
+	log_debug("launch_cancel_standby: connecting");
+	connect_new_server(pool, true);
 }
 
 /* new client connection attempt */
@@ -2052,10 +2401,17 @@ bool finish_client_login(PgSocket *client)
 		return false;
 	}
 
+	free_login_state(client);
+
 	switch (client->state) {
 	case CL_LOGIN:
 		change_client_state(client, CL_ACTIVE);
 		client->pool->stats.client_login_count++;
+		if (client->sbuf.tls) {
+			client->pool->stats.client_tls_login_count++;
+			if (sbuf_tls_resumed(&client->sbuf))
+				client->pool->stats.client_tls_resumed_count++;
+		}
 	case CL_ACTIVE:
 		break;
 	default:
@@ -2086,6 +2442,140 @@ bool finish_client_login(PgSocket *client)
 	return true;
 }
 
+/* find a connection that is kept ready for cancel requests */
+static PgSocket *find_cancel_standby(PgPool *pool)
+{
+	struct List *item;
+	PgSocket *server;
+
+	statlist_for_each(item, &pool->cancel_standby_server_list) {
+		server = container_of(item, PgSocket, head);
+		if (server->state == SV_ACTIVE_CANCEL)
+			return server;
+	}
+	return NULL;
+}
+
+/*
+ * A standby connection is used for a cancel request, from now on it is
+ * an ordinary cancel connection.
+ */
+static void claim_cancel_standby(PgSocket *server)
+{
+	PgPool *pool = server->pool;
+
+	statlist_remove(&pool->cancel_standby_server_list, &server->head);
+	server->cancel_standby = false;
+	statlist_append(&pool->active_cancel_server_list, &server->head);
+	count_server_connection(server);
+}
+
+/* whether a cancel request for the server is waiting to be forwarded */
+static bool cancel_request_queued(PgSocket *server)
+{
+	struct List *item;
+	PgSocket *req;
+
+	statlist_for_each(item, &server->canceling_clients) {
+		req = container_of(item, PgSocket, cancel_head);
+		if (req->state == CL_WAITING_CANCEL)
+			return true;
+	}
+	return false;
+}
+
+/* find the open link to a peer pool, see peer_link */
+static PgSocket *find_peer_link(PgPool *pool)
+{
+	struct List *item;
+	PgSocket *server;
+
+	statlist_for_each(item, &pool->active_cancel_server_list) {
+		server = container_of(item, PgSocket, head);
+		if (server->peer_link)
+			return server;
+	}
+	return NULL;
+}
+
+/*
+ * Forward a cancel request as a single frame over an open peer link.  The
+ * peer does not answer, so the request is done as soon as it's sent.
+ */
+static bool send_cancel_over_peer_link(PgPool *pool, PgSocket *req)
+{
+	PgSocket *link = find_peer_link(pool);
+	bool res;
+
+	if (!link)
+		return false;
+
+	SEND_CancelRequest(res, link, req->cancel_key);
+	if (!res) {
+		disconnect_server(link, false, "sending over peer link failed");
+		return false;
+	}
+	disconnect_client(req, false, "forwarded cancel request over peer link");
+	return true;
+}
+
+/*
+ * Turn a new connection to a peer into a peer link: announce it and send all
+ * waiting cancel requests over it at once.  The connection then stays open
+ * for the requests that follow.  Returns false if the server was closed.
+ */
+static bool send_peer_link(PgSocket *server)
+{
+	PgPool *pool = server->pool;
+	struct List *item;
+	PgSocket *req;
+	PktBuf *buf;
+	bool res = false;
+
+	buf = pktbuf_dynamic(16 * (statlist_count(&pool->waiting_cancel_req_list) + 1));
+	if (buf) {
+		pktbuf_write_PeerLink(buf, cf_peer_id, cf_peer_link_secret);
+		statlist_for_each(item, &pool->waiting_cancel_req_list) {
+			req = container_of(item, PgSocket, head);
+			pktbuf_write_CancelRequest(buf, req->cancel_key);
+		}
+		res = pktbuf_send_immediate(buf, server);
+		pktbuf_free(buf);
+	}
+
+	while ((req = first_socket(&pool->waiting_cancel_req_list)) != NULL) {
+		if (res)
+			disconnect_client(req, false, "forwarded cancel request over peer link");
+		else
+			disconnect_client(req, false, "failed to send cancel request");
+	}
+
+	if (!res) {
+		disconnect_server(server, false, "opening peer link failed");
+		return false;
+	}
+
+	slog_debug(server, "opened peer link");
+	server->peer_link = true;
+	change_server_state(server, SV_ACTIVE_CANCEL);
+	return true;
+}
+
+/*
+ * Open a peer link on a connection that negotiated TLS first, because the
+ * link carries peer_link_secret.  Returns false if the server was closed.
+ */
+bool open_peer_link(PgSocket *server)
+{
+	if (statlist_empty(&server->pool->waiting_cancel_req_list)) {
+		/* notify disconnect_server() that connect did not fail */
+		server->ready = true;
+		disconnect_server(server, false, "peer server was not necessary anymore, because client cancel connection was already closed");
+		return false;
+	}
+	return send_peer_link(server);
+}
+
 static void accept_cancel_request_for_peer(int peer_id, PgSocket *req)
 {
 	PgDatabase *peer = NULL;
@@ -2123,6 +2613,9 @@ static void accept_cancel_request_for_peer(int peer_id, PgSocket *req)
 		return;
 	}
 
+	if (cf_peer_link && send_cancel_over_peer_link(pool, req))
+		return;
+
 	/*
 	 * Attach to the target pool and change state to waiting_cancel. This way
 	 * once a new connection is opened, it's used to forward the cancel
@@ -2138,6 +2631,30 @@ static void accept_cancel_request_for_peer(int peer_id, PgSocket *req)
 	launch_new_connection(pool, /* evict_if_needed= */ true);
 }
 
+/*
+ * A cancel request that arrived over a peer link.  The link stays open for
+ * the next request, so this one gets a PgSocket of its own, without a socket.
+ */
+bool accept_peer_link_cancel_request(PgSocket *link, const uint8_t *key)
+{
+	PgSocket *req;
+
+	req = slab_alloc(client_cache);
+	if (!req) {
+		log_warning("cannot allocate client struct");
+		return false;
+	}
+
+	req->connect_time = req->request_time = get_cached_time();
+	req->remote_addr = link->remote_addr;
+	req->local_addr = link->local_addr;
+	change_client_state(req, CL_LOGIN);
+
+	memcpy(req->cancel_key, key, BACKENDKEY_LEN);
+	accept_cancel_request(req);
+	return true;
+}
+
 /*
  * Accepts a cancellation request, which will eventual cancel the query running
  * on the client that matches req->client_key
@@ -2231,6 +2748,15 @@ found:
 		return;
 	}
 
+	/*
+	 * A request for the same server that is still queued cancels whatever
+	 * runs there once it is sent, so this one would not add anything.
+	 */
+	if (cancel_request_queued(server)) {
+		disconnect_client(req, false, "coalesced with queued cancel request");
+		return;
+	}
+
 	/*
 	 * Link the cancel request and the server on which the query is being
 	 * cancelled in a many-to-one way.
@@ -2244,13 +2770,29 @@ found:
 	 * request.
 	 */
 	req->pool = pool;
+	pool->last_cancel_time = get_cached_time();
 	pause_cancel_request(req);
 
-	/*
-	 * Open a new connection over which the cancel request is forwarded to the
-	 * server.
-	 */
-	launch_new_connection(pool, /* evict_if_needed= */ true);
+	start_waiting_cancel_requests(pool);
+}
+
+/*
+ * Forward the waiting cancel requests of a pool over the connections that
+ * are kept ready for them, and open a new connection for the rest.
+ */
+void start_waiting_cancel_requests(PgPool *pool)
+{
+	PgSocket *server;
+
+	while (!statlist_empty(&pool->waiting_cancel_req_list)) {
+		server = find_cancel_standby(pool);
+		if (!server)
+			break;
+		forward_cancel_request(server);
+	}
+
+	if (!statlist_empty(&pool->waiting_cancel_req_list))
+		launch_new_connection(pool, /* evict_if_needed= */ true);
 }
 
 void forward_cancel_request(PgSocket *server)
@@ -2258,9 +2800,24 @@ void forward_cancel_request(PgSocket *server)
 	bool res;
 	PgSocket *req = first_socket(&server->pool->waiting_cancel_req_list);
 	bool forwarding_to_peer = server->pool->db->peer_id != 0;
+	bool standby = server->cancel_standby;
 
 	Assert(req != NULL && req->state == CL_WAITING_CANCEL);
-	Assert(server->state == SV_LOGIN);
+	Assert(server->state == SV_LOGIN || (standby && server->state == SV_ACTIVE_CANCEL));
+
+	if (forwarding_to_peer && cf_peer_link && *cf_peer_link_secret) {
+		if (send_peer_link(server))
+			sbuf_continue(&server->sbuf);
+		return;
+	}
+
+	/* keep the standby connection for the next request, see below */
+	if (standby && !req->canceled_server) {
+		disconnect_client(req, false, "not sending cancel request for client that is now idle");
+		return;
+	}
+	if (standby)
+		claim_cancel_standby(server);
 
 	server->link = req;
 	req->link = server;
@@ -2294,7 +2851,9 @@ void forward_cancel_request(PgSocket *server)
 
 	change_client_state(req, CL_ACTIVE_CANCEL);
 	change_server_state(server, SV_ACTIVE_CANCEL);
-	sbuf_continue(&server->sbuf);
+	/* a standby connection is already waiting for the server to close it */
+	if (!standby)
+		sbuf_continue(&server->sbuf);
 	return;
 }
 
@@ -2522,6 +3081,7 @@ static void for_each_server_filtered(PgPool *pool, void (*func)(PgSocket *sk), b
 static void tag_dirty(PgSocket *sk)
 {
 	sk->close_needed = true;
+	server_timeout_update(sk);
 }
 
 void tag_pool_dirty(PgPool *pool)
@@ -2655,6 +3215,7 @@ void objects_cleanup(void)
 {
 	struct List *item, *tmp;
 	PgDatabase *db;
+	int i;
 
 	/* close can be postpones, just in case call twice */
 	reuse_just_freed_objects();
@@ -2710,12 +3271,16 @@ void objects_cleanup(void)
 	user_cache = NULL;
 	slab_destroy(credentials_cache);
 	credentials_cache = NULL;
-	slab_destroy(iobuf_cache);
-	iobuf_cache = NULL;
-	slab_destroy(outstanding_request_cache);
-	outstanding_request_cache = NULL;
+	for (i = 0; i < iobuf_class_count; i++) {
+		slab_destroy(iobuf_caches[i]);
+		iobuf_caches[i] = NULL;
+	}
+	iobuf_class_count = 0;
 	slab_destroy(var_list_cache);
 	var_list_cache = NULL;
 	slab_destroy(server_prepared_statement_cache);
 	server_prepared_statement_cache = NULL;
+	slab_destroy(login_state_cache);
+	login_state_cache = NULL;
+	arena_cleanup();
 }
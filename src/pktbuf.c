@@ -121,7 +121,11 @@ bool pktbuf_send_immediate(PktBuf *buf, PgSocket *sk)
 
 	if (buf->failed)
 		return false;
-	res = sbuf_op_send(&sk->sbuf, pos, amount);
+	/* must not get ahead of data that is still spooled */
+	if (sk->sbuf.spool)
+		res = spool_append(sk->sbuf.spool, pos, amount);
+	else
+		res = sbuf_op_send(&sk->sbuf, pos, amount);
 	if (res < 0) {
 		log_debug("pktbuf_send_immediate: %s", strerror(errno));
 	}
@@ -456,14 +460,15 @@ void pktbuf_write_DataRow(PktBuf *buf, const char *tupdesc, ...)
 			int blen = va_arg(ap, int);
 			if (blen >= 0) {
 				uint8_t *bval = va_arg(ap, uint8_t *);
-				size_t required = 2 + blen * 2 + 1;
-
-				if (required > sizeof(tmp))
-					fatal("byte array too long (%zu > %zu)", required, sizeof(tmp));
-				strcpy(tmp, "\\x");
-				for (int j = 0; j < blen; j++)
-					sprintf(tmp + (2 + j * 2), "%02x", bval[j]);
-				val = tmp;
+
+				/* hex-encode straight into the packet, it can be long */
+				pktbuf_put_uint32(buf, 2 + blen * 2);
+				pktbuf_put_bytes(buf, "\\x", 2);
+				for (int j = 0; j < blen; j++) {
+					snprintf(tmp, sizeof(tmp), "%02x", bval[j]);
+					pktbuf_put_bytes(buf, tmp, 2);
+				}
+				continue;
 			} else {
 				(void) va_arg(ap, uint8_t *);
 				val = NULL;
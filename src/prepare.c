@@ -10,9 +10,36 @@
 
 #include <usual/hashtab-impl.h>
 #include <usual/slab.h>
+#include <usual/hashing/xxhash.h>
 
 static uint64_t next_unique_query_id;
 
+/*
+ * Statements that no client or server refers to anymore stay in the global
+ * hash, so that preparing the same query again does not need a new copy.
+ * They are kept in LRU order and freed, oldest first, when the memory used
+ * by the whole hash goes over prepared_statement_cache_size.
+ */
+static STATLIST(unused_prepared_statements);
+static uint64_t prepared_statements_bytes;
+
+/*
+ * Cached Describe responses are only valid if they were stored in the
+ * current generation.  Bumping it invalidates all of them at once.
+ */
+static uint64_t describe_generation = 1;
+
+/*
+ * The prepared_statement_preprepare statements with the highest use_count,
+ * most used first.  A statement is re-ranked whenever its use_count
+ * changes, so new server connections don't have to scan the whole hash.
+ * One that drops out of the list only gets back in when its own count
+ * changes again, which is good enough for picking statements to prepare.
+ */
+static PgPreparedStatement **hot_statements;
+static int hot_statement_count;
+static int hot_statement_capacity;
+
 /*
  * Track allocation failures in uthash, so that we can fail more gracefully
  * than a full process crash. Instead we will just disconnect the client and
@@ -49,25 +76,105 @@ static bool uthash_alloc_failed;
 /*
  * Benchmarking showed that HASH_BER is one of the fastest hash functions for our
  * usecases
+ *
+ * That is true for the short keys of the client and server hashes.  The global
+ * hash is keyed by whole query texts though, which can be many kilobytes.  It
+ * uses xxhash instead, computed once when the Parse packet is unmarshalled, so
+ * it's only ever accessed with the *_BYHASHVALUE variants. (see
+ * test/hashbench.c)
  */
 #undef HASH_FUNCTION
 #define HASH_FUNCTION HASH_BER
 
 /*
- * Converts a PgParsePacket to a malloc-ed PgPreparedStatement. The
+ * Statements are allocated from slabs with power-of-two object sizes, so
+ * that memory of freed statements is reused by later ones of similar size.
+ * Statements larger than the biggest class are malloc-ed.
+ */
+#define PS_CLASS_MIN_SHIFT      8	/* 256 bytes */
+#define PS_CLASS_COUNT          7	/* up to 16 kB */
+
+static struct Slab *prepared_statement_slabs[PS_CLASS_COUNT];
+
+static int prepared_statement_class(size_t size)
+{
+	int cls = 0;
+
+	while (cls < PS_CLASS_COUNT && size > ((size_t)1 << (PS_CLASS_MIN_SHIFT + cls)))
+		cls++;
+	return cls;
+}
+
+static PgPreparedStatement *alloc_prepared_statement(size_t size)
+{
+	int cls = prepared_statement_class(size);
+	size_t obj_size;
+	char name[64];
+
+	if (cls == PS_CLASS_COUNT)
+		return malloc(size);
+
+	if (!prepared_statement_slabs[cls]) {
+		obj_size = (size_t)1 << (PS_CLASS_MIN_SHIFT + cls);
+		snprintf(name, sizeof(name), "prepared_statement_cache_%zu", obj_size);
+		prepared_statement_slabs[cls] = slab_create(name, obj_size, 0, NULL, USUAL_ALLOC);
+		if (!prepared_statement_slabs[cls])
+			return NULL;
+	}
+	return slab_alloc(prepared_statement_slabs[cls]);
+}
+
+static size_t prepared_statement_size(PgPreparedStatement *ps)
+{
+	return sizeof(PgPreparedStatement) + ps->query_and_parameters_len;
+}
+
+static void free_prepared_statement(PgPreparedStatement *ps)
+{
+	int cls = prepared_statement_class(prepared_statement_size(ps));
+
+	free(ps->describe_response);
+	strpool_decref(ps->describe_search_path);
+
+	if (cls == PS_CLASS_COUNT)
+		free(ps);
+	else
+		slab_free(prepared_statement_slabs[cls], ps);
+}
+
+/* assign the id and the server-side statement name derived from it */
+static void set_prepared_statement_id(PgPreparedStatement *ps, uint64_t query_id)
+{
+	ps->query_id = query_id;
+	ps->stmt_name_len = (uint8_t)snprintf(
+		ps->stmt_name,
+		sizeof ps->stmt_name,
+		PREPARED_STMT_NAME_FORMAT,
+		query_id);
+}
+
+/*
+ * Converts a PgParsePacket to a newly allocated PgPreparedStatement. The
  * PgPreparedStatement can be stored in the global prepared statement cache.
  */
 static PgPreparedStatement *create_prepared_statement(PgParsePacket *pkt)
 {
-	PgPreparedStatement *ps = malloc(
+	PgPreparedStatement *ps = alloc_prepared_statement(
 		sizeof(PgPreparedStatement)
 		+ pkt->query_and_parameters_len);
 	if (ps == NULL)
 		return NULL;
 
 	next_unique_query_id += 1;
-	ps->query_id = next_unique_query_id;
+	set_prepared_statement_id(ps, next_unique_query_id);
 	ps->use_count = 0;
+	list_init(&ps->unused_node);
+	ps->hot_index = -1;
+	ps->describe_response = NULL;
+	ps->describe_len = 0;
+	ps->describe_pool = NULL;
+	ps->describe_search_path = NULL;
+	ps->describe_generation = 0;
 	ps->query_and_parameters_len = pkt->query_and_parameters_len;
 	memcpy(ps->query_and_parameters,
 	       pkt->query_and_parameters,
@@ -75,6 +182,259 @@ static PgPreparedStatement *create_prepared_statement(PgParsePacket *pkt)
 	return ps;
 }
 
+/* free unused statements until the global hash fits into its budget */
+static void trim_prepared_statements(void)
+{
+	PgPreparedStatement *ps;
+	struct List *el;
+
+	while (prepared_statements_bytes > cf_prepared_statement_cache_size) {
+		el = statlist_pop(&unused_prepared_statements);
+		if (!el)
+			break;
+		ps = container_of(el, PgPreparedStatement, unused_node);
+		HASH_DEL(prepared_statements, ps);
+		prepared_statements_bytes -= prepared_statement_size(ps) + ps->describe_len;
+		free_prepared_statement(ps);
+	}
+}
+
+static void set_hot_statement(int i, PgPreparedStatement *ps)
+{
+	hot_statements[i] = ps;
+	ps->hot_index = i;
+}
+
+static void drop_hot_statement(void)
+{
+	hot_statement_count--;
+	hot_statements[hot_statement_count]->hot_index = -1;
+}
+
+/* follow changes of prepared_statement_preprepare */
+static bool resize_hot_statements(void)
+{
+	PgPreparedStatement **list;
+	int max = cf_prepared_statement_preprepare;
+
+	if (max < 0)
+		max = 0;
+	if (max == hot_statement_capacity)
+		return max > 0;
+
+	while (hot_statement_count > max)
+		drop_hot_statement();
+	if (max == 0) {
+		free(hot_statements);
+		hot_statements = NULL;
+	} else {
+		list = realloc(hot_statements, max * sizeof(*list));
+		if (!list)
+			return max < hot_statement_capacity;
+		hot_statements = list;
+	}
+	hot_statement_capacity = max;
+	return max > 0;
+}
+
+/* move the statement to its place after its use_count changed */
+static void rank_hot_statement(PgPreparedStatement *ps)
+{
+	PgPreparedStatement *other;
+	int i = ps->hot_index;
+
+	if (!resize_hot_statements())
+		return;
+
+	if (i < 0) {
+		if (ps->use_count == 0)
+			return;
+		if (hot_statement_count == hot_statement_capacity) {
+			if (ps->use_count <= hot_statements[hot_statement_count - 1]->use_count)
+				return;
+			drop_hot_statement();
+		}
+		i = hot_statement_count++;
+		set_hot_statement(i, ps);
+	} else if (ps->use_count == 0) {
+		/* unused, shift the rest of the list up */
+		for (; i < hot_statement_count - 1; i++)
+			set_hot_statement(i, hot_statements[i + 1]);
+		hot_statement_count--;
+		ps->hot_index = -1;
+		return;
+	}
+
+	while (i > 0 && hot_statements[i - 1]->use_count < ps->use_count) {
+		other = hot_statements[i - 1];
+		set_hot_statement(i, other);
+		set_hot_statement(--i, ps);
+	}
+	while (i < hot_statement_count - 1 && hot_statements[i + 1]->use_count > ps->use_count) {
+		other = hot_statements[i + 1];
+		set_hot_statement(i, other);
+		set_hot_statement(++i, ps);
+	}
+}
+
+void acquire_prepared_statement(PgPreparedStatement *ps)
+{
+	if (ps->use_count++ == 0 && !list_empty(&ps->unused_node))
+		statlist_remove(&unused_prepared_statements, &ps->unused_node);
+	rank_hot_statement(ps);
+}
+
+/* drop a reference, the statement becomes reclaimable when it was the last */
+void release_prepared_statement(PgPreparedStatement *ps)
+{
+	--ps->use_count;
+	rank_hot_statement(ps);
+	if (ps->use_count > 0)
+		return;
+	statlist_append(&unused_prepared_statements, &ps->unused_node);
+	trim_prepared_statements();
+}
+
+void prepared_statement_mem_stats(unsigned *used_p, unsigned *unused_p, uint64_t *bytes_p)
+{
+	unsigned unused = statlist_count(&unused_prepared_statements);
+
+	*used_p = HASH_COUNT(prepared_statements) - unused;
+	*unused_p = unused;
+	*bytes_p = prepared_statements_bytes;
+}
+
+/*
+ * The response to a Describe of a statement depends on its query, its
+ * parameter types, the schema and the search_path the names are resolved
+ * with.  So once a server has answered it, later Describes of the same
+ * statement in the same pool are answered from a copy of that response, as
+ * long as the client has the same search_path.  The search_path is only
+ * known if it is listed in track_extra_parameters, otherwise clients are
+ * expected not to change it.
+ */
+static bool describe_response_valid(PgPreparedStatement *ps, PgSocket *client)
+{
+	return ps->describe_response != NULL
+	       && ps->describe_pool == client->pool
+	       && ps->describe_search_path == varcache_get_pstr(&client->vars, "search_path")
+	       && ps->describe_generation == describe_generation;
+}
+
+static void store_describe_response(PgPreparedStatement *ps, PgSocket *server, uint8_t *buf, unsigned len)
+{
+	struct PStr *search_path = varcache_get_pstr(&server->vars, "search_path");
+
+	prepared_statements_bytes -= ps->describe_len;
+	free(ps->describe_response);
+	ps->describe_response = buf;
+	ps->describe_len = len;
+	ps->describe_pool = server->pool;
+	strpool_incref(search_path);
+	strpool_decref(ps->describe_search_path);
+	ps->describe_search_path = search_path;
+	ps->describe_generation = describe_generation;
+	prepared_statements_bytes += len;
+}
+
+void invalidate_describe_cache(void)
+{
+	describe_generation++;
+}
+
+/* stop collecting the response, it won't be cached */
+static void abandon_describe_capture(OutstandingRequest *request)
+{
+	release_prepared_statement(request->describe_ps);
+	request->describe_ps = NULL;
+	free(request->describe_buf);
+	request->describe_buf = NULL;
+	request->describe_len = 0;
+}
+
+/*
+ * Collect the response packets of a Describe that should be cached, and
+ * cache them once the last one arrived.  Returns false if the rest of the
+ * packet needs to be waited for.
+ */
+bool capture_describe_response(PgSocket *server, PktHdr *pkt)
+{
+	OutstandingRequest *request = first_outstanding_request(server);
+	uint8_t *buf;
+	unsigned len;
+
+	if (!request)
+		return true;
+	if (request->type != PqMsg_Describe || request->action != RA_FORWARD || !request->describe_ps)
+		return true;
+
+	if (incomplete_pkt(pkt)) {
+		if (pkt->len <= (unsigned)cf_sbuf_len)
+			return false;
+		abandon_describe_capture(request);
+		return true;
+	}
+
+	/* ParameterDescription must come first, and only once */
+	if ((pkt->type == PqMsg_ParameterDescription) != (request->describe_buf == NULL)) {
+		abandon_describe_capture(request);
+		return true;
+	}
+
+	len = request->describe_len + pkt->len;
+	buf = realloc(request->describe_buf, len);
+	if (!buf) {
+		abandon_describe_capture(request);
+		return true;
+	}
+	memcpy(buf + request->describe_len, pkt->data.data, pkt->len);
+	request->describe_buf = buf;
+	request->describe_len = len;
+
+	if (pkt->type != PqMsg_ParameterDescription) {
+		slog_noise(server, "caching Describe response of %s, %u bytes",
+			   request->describe_ps->stmt_name, len);
+		store_describe_response(request->describe_ps, server, buf, len);
+		request->describe_buf = NULL;
+		request->describe_len = 0;
+	}
+	return true;
+}
+
+bool queue_cached_describe_response(PgSocket *client, PgSocket *server, PgPreparedStatement *ps)
+{
+	PktBuf buf;
+
+	if (!ps || !ps->describe_response)
+		return false;
+	pktbuf_static(&buf, ps->describe_response, ps->describe_len);
+	buf.write_pos = ps->describe_len;
+	return sbuf_queue_packet(&server->sbuf, &client->sbuf, &buf);
+}
+
+/*
+ * "cached plan must not change result type" means the schema changed under
+ * a prepared statement, so cached Describe responses might be wrong too.
+ * Its SQLSTATE 0A000 is shared with every other "not supported" error, so
+ * the message has to match as well, which misses translated messages.  It
+ * is rare enough that dropping the whole cache on it does not matter.
+ */
+void check_describe_cache_error(PktHdr *pkt)
+{
+	PktHdr tmp;
+	const char *level, *msg, *sqlstate;
+
+	if (!cf_prepared_statement_describe_cache || incomplete_pkt(pkt))
+		return;
+
+	tmp = *pkt;
+	parse_server_error(&tmp, &level, &msg, &sqlstate);
+	if (sqlstate && strcmp(sqlstate, "0A000") == 0
+	    && msg && strcmp(msg, "cached plan must not change result type") == 0) {
+		log_debug("describe cache invalidated: %s", msg ? msg : "");
+		invalidate_describe_cache();
+	}
+}
 
 /*
  * Creates a PgClientPreparedStatement from a PgPreparedStatement. The
@@ -91,7 +451,7 @@ static PgClientPreparedStatement *create_client_prepared_statement(char const *n
 
 	memcpy(client_ps->stmt_name, name, name_len);
 	client_ps->ps = ps;
-	ps->use_count += 1;
+	acquire_prepared_statement(ps);
 	return client_ps;
 }
 
@@ -108,7 +468,7 @@ static PgServerPreparedStatement *create_server_prepared_statement(PgPreparedSta
 
 	server_ps->ps = ps;
 	server_ps->query_id = ps->query_id;
-	ps->use_count += 1;
+	acquire_prepared_statement(ps);
 	return server_ps;
 }
 
@@ -119,11 +479,12 @@ static PgServerPreparedStatement *create_server_prepared_statement(PgPreparedSta
 static PgPreparedStatement *get_prepared_statement(PgParsePacket *pkt, bool *found)
 {
 	PgPreparedStatement *ps = NULL;
-	HASH_FIND(hh,
-		  prepared_statements,
-		  pkt->query_and_parameters,
-		  pkt->query_and_parameters_len,
-		  ps);
+	HASH_FIND_BYHASHVALUE(hh,
+			      prepared_statements,
+			      pkt->query_and_parameters,
+			      pkt->query_and_parameters_len,
+			      pkt->query_hash,
+			      ps);
 	if (ps != NULL) {
 		*found = true;
 		return ps;
@@ -133,21 +494,19 @@ static PgPreparedStatement *get_prepared_statement(PgParsePacket *pkt, bool *fou
 	if (ps == NULL)
 		return NULL;
 
-	HASH_ADD(hh,
-		 prepared_statements,
-		 query_and_parameters,
-		 ps->query_and_parameters_len,
-		 ps);
+	HASH_ADD_KEYPTR_BYHASHVALUE(hh,
+				    prepared_statements,
+				    ps->query_and_parameters,
+				    ps->query_and_parameters_len,
+				    pkt->query_hash,
+				    ps);
 	if (uthash_alloc_failed) {
 		uthash_alloc_failed = false;
-		free(ps);
+		free_prepared_statement(ps);
 		return NULL;
 	}
-	ps->stmt_name_len = (uint8_t)snprintf(
-		ps->stmt_name,
-		sizeof ps->stmt_name,
-		PREPARED_STMT_NAME_FORMAT,
-		ps->query_id);
+	prepared_statements_bytes += prepared_statement_size(ps);
+	trim_prepared_statements();
 	*found = false;
 
 	return ps;
@@ -185,10 +544,7 @@ void free_server_prepared_statement(PgServerPreparedStatement *server_ps)
 {
 	if (server_ps == NULL)
 		return;
-	if (--server_ps->ps->use_count == 0) {
-		HASH_DEL(prepared_statements, server_ps->ps);
-		free(server_ps->ps);
-	}
+	release_prepared_statement(server_ps->ps);
 	slab_free(server_prepared_statement_cache, server_ps);
 }
 
@@ -230,7 +586,6 @@ static bool register_prepared_statement(PgSocket *client, PgSocket *server, PgSe
 {
 	struct PgServerPreparedStatement *current, *tmp;
 	OutstandingRequest *outstanding_request;
-	struct List *el;
 	int res;
 
 	Assert(server_ps);
@@ -239,9 +594,8 @@ static bool register_prepared_statement(PgSocket *client, PgSocket *server, PgSe
 	 * Now we need to link the outstanding request to the server_ps, so
 	 * that it can be unregistered if the request fails.
 	 */
-	el = statlist_last(&server->outstanding_requests);
-	Assert(el);
-	outstanding_request = container_of(el, OutstandingRequest, node);
+	outstanding_request = last_outstanding_request(server);
+	Assert(outstanding_request);
 	Assert(outstanding_request->type == PqMsg_Parse);
 	Assert(outstanding_request->server_ps_query_id == 0);
 	outstanding_request->server_ps_query_id = server_ps->ps->query_id;
@@ -271,9 +625,8 @@ static bool register_prepared_statement(PgSocket *client, PgSocket *server, PgSe
 		if (!add_outstanding_request(client, PqMsg_Close, RA_SKIP)) {
 			return false;
 		}
-		el = statlist_last(&server->outstanding_requests);
-		Assert(el);
-		outstanding_request = container_of(el, OutstandingRequest, node);
+		outstanding_request = last_outstanding_request(server);
+		Assert(outstanding_request);
 		outstanding_request->server_ps = current;
 
 		/*
@@ -628,6 +981,16 @@ bool handle_describe_command(PgSocket *client, PktHdr *pkt)
 		return false;
 	ps = client_ps->ps;
 
+	if (cf_prepared_statement_describe_cache && describe_response_valid(ps, client)) {
+		slog_debug(client, "handle_describe_command: answering statement '%s' (query '%s') from cache",
+			   dp.name, ps->query_and_parameters);
+		skip_possibly_completely_buffered_packet(client, pkt);
+		if (!add_outstanding_describe_request(client, RA_FAKE, ps))
+			goto oom;
+		client->pool->stats.ps_describe_cache_hit_count++;
+		return true;
+	}
+
 	if (!ensure_statement_is_prepared_on_server(server, ps))
 		goto oom;
 
@@ -638,7 +1001,8 @@ bool handle_describe_command(PgSocket *client, PktHdr *pkt)
 	 * Track the Describe command that we send to server and forward the
 	 * response to the client, because they expect one.
 	 */
-	if (!add_outstanding_request(client, PqMsg_Describe, RA_FORWARD))
+	if (!add_outstanding_describe_request(client, RA_FORWARD,
+					      cf_prepared_statement_describe_cache ? ps : NULL))
 		goto oom;
 
 	skip_possibly_completely_buffered_packet(client, pkt);
@@ -671,16 +1035,13 @@ bool handle_close_statement_command(PgSocket *client, PktHdr *pkt, PgClosePacket
 	if (client_ps) {
 		slog_noise(client, "handle_close_command: removed '%s' from cached prepared statements, items remaining %u", close_packet->name, HASH_COUNT(client->client_prepared_statements));
 		HASH_DEL(client->client_prepared_statements, client_ps);
-		if (--client_ps->ps->use_count == 0) {
-			HASH_DEL(prepared_statements, client_ps->ps);
-			free(client_ps->ps);
-		}
+		release_prepared_statement(client_ps->ps);
 		free(client_ps);
 	}
 	/* Do not forward packet to server */
 	skip_possibly_completely_buffered_packet(client, pkt);
 
-	if (!client->link || statlist_count(&client->link->outstanding_requests) == 0) {
+	if (!client->link || outstanding_request_count(client->link) == 0) {
 		slog_debug(client, "handle_close_statement_command: no outstanding requests so instantly answering client");
 		SEND_CloseComplete(res, client);
 		return res;
@@ -701,10 +1062,7 @@ void free_client_prepared_statements(PgSocket *client)
 
 	HASH_ITER(hh, client->client_prepared_statements, client_ps, tmp) {
 		HASH_DEL(client->client_prepared_statements, client_ps);
-		if (--client_ps->ps->use_count == 0) {
-			HASH_DEL(prepared_statements, client_ps->ps);
-			free(client_ps->ps);
-		}
+		release_prepared_statement(client_ps->ps);
 		free(client_ps);
 	}
 
@@ -727,3 +1085,217 @@ void free_server_prepared_statements(PgSocket *server)
 	free(server->server_prepared_statements);
 	server->server_prepared_statements = NULL;
 }
+
+/*
+ * Prepare the most used statements on a server that just logged in, so
+ * the first clients that get it don't have to wait for the Parse.  All of
+ * them are sent at once, followed by a Sync.
+ *
+ * Returns the number of statements sent, or -1 on failure.
+ */
+int prepare_hot_statements(PgSocket *server)
+{
+	PgPreparedStatement *ps;
+	PgServerPreparedStatement *server_ps;
+	PktBuf *buf = NULL;
+	int count, i;
+
+	if (!resize_hot_statements() || !is_prepared_statements_enabled(server)
+	    || server->replication || server->pool->db->admin)
+		return 0;
+
+	count = hot_statement_count;
+	if (count > cf_max_prepared_statements)
+		count = cf_max_prepared_statements;
+	if (count == 0)
+		return 0;
+
+	buf = pktbuf_dynamic(512);
+	if (!buf)
+		return -1;
+	for (i = 0; i < count; i++) {
+		/* all of them gain a reference, so their order stays the same */
+		ps = hot_statements[i];
+		server_ps = create_server_prepared_statement(ps);
+		if (!server_ps)
+			goto failed;
+		if (!add_prepared_statement(server, server_ps)) {
+			free_server_prepared_statement(server_ps);
+			goto failed;
+		}
+		pktbuf_write_Parse(buf, ps->stmt_name, ps->query_and_parameters,
+				   ps->query_and_parameters_len);
+	}
+	pktbuf_write_generic(buf, PqMsg_Sync, "");
+	if (buf->failed)
+		goto failed;
+
+	slog_debug(server, "preparing %d hot statements", count);
+	server->pool->stats.ps_server_parse_count += count;
+	server->preparing_hot_statements = true;
+	server->hot_statements_prepared = 0;
+	if (!pktbuf_send_queued(buf, server))
+		return -1;
+	return count;
+
+failed:
+	pktbuf_free(buf);
+	return -1;
+}
+
+void hot_statement_prepared(PgSocket *server)
+{
+	server->hot_statements_prepared++;
+}
+
+/*
+ * One of the Parses failed and the server skipped the rest of them.  They
+ * were added to the cache in the order they were sent, so everything
+ * after the ones that completed has to be forgotten again.
+ */
+void hot_statements_failed(PgSocket *server, PktHdr *pkt)
+{
+	PgServerPreparedStatement *current, *tmp;
+	int i = 0;
+
+	log_server_error("S: preparing hot statement failed", pkt);
+	HASH_ITER(hh, server->server_prepared_statements, current, tmp) {
+		if (i++ < server->hot_statements_prepared)
+			continue;
+		HASH_DEL(server->server_prepared_statements, current);
+		free_server_prepared_statement(current);
+	}
+}
+
+/*
+ * Rows for SHOW PREPARED_STATEMENTS, which hands the prepared statements
+ * over to the new process on online restart.  The statements come first,
+ * the rows of the sockets refer to them by id.
+ */
+void write_prepared_statement_rows(PktBuf *buf)
+{
+	PgPreparedStatement *ps, *tmp;
+
+	HASH_ITER(hh, prepared_statements, ps, tmp) {
+		pktbuf_write_DataRow(buf, "siqsb", "statement", 0, ps->query_id, NULL,
+				     (int)ps->query_and_parameters_len, ps->query_and_parameters);
+	}
+}
+
+void write_socket_prepared_statement_rows(PktBuf *buf, PgSocket *sk)
+{
+	PgServerPreparedStatement *server_ps, *tmp_s;
+	PgClientPreparedStatement *client_ps, *tmp_c;
+	int fd = sbuf_socket(&sk->sbuf);
+
+	/* in LRU order, so the new process evicts the same ones */
+	HASH_ITER(hh, sk->server_prepared_statements, server_ps, tmp_s) {
+		pktbuf_write_DataRow(buf, "siqsb", "server", fd, server_ps->query_id, NULL, -1, NULL);
+	}
+	HASH_ITER(hh, sk->client_prepared_statements, client_ps, tmp_c) {
+		pktbuf_write_DataRow(buf, "siqsb", "client", fd, client_ps->ps->query_id,
+				     client_ps->stmt_name, -1, NULL);
+	}
+}
+
+/*
+ * Statements received from the old process, by their id.  The entries
+ * hold a reference, so the statements survive until all sockets are
+ * loaded.
+ */
+static PgServerPreparedStatement *takeover_statements;
+
+static PgPreparedStatement *find_takeover_statement(uint64_t query_id)
+{
+	PgServerPreparedStatement *entry;
+
+	HASH_FIND_UINT64(takeover_statements, &query_id, entry);
+	return entry ? entry->ps : NULL;
+}
+
+/*
+ * Add a statement of the old process to the global hash.  It keeps its id,
+ * because that is the name it is prepared under on the servers.
+ */
+bool takeover_load_prepared_statement(uint64_t query_id, const uint8_t *data, int len)
+{
+	PgParsePacket pkt;
+	PgPreparedStatement *ps;
+	PgServerPreparedStatement *entry;
+	bool found;
+
+	if (find_takeover_statement(query_id))
+		return false;
+
+	memset(&pkt, 0, sizeof(pkt));
+	pkt.query_and_parameters = (const char *)data;
+	pkt.query_and_parameters_len = len;
+	pkt.query_hash = xxhash(data, len, 0);
+	ps = get_prepared_statement(&pkt, &found);
+	if (!ps || found)
+		return false;
+	set_prepared_statement_id(ps, query_id);
+	if (query_id > next_unique_query_id)
+		next_unique_query_id = query_id;
+
+	entry = create_server_prepared_statement(ps);
+	if (!entry)
+		return false;
+	HASH_ADD_UINT64(takeover_statements, query_id, entry);
+	if (uthash_alloc_failed) {
+		uthash_alloc_failed = false;
+		free_server_prepared_statement(entry);
+		return false;
+	}
+	return true;
+}
+
+bool takeover_load_server_prepared_statement(PgSocket *server, uint64_t query_id)
+{
+	PgPreparedStatement *ps = find_takeover_statement(query_id);
+	PgServerPreparedStatement *server_ps;
+
+	if (!ps)
+		return false;
+	server_ps = create_server_prepared_statement(ps);
+	if (!server_ps)
+		return false;
+	if (!add_prepared_statement(server, server_ps)) {
+		free_server_prepared_statement(server_ps);
+		return false;
+	}
+	return true;
+}
+
+bool takeover_load_client_prepared_statement(PgSocket *client, const char *name, uint64_t query_id)
+{
+	PgPreparedStatement *ps = find_takeover_statement(query_id);
+	PgClientPreparedStatement *client_ps;
+
+	if (!ps)
+		return false;
+	client_ps = create_client_prepared_statement(name, ps);
+	if (!client_ps)
+		return false;
+	HASH_ADD_STR(client->client_prepared_statements, stmt_name, client_ps);
+	if (uthash_alloc_failed) {
+		uthash_alloc_failed = false;
+		release_prepared_statement(ps);
+		free(client_ps);
+		return false;
+	}
+	return true;
+}
+
+/* all sockets are loaded, statements nobody uses go to the LRU */
+void takeover_prepared_statements_done(void)
+{
+	PgServerPreparedStatement *entry, *tmp;
+
+	HASH_ITER(hh, takeover_statements, entry, tmp) {
+		HASH_DEL(takeover_statements, entry);
+		free_server_prepared_statement(entry);
+	}
+	free(takeover_statements);
+	takeover_statements = NULL;
+}
@@ -0,0 +1,389 @@
+/*
+ * PgBouncer - Lightweight connection pooler for PostgreSQL.
+ *
+ * Copyright (c) 2007-2009  Marko Kreen, Skype Technologies OÜ
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Time-of-day load profiles for predictive pre-warming of pools.
+ *
+ * At every stats_period the average number of busy servers of a pool is
+ * derived from its PgStats (transaction time plus time clients spent
+ * waiting, divided by the length of the period) and folded into the slot
+ * of the current time of day.  The janitor then keeps at least as many
+ * servers open as the profile predicts for the next
+ * predictive_prewarm_lead, so that recurring ramps find warm connections.
+ *
+ * Profiles survive restarts through predictive_prewarm_state_file.  Pools
+ * are created lazily, so profiles read from the file (or belonging to pools
+ * that were reaped) are parked in a pending list until their pool exists.
+ */
+
+#include "bouncer.h"
+
+#include <usual/string.h>
+
+#define PREWARM_FILE_HEADER "# pgbouncer load profile v1"
+
+/* profiles change slowly, no point in writing them more often */
+#define PREWARM_SAVE_INTERVAL (LOAD_PROFILE_SLOT_MINUTES * 60 * USEC)
+
+struct PendingProfile {
+	struct List head;
+	char dbname[MAX_DBNAME];
+	char username[MAX_USERNAME];
+	uint16_t load_profile[LOAD_PROFILE_SLOTS];
+};
+
+/* profiles that are not attached to a pool */
+static LIST(pending_profiles);
+
+/* some profile has changed since the file was written */
+static bool profiles_dirty;
+static usec_t last_save_time;
+
+/* time of day slot of the given timestamp, in local time */
+static int load_profile_slot(usec_t t)
+{
+	time_t sec = t / USEC;
+	struct tm tm;
+
+	if (!localtime_r(&sec, &tm))
+		return 0;
+	return (tm.tm_hour * 60 + tm.tm_min) / LOAD_PROFILE_SLOT_MINUTES;
+}
+
+static bool profile_is_empty(const uint16_t *profile)
+{
+	int i;
+
+	for (i = 0; i < LOAD_PROFILE_SLOTS; i++) {
+		if (profile[i])
+			return false;
+	}
+	return true;
+}
+
+static struct PendingProfile *find_pending(const char *dbname, const char *username)
+{
+	struct List *item;
+	struct PendingProfile *pp;
+
+	list_for_each(item, &pending_profiles) {
+		pp = container_of(item, struct PendingProfile, head);
+		if (strcmp(pp->dbname, dbname) == 0 && strcmp(pp->username, username) == 0)
+			return pp;
+	}
+	return NULL;
+}
+
+static struct PendingProfile *add_pending(const char *dbname, const char *username)
+{
+	struct PendingProfile *pp = find_pending(dbname, username);
+
+	if (pp)
+		return pp;
+
+	pp = calloc(1, sizeof(*pp));
+	if (!pp)
+		return NULL;
+	list_init(&pp->head);
+	safe_strcpy(pp->dbname, dbname, sizeof(pp->dbname));
+	safe_strcpy(pp->username, username, sizeof(pp->username));
+	list_append(&pending_profiles, &pp->head);
+	return pp;
+}
+
+/* the profile of a pool, allocated when it is first needed */
+static uint16_t *pool_profile(PgPool *pool)
+{
+	if (!pool->load_profile)
+		pool->load_profile = calloc(LOAD_PROFILE_SLOTS, sizeof(*pool->load_profile));
+	return pool->load_profile;
+}
+
+/*
+ * Fold the load of the last stats period into the profile slot of the
+ * current time.  Rises are followed quickly, decays slowly, so a single
+ * quiet day does not erase a ramp that happens every morning.
+ */
+void prewarm_update_pool(PgPool *pool, usec_t period)
+{
+	PgStats *cur = &pool->newer_stats;
+	PgStats *old = &pool->older_stats;
+	uint16_t *profile;
+	uint64_t busy;
+	int64_t sample, value;
+	int slot;
+
+	if (!cf_predictive_prewarm || period == 0 || pool->db->admin)
+		return;
+	profile = pool_profile(pool);
+	if (!profile)
+		return;
+
+	busy = (cur->xact_time - old->xact_time) + (cur->wait_time - old->wait_time);
+	sample = LOAD_PROFILE_SCALE * busy / period;
+	if (sample > UINT16_MAX)
+		sample = UINT16_MAX;
+
+	slot = load_profile_slot(get_cached_time());
+	value = profile[slot];
+	if (sample > value)
+		value += (sample - value + 1) / 2;
+	else
+		value -= (value - sample + 7) / 8;
+	if (profile[slot] != value) {
+		profile[slot] = value;
+		profiles_dirty = true;
+	}
+}
+
+/*
+ * Number of servers the pool is expected to need between now and
+ * predictive_prewarm_lead from now.
+ */
+int prewarm_pool_target(PgPool *pool)
+{
+	/* slot range is the same for all pools during one maintenance run */
+	static usec_t range_time;
+	static int first_slot, last_slot;
+	usec_t now;
+	int slot;
+	int peak = 0;
+
+	if (!cf_predictive_prewarm || !pool->load_profile)
+		return 0;
+
+	now = get_cached_time();
+	if (now != range_time) {
+		first_slot = load_profile_slot(now);
+		last_slot = load_profile_slot(now + cf_predictive_prewarm_lead);
+		range_time = now;
+	}
+
+	slot = first_slot;
+	while (1) {
+		if (pool->load_profile[slot] > peak)
+			peak = pool->load_profile[slot];
+		if (slot == last_slot)
+			break;
+		slot = (slot + 1) % LOAD_PROFILE_SLOTS;
+	}
+	return (peak + LOAD_PROFILE_SCALE - 1) / LOAD_PROFILE_SCALE;
+}
+
+/* pick up a parked profile for a freshly created pool */
+void prewarm_attach_pool(PgPool *pool)
+{
+	struct PendingProfile *pp;
+
+	if (list_empty(&pending_profiles) || !pool->user_credentials)
+		return;
+
+	pp = find_pending(pool->db->name, pool->user_credentials->name);
+	if (!pp || !pool_profile(pool))
+		return;
+
+	memcpy(pool->load_profile, pp->load_profile, sizeof(pp->load_profile));
+	list_del(&pp->head);
+	free(pp);
+}
+
+/* park the profile of a pool that is going away */
+void prewarm_detach_pool(PgPool *pool)
+{
+	struct PendingProfile *pp;
+
+	if (!pool->load_profile)
+		return;
+
+	if (pool->user_credentials && !profile_is_empty(pool->load_profile)) {
+		pp = add_pending(pool->db->name, pool->user_credentials->name);
+		if (pp)
+			memcpy(pp->load_profile, pool->load_profile, sizeof(pp->load_profile));
+	}
+	free(pool->load_profile);
+	pool->load_profile = NULL;
+}
+
+static void write_profile(FILE *f, const char *dbname, const char *username,
+			  const uint16_t *profile)
+{
+	int i;
+
+	fprintf(f, "%s\t%s\t", dbname, username);
+	for (i = 0; i < LOAD_PROFILE_SLOTS; i++)
+		fprintf(f, i ? " %u" : "%u", profile[i]);
+	fputc('\n', f);
+}
+
+/*
+ * Write all profiles to predictive_prewarm_state_file, if they have
+ * changed.  Unless forced, that happens at most every
+ * PREWARM_SAVE_INTERVAL, as the write blocks the event loop.
+ */
+void prewarm_save(bool force)
+{
+	const char *fn = cf_predictive_prewarm_state_file;
+	char tmpfn[PATH_MAX];
+	struct List *item;
+	struct PendingProfile *pp;
+	PgPool *pool;
+	FILE *f;
+
+	if (!cf_predictive_prewarm || !fn || !*fn || !profiles_dirty)
+		return;
+	if (!force && get_cached_time() - last_save_time < PREWARM_SAVE_INTERVAL)
+		return;
+
+	if (snprintf(tmpfn, sizeof(tmpfn), "%s.tmp", fn) >= (int)sizeof(tmpfn)) {
+		log_warning("predictive_prewarm_state_file name too long: %s", fn);
+		return;
+	}
+
+	f = fopen(tmpfn, "w");
+	if (!f) {
+		log_warning("could not open load profile file \"%s\": %s", tmpfn, strerror(errno));
+		return;
+	}
+
+	fprintf(f, "%s\n", PREWARM_FILE_HEADER);
+	statlist_for_each(item, &pool_list) {
+		pool = container_of(item, PgPool, head);
+		if (pool->db->admin || !pool->user_credentials)
+			continue;
+		if (!pool->load_profile || profile_is_empty(pool->load_profile))
+			continue;
+		write_profile(f, pool->db->name, pool->user_credentials->name, pool->load_profile);
+	}
+	list_for_each(item, &pending_profiles) {
+		pp = container_of(item, struct PendingProfile, head);
+		write_profile(f, pp->dbname, pp->username, pp->load_profile);
+	}
+
+	/* make sure a crash cannot leave an empty file behind the rename */
+	if (fflush(f) != 0 || fsync(fileno(f)) < 0) {
+		log_warning("could not write load profile file \"%s\": %s", tmpfn, strerror(errno));
+		fclose(f);
+		unlink(tmpfn);
+		return;
+	}
+	if (ferror(f) | fclose(f)) {
+		log_warning("could not write load profile file \"%s\": %s", tmpfn, strerror(errno));
+		unlink(tmpfn);
+		return;
+	}
+	if (rename(tmpfn, fn) < 0) {
+		log_warning("could not rename load profile file \"%s\" to \"%s\": %s",
+			    tmpfn, fn, strerror(errno));
+		unlink(tmpfn);
+		return;
+	}
+	profiles_dirty = false;
+	last_save_time = get_cached_time();
+}
+
+/* parse one "dbname<TAB>username<TAB>slot slot ..." line */
+static bool parse_profile_line(char *line)
+{
+	char *dbname, *username, *p, *end;
+	uint16_t profile[LOAD_PROFILE_SLOTS];
+	struct PendingProfile *pp;
+	PgDatabase *db;
+	PgPool *pool;
+	unsigned long val;
+	int i;
+
+	dbname = line;
+	p = strchr(dbname, '\t');
+	if (!p)
+		return false;
+	*p++ = 0;
+	username = p;
+	p = strchr(username, '\t');
+	if (!p)
+		return false;
+	*p++ = 0;
+
+	for (i = 0; i < LOAD_PROFILE_SLOTS; i++) {
+		errno = 0;
+		val = strtoul(p, &end, 10);
+		if (end == p || errno || val > UINT16_MAX)
+			return false;
+		profile[i] = val;
+		p = end;
+	}
+
+	/*
+	 * Pools of forced users are created right away, so they can warm up
+	 * before the first client arrives.  Everything else waits for its pool.
+	 */
+	db = find_database(dbname);
+	if (db && db->forced_user_credentials && strcmp(db->forced_user_credentials->name, username) == 0) {
+		pool = get_pool(db, db->forced_user_credentials);
+		if (pool && pool_profile(pool)) {
+			memcpy(pool->load_profile, profile, sizeof(profile));
+			return true;
+		}
+	}
+
+	pp = add_pending(dbname, username);
+	if (!pp)
+		return false;
+	memcpy(pp->load_profile, profile, sizeof(pp->load_profile));
+	return true;
+}
+
+/* read predictive_prewarm_state_file, done once at startup */
+void prewarm_load(void)
+{
+	const char *fn = cf_predictive_prewarm_state_file;
+	char line[4096];
+	int lineno = 0;
+	FILE *f;
+
+	if (!cf_predictive_prewarm || !fn || !*fn)
+		return;
+
+	f = fopen(fn, "r");
+	if (!f) {
+		if (errno != ENOENT)
+			log_warning("could not open load profile file \"%s\": %s", fn, strerror(errno));
+		return;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+		line[strcspn(line, "\r\n")] = 0;
+		if (line[0] == '#' || line[0] == 0)
+			continue;
+		if (!parse_profile_line(line))
+			log_warning("invalid load profile at %s:%d, ignoring", fn, lineno);
+	}
+	fclose(f);
+}
+
+void prewarm_cleanup(void)
+{
+	struct List *item, *tmp;
+	struct PendingProfile *pp;
+
+	list_for_each_safe(item, &pending_profiles, tmp) {
+		pp = container_of(item, struct PendingProfile, head);
+		list_del(&pp->head);
+		free(pp);
+	}
+}
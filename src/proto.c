@@ -103,6 +103,10 @@ bool get_header(struct MBuf *data, PktHdr *pkt)
 			type = PKT_SSLREQ;
 		} else if (code == PKT_GSSENCREQ) {
 			type = PKT_GSSENCREQ;
+		} else if (code == PKT_PEER_LINK) {
+			type = PKT_PEER_LINK;
+		} else if (code == PKT_COMPRESSREQ) {
+			type = PKT_COMPRESSREQ;
 		} else if (code >= PKT_STARTUP_V3 && code < PKT_STARTUP_V3_UNSUPPORTED) {
 			type = PKT_STARTUP_V3;
 		} else if (code >= PKT_STARTUP_V3_UNSUPPORTED && code < PKT_STARTUP_V4) {
@@ -541,12 +545,17 @@ static bool login_scram_sha_256(PgSocket *server)
 		return false;
 	}
 
-	if (server->scram_state.client_nonce) {
+	if (!socket_login_state(server)) {
+		slog_error(server, "cannot do SCRAM authentication: out of memory");
+		return false;
+	}
+
+	if (server->login_state->scram_state.client_nonce) {
 		slog_error(server, "protocol error: duplicate AuthenticationSASL message from server");
 		return false;
 	}
 
-	client_first_message = build_client_first_message(&server->scram_state);
+	client_first_message = build_client_first_message(&server->login_state->scram_state);
 	if (!client_first_message)
 		return false;
 
@@ -566,12 +575,12 @@ static bool login_scram_sha_256_cont(PgSocket *server, unsigned datalen, const u
 	bool res;
 	char *client_final_message = NULL;
 
-	if (!server->scram_state.client_nonce) {
+	if (!server->login_state || !server->login_state->scram_state.client_nonce) {
 		slog_error(server, "protocol error: AuthenticationSASLContinue without prior AuthenticationSASL");
 		return false;
 	}
 
-	if (server->scram_state.server_first_message) {
+	if (server->login_state->scram_state.server_first_message) {
 		slog_error(server, "SCRAM exchange protocol error: received second AuthenticationSASLContinue");
 		return false;
 	}
@@ -613,7 +622,7 @@ static bool login_scram_sha_256_final(PgSocket *server, unsigned datalen, const
 	char ServerSignature[PG_SHA256_DIGEST_LENGTH];
 	bool match = false;
 
-	if (!server->scram_state.server_first_message) {
+	if (!server->login_state || !server->login_state->scram_state.server_first_message) {
 		slog_error(server, "protocol error: AuthenticationSASLFinal without prior AuthenticationSASLContinue");
 		return false;
 	}
@@ -723,7 +732,7 @@ bool answer_authreq(PgSocket *server, PktHdr *pkt)
 		if (!mbuf_get_bytes(&pkt->data, len, &data))
 			return false;
 		res = login_scram_sha_256_final(server, len, data);
-		free_scram_state(&server->scram_state);
+		free_login_state(server);
 		break;
 	}
 	default:
@@ -808,6 +817,13 @@ bool send_sslreq_packet(PgSocket *server)
 	return res;
 }
 
+bool send_compressreq_packet(PgSocket *server)
+{
+	int res;
+	SEND_wrap(16, pktbuf_write_CompressionRequest, res, server);
+	return res;
+}
+
 /*
  * decode DataRow packet (opposite of pktbuf_write_DataRow)
  *
@@ -0,0 +1,535 @@
+/*
+ * PgBouncer - Lightweight connection pooler for PostgreSQL.
+ *
+ * Copyright (c) 2007-2009  Marko Kreen, Skype Technologies OÜ
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Read-only transaction routing.
+ *
+ * A database with replicas= set sends read-only transactions to the
+ * pools of the listed databases, everything else stays on its own pool.
+ * The decision is made when a transaction starts, i.e. when the client
+ * has no server linked, by looking at the first statement.  Only
+ * transaction and statement pooling are routed, a session stays where
+ * it was opened.
+ *
+ * A SELECT alone does not say anything about what follows it in the same
+ * transaction.  So it only counts when everything the client has sent is
+ * at hand: a Query with nothing after it, or an extended protocol batch
+ * up to its Sync that has nothing but SELECTs in it.
+ *
+ * The classifier does not parse SQL, it only walks the words of the
+ * statement, skipping literals, quoted identifiers and comments.  If it
+ * cannot tell, the transaction goes to the primary.
+ */
+
+#include "bouncer.h"
+
+#include <usual/crypto/csrandom.h>
+
+#include "common/builtins.h"
+
+/* upper limit for replicas= entries considered per transaction */
+#define MAX_REPLICAS 16
+
+enum Access {
+	ACCESS_UNKNOWN,
+	ACCESS_READ_ONLY,
+	ACCESS_READ_WRITE,
+	ACCESS_SELECT,		/* read-only if the rest of the batch is */
+};
+
+static bool is_word_char(char c)
+{
+	return isalnum((unsigned char)c) || c == '_' || c == '$' || (c & 0x80);
+}
+
+/* skip whitespace and comments */
+static const char *skip_blank(const char *p, const char *end)
+{
+	while (p < end) {
+		if (isspace((unsigned char)*p)) {
+			p++;
+		} else if (*p == '-' && p + 1 < end && p[1] == '-') {
+			while (p < end && *p != '\n')
+				p++;
+		} else if (*p == '/' && p + 1 < end && p[1] == '*') {
+			for (p += 2; p < end; p++) {
+				if (*p == '*' && p + 1 < end && p[1] == '/') {
+					p += 2;
+					break;
+				}
+			}
+		} else {
+			break;
+		}
+	}
+	return p;
+}
+
+/* skip a '...' or "..." token, doubled quotes stay inside */
+static const char *skip_quoted(const char *p, const char *end)
+{
+	char q = *p++;
+
+	while (p < end) {
+		if (*p++ != q)
+			continue;
+		if (p < end && *p == q)
+			p++;
+		else
+			return p;
+	}
+	return NULL;
+}
+
+/* skip a $tag$...$tag$ literal, p is at the first '$' */
+static const char *skip_dollar_quoted(const char *p, const char *end)
+{
+	const char *tag = p;
+	size_t taglen;
+
+	for (p++; p < end && *p != '$'; p++) {
+		if (!is_word_char(*p))
+			return NULL;
+	}
+	if (p >= end)
+		return NULL;
+	taglen = p + 1 - tag;
+
+	for (p++; p + taglen <= end; p++) {
+		if (*p == '$' && memcmp(p, tag, taglen) == 0)
+			return p + taglen;
+	}
+	return NULL;
+}
+
+/*
+ * Find the next word of the statement.  Returns false at the end of the
+ * statement, with *p_p after the ';' if there was one, or at the end of
+ * the text.  *p_p is set to NULL if a literal is not terminated.
+ */
+static bool next_word(const char **p_p, const char *end, const char **word_p, size_t *len_p)
+{
+	const char *p = *p_p;
+
+	while (p) {
+		p = skip_blank(p, end);
+		if (p >= end)
+			break;
+
+		if (*p == ';') {
+			p++;
+			break;
+		} else if (*p == '\'' || *p == '"') {
+			p = skip_quoted(p, end);
+		} else if (*p == '$' && p + 1 < end && !isdigit((unsigned char)p[1])) {
+			p = skip_dollar_quoted(p, end);
+		} else if (is_word_char(*p)) {
+			*word_p = p;
+			while (p < end && is_word_char(*p))
+				p++;
+			*len_p = p - *word_p;
+			*p_p = p;
+			return true;
+		} else {
+			p++;
+		}
+	}
+	*p_p = p;
+	return false;
+}
+
+static bool word_is(const char *word, size_t len, const char *kw)
+{
+	return strlen(kw) == len && strncasecmp(word, kw, len) == 0;
+}
+
+/* the statement is the last one in the text */
+static bool at_end(const char *p, const char *end)
+{
+	return p && skip_blank(p, end) >= end;
+}
+
+/* BEGIN or START TRANSACTION, look at the transaction modes */
+static enum Access begin_access(const char *p, const char *end)
+{
+	enum Access access = ACCESS_UNKNOWN;
+	const char *word;
+	size_t len;
+	bool after_read = false;
+
+	while (next_word(&p, end, &word, &len)) {
+		if (after_read && word_is(word, len, "only"))
+			access = ACCESS_READ_ONLY;
+		else if (after_read && word_is(word, len, "write"))
+			access = ACCESS_READ_WRITE;
+		after_read = word_is(word, len, "read");
+	}
+
+	/* more statements after BEGIN could do anything */
+	if (access == ACCESS_READ_ONLY && !at_end(p, end))
+		return ACCESS_UNKNOWN;
+	return access;
+}
+
+/* SELECT without INTO or a locking clause */
+static enum Access select_access(const char *p, const char *end)
+{
+	const char *word;
+	size_t len;
+	bool after_for = false;
+
+	while (next_word(&p, end, &word, &len)) {
+		if (word_is(word, len, "into"))
+			return ACCESS_UNKNOWN;
+		if (after_for && (word_is(word, len, "update") || word_is(word, len, "share") ||
+				  word_is(word, len, "no") || word_is(word, len, "key")))
+			return ACCESS_UNKNOWN;
+		after_for = word_is(word, len, "for");
+	}
+	if (!at_end(p, end))
+		return ACCESS_UNKNOWN;
+	return ACCESS_SELECT;
+}
+
+static enum Access statement_access(const char *p, const char *end)
+{
+	const char *word;
+	size_t len;
+
+	if (!next_word(&p, end, &word, &len))
+		return ACCESS_UNKNOWN;
+
+	if (word_is(word, len, "begin"))
+		return begin_access(p, end);
+	if (word_is(word, len, "start")) {
+		if (next_word(&p, end, &word, &len) && word_is(word, len, "transaction"))
+			return begin_access(p, end);
+		return ACCESS_UNKNOWN;
+	}
+	if (cf_read_only_routing == READ_ONLY_ROUTING_SELECT && word_is(word, len, "select"))
+		return select_access(p, end);
+	return ACCESS_UNKNOWN;
+}
+
+/* find the query text of a Query or Parse packet */
+static bool get_query(PktHdr *pkt, const char **query_p, const char **end_p)
+{
+	const char *p = (const char *)pkt->data.data + NEW_HEADER_LEN;
+	const char *end = (const char *)pkt->data.data + mbuf_written(&pkt->data);
+
+	if (incomplete_pkt(pkt))
+		return false;
+
+	if (pkt->type == PqMsg_Parse) {
+		/* skip statement name */
+		p = memchr(p, '\0', end - p);
+		if (!p)
+			return false;
+		p++;
+	}
+
+	*query_p = p;
+	*end_p = memchr(p, '\0', end - p);
+	return *end_p != NULL;
+}
+
+/*
+ * The client has sent nothing but SELECTs with this packet: it is a Query
+ * with nothing buffered after it, or the start of an extended protocol
+ * batch whose Parse packets are all SELECTs, ending in a Sync that is the
+ * last thing buffered.  Binds must use the statement parsed just before,
+ * one prepared earlier could write.  A packet that was too large for the
+ * buffer is not looked at.
+ */
+static bool batch_is_select(PgSocket *client, PktHdr *pkt)
+{
+	IOBuf *io = client->sbuf.io;
+	const char *query, *end;
+	const char *parsed = NULL, *portal, *name;
+	struct MBuf buf;
+	PktHdr next;
+	bool synced = false;
+
+	if (!io || pkt->data.data != io->buf + io->parse_pos)
+		return false;
+	mbuf_init_fixed_reader(&buf, io->buf + io->parse_pos, iobuf_amount_parse(io));
+
+	while (mbuf_avail_for_read(&buf) > 0) {
+		/* the next batch or query could write */
+		if (synced)
+			return false;
+		if (!get_header(&buf, &next) || incomplete_pkt(&next))
+			return false;
+		switch (next.type) {
+		case PqMsg_Query:
+			if (next.data.data != pkt->data.data)
+				return false;
+			synced = true;
+			break;
+		case PqMsg_Parse:
+			if (!get_query(&next, &query, &end) || statement_access(query, end) != ACCESS_SELECT)
+				return false;
+			parsed = (const char *)next.data.data + NEW_HEADER_LEN;
+			break;
+		case PqMsg_Bind:
+			if (!mbuf_get_string(&next.data, &portal) || !mbuf_get_string(&next.data, &name))
+				return false;
+			if (!parsed || strcmp(name, parsed) != 0)
+				return false;
+			break;
+		case PqMsg_Describe:
+		case PqMsg_Execute:
+		case PqMsg_Close:
+			break;
+		case PqMsg_Sync:
+			synced = true;
+			break;
+		default:
+			return false;
+		}
+	}
+	return synced;
+}
+
+static bool client_default_read_only(PgSocket *client)
+{
+	const char *val = varcache_get(&client->vars, "default_transaction_read_only");
+	bool res;
+
+	return val && parse_bool(val, &res) && res;
+}
+
+/* average query time over the last stats period */
+static usec_t pool_latency(PgPool *pool)
+{
+	uint64_t count = pool->newer_stats.query_count - pool->older_stats.query_count;
+
+	if (count == 0)
+		return 0;
+	return (pool->newer_stats.query_time - pool->older_stats.query_time) / count;
+}
+
+static PgPool *get_replica_pool(PgSocket *client, PgDatabase *db)
+{
+	PgCredentials *credentials;
+	PgPool *pool;
+
+	if (!db || db == client->db || db->admin || db->db_dead || db->db_disabled || db->db_paused)
+		return NULL;
+
+	credentials = db->forced_user_credentials;
+	if (!credentials) {
+		/* auth_query users belong to their own database */
+		if (client->login_user_credentials->dynamic_passwd)
+			return NULL;
+		credentials = client->login_user_credentials;
+	}
+
+	pool = get_pool(db, credentials);
+	if (!pool || pool->last_connect_failed)
+		return NULL;
+	if (probably_wrong_pool_pool_mode(pool) == POOL_SESSION)
+		return NULL;
+	return pool;
+}
+
+/*
+ * Pick one of the replicas, weighted by the inverse of their query time
+ * so a slow replica gets less of the load.
+ */
+static PgPool *pick_replica(PgSocket *client)
+{
+	PgPool *pools[MAX_REPLICAS];
+	uint32_t weights[MAX_REPLICAS];
+	uint32_t total = 0, r;
+	int n = 0, i;
+
+	for (i = 0; i < client->db->replica_count; i++) {
+		pools[n] = get_replica_pool(client, client->db->replica_list[i]);
+		if (!pools[n])
+			continue;
+		weights[n] = USEC / (pool_latency(pools[n]) + 1000);
+		if (weights[n] == 0)
+			weights[n] = 1;
+		total += weights[n];
+		n++;
+	}
+
+	if (n == 0)
+		return NULL;
+
+	r = csrandom_range(total);
+	for (i = 0; i < n - 1; i++) {
+		if (r < weights[i])
+			break;
+		r -= weights[i];
+	}
+	return pools[i];
+}
+
+/* the pool the client logged in to */
+static PgPool *primary_pool(PgSocket *client)
+{
+	PgCredentials *credentials = client->db->forced_user_credentials;
+
+	return get_pool(client->db, credentials ? credentials : client->login_user_credentials);
+}
+
+/*
+ * The transaction is over, so put the client back into the pool it logged
+ * in to.  Otherwise it would be listed, paused and killed with the
+ * replica while it is idle.
+ */
+void route_client_home(PgSocket *client)
+{
+	PgPool *pool;
+
+	if (client->pool->db == client->db || client->state != CL_ACTIVE)
+		return;
+	pool = primary_pool(client);
+	if (pool) {
+		slog_debug(client, "returning to database %s", pool->db->name);
+		switch_client_pool(client, pool);
+	}
+}
+
+/*
+ * Called for every packet that may start a transaction, before a server
+ * is searched for it.
+ */
+void route_client(PgSocket *client, PktHdr *pkt)
+{
+	enum Access access = ACCESS_UNKNOWN;
+	const char *query, *end;
+	PgPool *pool = NULL;
+
+	if (!client->db->replicas || client->link || client->state != CL_ACTIVE)
+		return;
+	if (connection_pool_mode(client) == POOL_SESSION)
+		return;
+
+	if ((pkt->type == PqMsg_Query || pkt->type == PqMsg_Parse) && get_query(pkt, &query, &end))
+		access = statement_access(query, end);
+	if (access == ACCESS_SELECT)
+		access = batch_is_select(client, pkt) ? ACCESS_READ_ONLY : ACCESS_UNKNOWN;
+	if (access == ACCESS_UNKNOWN && client_default_read_only(client))
+		access = ACCESS_READ_ONLY;
+
+	if (access == ACCESS_READ_ONLY)
+		pool = pick_replica(client);
+	if (!pool) {
+		route_client_home(client);
+		return;
+	}
+
+	if (pool != client->pool) {
+		slog_debug(client, "routing transaction to database %s", pool->db->name);
+		switch_client_pool(client, pool);
+	}
+}
+
+/*
+ * Look up the databases named in replicas=.  Names that are not
+ * configured are skipped.
+ */
+void resolve_replicas(PgDatabase *db)
+{
+	PgDatabase *replica;
+	char name[MAX_DBNAME];
+	const char *p = db->replicas;
+	size_t len;
+
+	db->replica_count = 0;
+	if (!p) {
+		free(db->replica_list);
+		db->replica_list = NULL;
+		return;
+	}
+	if (!db->replica_list) {
+		db->replica_list = calloc(MAX_REPLICAS, sizeof(*db->replica_list));
+		if (!db->replica_list) {
+			log_warning("database %s: out of memory for replicas", db->name);
+			return;
+		}
+	}
+
+	while (*p) {
+		p += strspn(p, ", \t");
+		len = strcspn(p, ", \t");
+		if (len == 0)
+			break;
+		if (len >= sizeof(name)) {
+			log_warning("database %s: replica name too long", db->name);
+			p += len;
+			continue;
+		}
+		memcpy(name, p, len);
+		name[len] = '\0';
+		p += len;
+
+		replica = find_database(name);
+		if (!replica) {
+			log_warning("database %s: replica %s is not configured", db->name, name);
+		} else if (replica == db) {
+			log_warning("database %s: cannot be its own replica", db->name);
+		} else if (db->replica_count == MAX_REPLICAS) {
+			log_warning("database %s: more than %d replicas, ignoring %s", db->name, MAX_REPLICAS, name);
+		} else {
+			db->replica_list[db->replica_count++] = replica;
+		}
+	}
+}
+
+/* after the config is loaded, all databases are known */
+void resolve_all_replicas(void)
+{
+	struct List *item;
+	PgDatabase *db;
+
+	statlist_for_each(item, &database_list) {
+		db = container_of(item, PgDatabase, head);
+		if (db->replicas || db->replica_list)
+			resolve_replicas(db);
+	}
+}
+
+static void forget_replica_in(struct StatList *list, PgDatabase *replica)
+{
+	struct List *item;
+	PgDatabase *db;
+	int i;
+
+	statlist_for_each(item, list) {
+		db = container_of(item, PgDatabase, head);
+		for (i = 0; i < db->replica_count; i++) {
+			if (db->replica_list[i] != replica)
+				continue;
+			db->replica_count--;
+			memmove(&db->replica_list[i], &db->replica_list[i + 1],
+				(db->replica_count - i) * sizeof(*db->replica_list));
+			i--;
+		}
+	}
+}
+
+/* the database goes away, drop it from the replicas of the others */
+void forget_replica(PgDatabase *db)
+{
+	forget_replica_in(&database_list, db);
+	forget_replica_in(&autodatabase_idle_list, db);
+}
@@ -35,6 +35,10 @@
 #define USE_TLS
 #endif
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 /* sbuf_main_loop() skip_recv values */
 #define DO_RECV         false
 #define SKIP_RECV       true
@@ -70,7 +74,12 @@ enum WaitType {
 
 /* declare static stuff */
 static bool sbuf_queue_send(SBuf *sbuf) _MUSTCHECK;
+static ssize_t sbuf_send_or_spool(SBuf *sbuf, const void *data, unsigned len) _MUSTCHECK;
+static void sbuf_spool_cb(evutil_socket_t sock, short flags, void *arg);
+static void sbuf_free_spool(SBuf *sbuf);
 static bool sbuf_send_pending_iobuf(SBuf *sbuf) _MUSTCHECK;
+static bool sbuf_send_pending_extra_packets(SBuf *sbuf) _MUSTCHECK;
+static bool sbuf_send_pending(SBuf *sbuf) _MUSTCHECK;
 static bool sbuf_process_pending(SBuf *sbuf) _MUSTCHECK;
 static void sbuf_connect_cb(evutil_socket_t sock, short flags, void *arg);
 static void sbuf_recv_cb(evutil_socket_t sock, short flags, void *arg);
@@ -112,6 +121,22 @@ static void sbuf_tls_handshake_cb(evutil_socket_t fd, short flags, void *_sbuf);
 static void sbuf_possible_direct_tls_startup_cb(evutil_socket_t fd, short flags, void *_sbuf);
 #endif
 
+/* compressed I/O, on top of regular or TLS I/O */
+#ifdef HAVE_ZLIB
+static ssize_t compress_sbufio_peek(struct SBuf *sbuf, void *buf, size_t len);
+static ssize_t compress_sbufio_recv(struct SBuf *sbuf, void *dst, size_t len);
+static ssize_t compress_sbufio_send(struct SBuf *sbuf, const void *data, size_t len);
+static int compress_sbufio_close(struct SBuf *sbuf);
+static const SBufIO compress_sbufio_ops = {
+	compress_sbufio_peek,
+	compress_sbufio_recv,
+	compress_sbufio_send,
+	compress_sbufio_close
+};
+#endif
+
+struct SBufCompressStats sbuf_compress_stats;
+
 /*
  *********************************
  * Public functions
@@ -326,10 +351,13 @@ bool sbuf_close(SBuf *sbuf)
 	sbuf->pkt_remain = 0;
 	sbuf->pkt_action = sbuf->wait_type = 0;
 	if (sbuf->io) {
-		slab_free(iobuf_cache, sbuf->io);
+		iobuf_free(sbuf->io);
 		sbuf->io = NULL;
 	}
+	sbuf->io_class = sbuf->io_fills = sbuf->io_idle = 0;
 	mbuf_free(&sbuf->extra_packets);
+	sbuf_free_spool(sbuf);
+	sbuf->spool_allowed = false;
 	return true;
 }
 
@@ -619,19 +647,193 @@ static bool sbuf_queue_send(SBuf *sbuf)
 	return true;
 }
 
+/* start spooling data for a socket that is full */
+static bool sbuf_start_spool(SBuf *sbuf)
+{
+	struct Spool *spool;
+
+	if (!sbuf->spool_allowed || cf_result_spool_size == 0 || spool_total_room(1) == 0)
+		return false;
+
+	spool = spool_new();
+	if (!spool)
+		return false;
+
+	event_assign(&spool->ev, pgb_event_base, sbuf->sock, EV_WRITE, sbuf_spool_cb, sbuf);
+	if (event_add(&spool->ev, NULL) < 0) {
+		log_warning("sbuf_start_spool: event_add failed: %s", strerror(errno));
+		spool_free(spool);
+		return false;
+	}
+	sbuf->spool = spool;
+	log_debug("sbuf_start_spool: %p", sbuf);
+	return true;
+}
+
+static void sbuf_free_spool(SBuf *sbuf)
+{
+	if (!sbuf->spool)
+		return;
+	event_del(&sbuf->spool->ev);
+	spool_free(sbuf->spool);
+	sbuf->spool = NULL;
+}
+
 /*
- * flush all pending data in the iobuf. This should be called before calling
- * needed before calling sbuf_queue_packet.
+ * Send data from sbuf to its destination.  If the destination is full
+ * and allows it, the data goes to its spool instead, so that sbuf can
+ * move on.  Once there is a spool, all data goes through it to keep
+ * the order.  Returns like sbuf_op_send().
  */
-bool sbuf_flush(SBuf *sbuf)
+static ssize_t sbuf_send_or_spool(SBuf *sbuf, const void *data, unsigned len)
 {
-	if (sbuf->io) {
-		log_noise("sbuf_flush");
-		return sbuf_send_pending_iobuf(sbuf);
+	SBuf *dst = sbuf->dst;
+	ssize_t res;
+
+	if (!dst->spool) {
+		res = sbuf_op_send(dst, data, len);
+		if (res >= 0 || errno != EAGAIN)
+			return res;
+		if (!sbuf_start_spool(dst))
+			return res;
+	}
+
+	res = spool_append(dst->spool, data, spool_total_room(len));
+	if (res == 0) {
+		/* spool is full too, wait for the destination as usual */
+		errno = EAGAIN;
+		return -1;
+	}
+	return res;
+}
+
+/* libevent EV_WRITE: socket with spooled data is writable */
+static void sbuf_spool_cb(evutil_socket_t sock, short flags, void *arg)
+{
+	SBuf *sbuf = arg;
+	struct Spool *spool = sbuf->spool;
+	const uint8_t *data;
+	unsigned len;
+	ssize_t res;
+	bool resume;
+
+	/* sbuf was closed before in this loop */
+	if (!sbuf->sock || !spool)
+		return;
+
+	while (1) {
+		if (!spool_peek(spool, &data, &len))
+			goto failed;
+		if (len == 0)
+			break;
+
+		res = sbuf_op_send(sbuf, data, len);
+		if (res > 0) {
+			spool_consume(spool, res);
+		} else if (res < 0 && errno == EAGAIN) {
+			if (event_add(&spool->ev, NULL) < 0) {
+				log_warning("sbuf_spool_cb: event_add failed: %s", strerror(errno));
+				goto failed;
+			}
+			return;
+		} else if (res < 0) {
+			goto failed;
+		}
 	}
+
+	/* all sent, wake up reading side if it was stopped because of us */
+	resume = spool->reader_paused;
+	sbuf_free_spool(sbuf);
+	log_debug("sbuf_spool_cb: %p spool drained", sbuf);
+	if (resume)
+		sbuf_continue(sbuf);
+	return;
+
+failed:
+	sbuf_call_proto(sbuf, SBUF_EV_RECV_FAILED);
+}
+
+/*
+ * Move the parsed data in iobuf to the end of extra_packets, so that it is
+ * sent together with the packets that get queued after it.
+ */
+static bool sbuf_batch_pending_iobuf(SBuf *sbuf)
+{
+	IOBuf *io = sbuf->io;
+	unsigned avail;
+
+	if (!io)
+		return true;
+	avail = iobuf_amount_pending(io);
+	if (avail == 0)
+		return true;
+	if (!mbuf_write(&sbuf->extra_packets, io->buf + io->done_pos, avail))
+		return false;
+	io->done_pos += avail;
+	sbuf->extra_packets_batched = mbuf_written(&sbuf->extra_packets);
 	return true;
 }
 
+/*
+ * Make sure there is no pending data in the iobuf. This is needed before
+ * calling sbuf_queue_packet.
+ *
+ * Unless packets are queued after the current one, the data is not sent
+ * here but moved to extra_packets.  So a pipeline of Bind/Execute with
+ * rewritten statement names goes out with one send when the processing
+ * loop ends, instead of two sends per rewritten packet.
+ */
+bool sbuf_flush(SBuf *sbuf)
+{
+	if (!sbuf->io)
+		return true;
+	if (!sbuf->extra_packet_queue_after)
+		return sbuf_batch_pending_iobuf(sbuf);
+	log_noise("sbuf_flush");
+	return sbuf_send_pending_iobuf(sbuf);
+}
+
+/* extra_packets is fully sent, prepare it for reuse */
+static void sbuf_reset_extra_packets(SBuf *sbuf)
+{
+	struct MBuf *extra_packets = &sbuf->extra_packets;
+
+	/*
+	 * To avoid frequent allocations we try to reuse the extra_packets
+	 * MBuf. But if it has grown to more than 4 times pkt_buf, we free it
+	 * to avoid wasting memory. Otherwise one huge packet can cause a lot
+	 * of memory to stay allocated for the lifetime of the connection. The
+	 * most common case where this might occur is a huge query in a
+	 * prepared statement.
+	 *
+	 * We use 4 times pkt_buf as an arbitrary but reosanable limit.
+	 */
+	if (extra_packets->alloc_len > (unsigned) cf_sbuf_len * 4) {
+		mbuf_free(extra_packets);
+	} else {
+		mbuf_rewind_writer(extra_packets);
+	}
+	sbuf->extra_packets_batched = 0;
+}
+
+/*
+ * Send everything that is pending, in order.  Batched extra_packets come
+ * before the iobuf data, which is appended to them first so that it all
+ * goes out in one send.
+ */
+static bool sbuf_send_pending(SBuf *sbuf)
+{
+	if (mbuf_avail_for_read(&sbuf->extra_packets) > 0 && !sbuf->extra_packet_queue_after) {
+		/* on allocation failure the iobuf data just follows separately */
+		if (!sbuf_batch_pending_iobuf(sbuf))
+			log_noise("sbuf_send_pending: could not batch iobuf data");
+		if (!sbuf_send_pending_extra_packets(sbuf))
+			return false;
+		sbuf_reset_extra_packets(sbuf);
+	}
+	return sbuf_send_pending_iobuf(sbuf);
+}
+
 /*
  * There's data in buffer to be sent. Returns bool if processing can continue.
  *
@@ -661,7 +863,7 @@ try_more:
 
 	/* actually send it */
 	//res = iobuf_send_pending(io, sbuf->dst->sock);
-	res = sbuf_op_send(sbuf->dst, io->buf + io->done_pos, avail);
+	res = sbuf_send_or_spool(sbuf, io->buf + io->done_pos, avail);
 	if (res > 0) {
 		io->done_pos += res;
 	} else if (res < 0) {
@@ -714,7 +916,7 @@ try_more:
 
 	/* actually send it */
 	//res = iobuf_send_pending(io, sbuf->dst->sock);
-	res = sbuf_op_send(sbuf->dst, mbuf->data + mbuf->read_pos, avail);
+	res = sbuf_send_or_spool(sbuf, mbuf->data + mbuf->read_pos, avail);
 	if (res > 0) {
 		mbuf->read_pos += res;
 	} else if (res < 0) {
@@ -757,34 +959,31 @@ static bool sbuf_process_pending(SBuf *sbuf)
 		 * might add even more packets there, which would be bad because it
 		 * would mean they get delivered out of order.
 		 */
-		if (mbuf_avail_for_read(extra_packets)) {
-			if (sbuf->extra_packet_queue_after) {
-				if (!sbuf_send_pending_iobuf(sbuf)) {
-					log_noise("sbuf_process_pending failed to send all pending data");
-					return false;
-				}
+		if (mbuf_avail_for_read(extra_packets) && sbuf->extra_packet_queue_after) {
+			if (!sbuf_send_pending_iobuf(sbuf)) {
+				log_noise("sbuf_process_pending failed to send all pending data");
+				return false;
 			}
 
 			if (!sbuf_send_pending_extra_packets(sbuf)) {
 				log_noise("sbuf_process_pending ended early because of not being able to send the queued extra packets");
 				return false;
 			}
+			sbuf_reset_extra_packets(sbuf);
+		} else if (mbuf_avail_for_read(extra_packets)) {
 			/*
-			 * To avoid frequent allocations we try to reuse the
-			 * extra_packets MBuf. But if it has grown to more than
-			 * 4 times pkt_buf, we free it to avoid wasting memory.
-			 * Otherwise one huge packet can cause a lot of memory
-			 * to stay allocated for the lifetime of the
-			 * connection. The most common case where this might
-			 * occur is a huge query in a prepared statement.
-			 *
-			 * We use 4 times pkt_buf as an arbitrary but
-			 * reosanable limit.
+			 * Packets queued before the current one are batched
+			 * with the data that follows them, and sent when the
+			 * loop ends.  Unless the batch got large already.
 			 */
-			if (extra_packets->alloc_len > (unsigned) cf_sbuf_len * 4) {
-				mbuf_free(extra_packets);
+			if (mbuf_avail_for_read(extra_packets) >= (unsigned) cf_sbuf_len) {
+				if (!sbuf_send_pending(sbuf)) {
+					log_noise("sbuf_process_pending ended early because of not being able to send the batched packets");
+					return false;
+				}
 			} else {
-				mbuf_rewind_writer(extra_packets);
+				/* the previous packet is done, keep its output on retry */
+				sbuf->extra_packets_batched = mbuf_written(extra_packets);
 			}
 		}
 
@@ -815,10 +1014,14 @@ static bool sbuf_process_pending(SBuf *sbuf)
 		}
 
 		if (sbuf->pkt_action == ACT_SKIP || sbuf->pkt_action == ACT_CALL) {
-			/* send any pending data before skipping */
+			/* send any pending data before skipping, or batch it */
 			if (iobuf_amount_pending(io) > 0) {
-				if (!sbuf_send_pending_iobuf(sbuf))
+				if (mbuf_avail_for_read(extra_packets) > 0 && !sbuf->extra_packet_queue_after
+				    && sbuf_batch_pending_iobuf(sbuf)) {
+					/* moved to extra_packets */
+				} else if (!sbuf_send_pending(sbuf)) {
 					return false;
+				}
 			}
 		}
 
@@ -852,7 +1055,7 @@ static bool sbuf_process_pending(SBuf *sbuf)
 	}
 
 	log_noise("sbuf_process_pending: done looping");
-	if (!sbuf_send_pending_iobuf(sbuf)) {
+	if (!sbuf_send_pending(sbuf)) {
 		log_noise("sbuf_process_pending failed to send all pending data");
 		return false;
 	}
@@ -865,9 +1068,12 @@ need_more_data:
 	 * packet. We'll call the handler for this packet again after receiving
 	 * more data and then all of the extra packets that were generated this
 	 * time will be regenerated again, so clean the ones up that were
-	 * generated this time.
+	 * generated this time.  Batched data from earlier packets stays.
 	 */
-	mbuf_rewind_writer(extra_packets);
+	if (extra_packets->write_pos > sbuf->extra_packets_batched)
+		extra_packets->write_pos = sbuf->extra_packets_batched;
+	if (mbuf_avail_for_read(extra_packets) == 0)
+		sbuf_reset_extra_packets(sbuf);
 
 	if (sbuf->sock && io && sbuf->wait_type == W_RECV) {
 		/*
@@ -875,8 +1081,8 @@ need_more_data:
 		 * to send though. Let's do that now to create some extra space
 		 * in the buffer.
 		 */
-		if (iobuf_amount_pending(io) > 0) {
-			if (!sbuf_send_pending_iobuf(sbuf))
+		if (iobuf_amount_pending(io) > 0 || mbuf_avail_for_read(extra_packets) > 0) {
+			if (!sbuf_send_pending(sbuf))
 				return false;
 		}
 
@@ -885,7 +1091,7 @@ need_more_data:
 		 * still needs more data, we should force a resync to make some
 		 * space.
 		 */
-		if (io && io->recv_pos == (unsigned) cf_sbuf_len) {
+		if (io && io->recv_pos == io->size) {
 			log_noise("resync(%d): done=%u, parse=%u, recv=%u, forced",
 				  sbuf->sock,
 				  io->done_pos, io->parse_pos, io->recv_pos);
@@ -912,7 +1118,7 @@ static void sbuf_try_resync(SBuf *sbuf, bool release)
 		return;
 
 	if (release && iobuf_empty(io)) {
-		slab_free(iobuf_cache, io);
+		iobuf_free(io);
 		sbuf->io = NULL;
 	} else {
 		iobuf_try_resync(io, SBUF_SMALL_PKT);
@@ -953,7 +1159,7 @@ static void sbuf_recv_cb(evutil_socket_t sock, short flags, void *arg)
 static bool allocate_iobuf(SBuf *sbuf)
 {
 	if (sbuf->io == NULL) {
-		sbuf->io = slab_alloc(iobuf_cache);
+		sbuf->io = iobuf_alloc(sbuf->io_class);
 		if (sbuf->io == NULL) {
 			sbuf_call_proto(sbuf, SBUF_EV_RECV_FAILED);
 			return false;
@@ -963,6 +1169,57 @@ static bool allocate_iobuf(SBuf *sbuf)
 	return true;
 }
 
+/*
+ * The buffer was filled completely.  If that happens in several main
+ * loops in a row, move the data to a buffer of the next size class, so
+ * bulk transfers need fewer rounds through the loop.
+ */
+static void sbuf_grow_iobuf(SBuf *sbuf)
+{
+	IOBuf *old = sbuf->io;
+	IOBuf *io;
+	unsigned avail;
+
+	if (old->size_class + 1 >= (unsigned)iobuf_class_count)
+		return;
+	if (sbuf->io_fills < IOBUF_GROW_FILLS)
+		return;
+
+	/* on failure just keep the old buffer */
+	io = iobuf_alloc(old->size_class + 1);
+	if (!io)
+		return;
+
+	avail = old->recv_pos - old->done_pos;
+	memcpy(io->buf, old->buf + old->done_pos, avail);
+	io->parse_pos = old->parse_pos - old->done_pos;
+	io->recv_pos = avail;
+	io->done_pos = 0;
+
+	log_noise("sbuf_grow_iobuf(%d): %u -> %u bytes", sbuf->sock, old->size, io->size);
+	iobuf_free(old);
+	sbuf->io = io;
+	sbuf->io_class = io->size_class;
+	sbuf->io_fills = 0;
+}
+
+/* buffer size for the next loop, larger ones are given back when idle */
+static void sbuf_update_iobuf_class(SBuf *sbuf, bool filled)
+{
+	if (filled) {
+		if (sbuf->io_fills < UINT8_MAX)
+			sbuf->io_fills++;
+		sbuf->io_idle = 0;
+		return;
+	}
+
+	sbuf->io_fills = 0;
+	if (sbuf->io_class > 0 && ++sbuf->io_idle >= IOBUF_SHRINK_IDLE) {
+		sbuf->io_class--;
+		sbuf->io_idle = 0;
+	}
+}
+
 /*
  * Main recv-parse-send-repeat loop.
  *
@@ -976,6 +1233,7 @@ static void sbuf_main_loop(SBuf *sbuf, bool skip_recv)
 {
 	unsigned free, ok;
 	int loopcnt = 0;
+	bool filled = false;
 
 	/* sbuf was closed before in this event loop */
 	if (!sbuf->sock)
@@ -988,6 +1246,19 @@ static void sbuf_main_loop(SBuf *sbuf, bool skip_recv)
 	if (!allocate_iobuf(sbuf))
 		return;
 
+	/*
+	 * Don't take new requests while results of earlier ones are
+	 * still spooled, answers to them could get ahead otherwise.
+	 */
+	if (sbuf->spool && !skip_recv) {
+		if (!sbuf_pause(sbuf)) {
+			sbuf_call_proto(sbuf, SBUF_EV_RECV_FAILED);
+			return;
+		}
+		sbuf->spool->reader_paused = true;
+		return;
+	}
+
 	/* avoid recv() if asked */
 	if (skip_recv)
 		goto skip_recv;
@@ -1042,9 +1313,22 @@ skip_recv:
 		return;
 
 	/* if the buffer is full, there can be more data available */
-	if (iobuf_amount_recv(sbuf->io) <= 0)
+	if (iobuf_amount_recv(sbuf->io) <= 0) {
+		if (!filled) {
+			filled = true;
+			sbuf_update_iobuf_class(sbuf, true);
+		}
+		sbuf_grow_iobuf(sbuf);
+		goto try_more;
+	}
+
+	/* same if the decompressor holds data the socket won't signal */
+	if (sbuf_compress_pending(sbuf))
 		goto try_more;
 
+	if (!filled)
+		sbuf_update_iobuf_class(sbuf, false);
+
 	/* clean buffer */
 	sbuf_try_resync(sbuf, true);
 
@@ -1106,7 +1390,11 @@ bool sbuf_answer(SBuf *sbuf, const void *buf, size_t len)
 	ssize_t res;
 	if (sbuf->sock <= 0)
 		return false;
-	res = sbuf_op_send(sbuf, buf, len);
+	/* must not get ahead of data that is still spooled */
+	if (sbuf->spool)
+		res = spool_append(sbuf->spool, buf, len);
+	else
+		res = sbuf_op_send(sbuf, buf, len);
 	if (res < 0) {
 		log_debug("sbuf_answer: error sending: %s", strerror(errno));
 	} else if ((unsigned)res != len) {
@@ -1255,6 +1543,256 @@ static bool setup_tls(struct tls_config *conf, const char *pfx, int sslmode,
 	return true;
 }
 
+/*
+ * Session resumption for client connections.
+ *
+ * The session ID context and the ticket keys live here rather than in
+ * client_accept_conf, so that RELOAD does not invalidate the sessions
+ * clients hold, and so that they can be handed over on online restart.
+ * A new ticket key is added every client_tls_session_lifetime.  Tickets
+ * made with one of the previous TLS_NUM_TICKETS - 1 keys are still
+ * accepted and renewed with the new one.
+ */
+struct TicketKey {
+	uint32_t keyrev;
+	uint8_t key[TLS_TICKET_KEY_SIZE];
+};
+
+static struct TicketKey ticket_keys[TLS_NUM_TICKETS];	/* newest first */
+static int ticket_key_count;
+static usec_t ticket_key_time;		/* when ticket_keys[0] was made */
+static bool loading_ticket_keys;	/* takeover replaces the keys */
+static uint8_t session_id[TLS_MAX_SESSION_ID_LENGTH];
+static bool have_session_id;
+
+static void push_ticket_key(uint32_t keyrev, const uint8_t *key)
+{
+	memmove(&ticket_keys[1], &ticket_keys[0], sizeof(ticket_keys) - sizeof(ticket_keys[0]));
+	ticket_keys[0].keyrev = keyrev;
+	memcpy(ticket_keys[0].key, key, TLS_TICKET_KEY_SIZE);
+	if (ticket_key_count < TLS_NUM_TICKETS)
+		ticket_key_count++;
+	ticket_key_time = get_cached_time();
+}
+
+static void new_ticket_key(void)
+{
+	uint8_t key[TLS_TICKET_KEY_SIZE];
+	uint32_t keyrev;
+
+	if (ticket_key_count > 0)
+		keyrev = ticket_keys[0].keyrev + 1;
+	else
+		get_random_bytes((uint8_t *)&keyrev, sizeof(keyrev));
+	get_random_bytes(key, sizeof(key));
+	push_ticket_key(keyrev, key);
+	explicit_bzero(key, sizeof(key));
+}
+
+static bool setup_session_resumption(struct tls_config *conf, bool keep_session_id)
+{
+	usec_t lifetime = cf_client_tls_session_lifetime;
+	int i, err;
+
+	/* sessions of another certificate or verify mode must not resume */
+	if (!keep_session_id || !have_session_id) {
+		get_random_bytes(session_id, sizeof(session_id));
+		have_session_id = true;
+	}
+	err = tls_config_set_session_id(conf, session_id, sizeof(session_id));
+	if (err) {
+		log_error("could not set TLS session id: %s", tls_config_error(conf));
+		return false;
+	}
+
+	if (lifetime > 0 && lifetime < USEC)
+		lifetime = USEC;
+	err = tls_config_set_session_lifetime(conf, lifetime > 0 ? lifetime / USEC : 0);
+	if (err) {
+		log_error("invalid client_tls_session_lifetime: %s", tls_config_error(conf));
+		return false;
+	}
+	tls_config_set_session_cache_size(conf, cf_client_tls_session_cache_size);
+	if (lifetime <= 0)
+		return true;
+
+	if (ticket_key_count == 0)
+		new_ticket_key();
+	for (i = ticket_key_count - 1; i >= 0; i--) {
+		err = tls_config_add_ticket_key(conf, ticket_keys[i].keyrev,
+						ticket_keys[i].key, TLS_TICKET_KEY_SIZE);
+		if (err) {
+			log_error("could not add TLS ticket key: %s", tls_config_error(conf));
+			return false;
+		}
+	}
+	return true;
+}
+
+/* add a new ticket key if the current one is old enough, called from janitor */
+void sbuf_tls_rotate_ticket_keys(void)
+{
+	int err;
+
+	if (!client_accept_conf || cf_client_tls_session_lifetime <= 0 || ticket_key_count == 0)
+		return;
+	if (get_cached_time() - ticket_key_time < cf_client_tls_session_lifetime)
+		return;
+
+	new_ticket_key();
+	err = tls_config_add_ticket_key(client_accept_conf, ticket_keys[0].keyrev,
+					ticket_keys[0].key, TLS_TICKET_KEY_SIZE);
+	if (err)
+		log_warning("could not add TLS ticket key: %s", tls_config_error(client_accept_conf));
+	else
+		log_debug("new TLS ticket key %u", ticket_keys[0].keyrev);
+}
+
+/*
+ * Rows of SHOW TLS_TICKET_KEYS, oldest key first.  Used on online restart,
+ * so that clients can resume their sessions with the new process.
+ */
+void sbuf_tls_write_ticket_keys(PktBuf *buf)
+{
+	int i;
+
+	if (have_session_id)
+		pktbuf_write_DataRow(buf, "sqb", "session_id", (uint64_t)0,
+				     (int)sizeof(session_id), session_id);
+	for (i = ticket_key_count - 1; i >= 0; i--) {
+		pktbuf_write_DataRow(buf, "sqb", "ticket_key", (uint64_t)ticket_keys[i].keyrev,
+				     TLS_TICKET_KEY_SIZE, ticket_keys[i].key);
+	}
+}
+
+/* load one row of SHOW TLS_TICKET_KEYS from the old process */
+bool sbuf_tls_load_ticket_key(const char *task, uint64_t keyrev, const uint8_t *key, int len)
+{
+	if (strcmp(task, "session_id") == 0) {
+		if (len != sizeof(session_id))
+			return false;
+		memcpy(session_id, key, len);
+		have_session_id = true;
+	} else if (strcmp(task, "ticket_key") == 0) {
+		if (len != TLS_TICKET_KEY_SIZE || keyrev > UINT32_MAX)
+			return false;
+		if (!loading_ticket_keys) {
+			ticket_key_count = 0;
+			loading_ticket_keys = true;
+		}
+		push_ticket_key(keyrev, key);
+	} else {
+		return false;
+	}
+	return true;
+}
+
+/* all keys of the old process loaded, start using them */
+void sbuf_tls_ticket_keys_loaded(void)
+{
+	loading_ticket_keys = false;
+	if (!sbuf_tls_setup())
+		log_warning("could not apply TLS ticket keys of old process");
+}
+
+/*
+ * TLS sessions of server connections, by host name and address of the
+ * server.  A new connection to the same server offers the last session,
+ * so that the server can skip the full handshake if it supports session
+ * resumption.  All sessions are dropped when the server TLS settings
+ * change.
+ */
+struct ServerTlsSession {
+	UT_hash_handle hh;
+	uint8_t *data;		/* serialized session */
+	size_t len;
+	char key[];
+};
+
+/* oldest first, as that is the iteration order of uthash */
+static struct ServerTlsSession *server_tls_sessions;
+
+#define MAX_SERVER_TLS_SESSIONS 1000
+#define SERVER_TLS_SESSION_KEY_MAX (256 + PGADDR_BUF + 32)
+
+static void drop_server_tls_session(struct ServerTlsSession *ss)
+{
+	HASH_DELETE(hh, server_tls_sessions, ss);
+	explicit_bzero(ss->data, ss->len);
+	free(ss->data);
+	free(ss);
+}
+
+static void drop_server_tls_sessions(void)
+{
+	struct ServerTlsSession *ss, *tmp;
+
+	HASH_ITER(hh, server_tls_sessions, ss, tmp) {
+		drop_server_tls_session(ss);
+	}
+}
+
+static size_t server_tls_session_key(SBuf *sbuf, char *buf, size_t buflen)
+{
+	PgSocket *server = container_of(sbuf, PgSocket, sbuf);
+	char addr[PGADDR_BUF + 16];
+	int len;
+
+	len = snprintf(buf, buflen, "%s@%s", server->host ? server->host : "",
+		       pga_str(&server->remote_addr, addr, sizeof(addr)));
+	if (len < 0 || (size_t)len >= buflen)
+		return 0;
+	return len;
+}
+
+static void offer_server_tls_session(SBuf *sbuf)
+{
+	struct ServerTlsSession *ss;
+	char key[SERVER_TLS_SESSION_KEY_MAX];
+	size_t keylen;
+
+	keylen = server_tls_session_key(sbuf, key, sizeof(key));
+	if (!keylen)
+		return;
+	HASH_FIND(hh, server_tls_sessions, key, keylen, ss);
+	if (ss && tls_set_session(sbuf->tls, ss->data, ss->len) < 0) {
+		log_debug("dropping TLS session of %s: %s", key, tls_error(sbuf->tls));
+		drop_server_tls_session(ss);
+	}
+}
+
+/* remember the session of a server connection for the next one */
+static void save_server_tls_session(SBuf *sbuf)
+{
+	struct ServerTlsSession *ss;
+	char key[SERVER_TLS_SESSION_KEY_MAX];
+	size_t keylen, len;
+	uint8_t *data;
+
+	keylen = server_tls_session_key(sbuf, key, sizeof(key));
+	if (!keylen)
+		return;
+	data = tls_conn_session(sbuf->tls, &len);
+	if (!data)
+		return;
+
+	HASH_FIND(hh, server_tls_sessions, key, keylen, ss);
+	if (ss)
+		drop_server_tls_session(ss);
+	ss = malloc(sizeof(*ss) + keylen);
+	if (!ss) {
+		explicit_bzero(data, len);
+		free(data);
+		return;
+	}
+	memcpy(ss->key, key, keylen);
+	ss->data = data;
+	ss->len = len;
+	while (HASH_COUNT(server_tls_sessions) >= MAX_SERVER_TLS_SESSIONS)
+		drop_server_tls_session(server_tls_sessions);
+	HASH_ADD(hh, server_tls_sessions, key, keylen, ss);
+}
+
 static bool tls_change_requires_reconnect(struct tls_config *new_server_connect_conf)
 {
 	if (server_connect_sslmode != cf_server_tls_sslmode) {
@@ -1337,6 +1875,9 @@ bool sbuf_tls_setup(void)
 			       cf_client_tls_ca_file, cf_client_tls_dheparams,
 			       cf_client_tls_ecdhecurve, false))
 			goto failed;
+		if (!setup_session_resumption(new_client_accept_conf,
+					      tls_config_equal(new_client_accept_conf, client_accept_conf)))
+			goto failed;
 
 		new_client_accept_base = tls_server();
 		if (!new_client_accept_base) {
@@ -1364,6 +1905,7 @@ bool sbuf_tls_setup(void)
 			pool = container_of(item, PgPool, head);
 			tag_pool_dirty(pool);
 		}
+		drop_server_tls_sessions();
 	}
 
 	usual_tls_free(client_accept_base);
@@ -1438,6 +1980,12 @@ bool sbuf_tls_accept(SBuf *sbuf)
 	return true;
 }
 
+/* did the TLS handshake resume an earlier session */
+bool sbuf_tls_resumed(SBuf *sbuf)
+{
+	return sbuf->tls && tls_conn_session_resumed(sbuf->tls);
+}
+
 /*
  * Connect to remote TLS host.
  */
@@ -1472,6 +2020,8 @@ bool sbuf_tls_connect(SBuf *sbuf, const char *hostname)
 		log_warning("TLS connect error: %s", tls_error(sbuf->tls));
 		return false;
 	}
+	offer_server_tls_session(sbuf);
+	sbuf->tls_session_pending = true;
 
 	sbuf->tls_state = SBUF_TLS_DO_HANDSHAKE;
 	return true;
@@ -1499,6 +2049,14 @@ static ssize_t tls_sbufio_recv(struct SBuf *sbuf, void *dst, size_t len)
 	out = tls_read(sbuf->tls, dst, len);
 	log_noise("tls_read: req=%zu out=%zd", len, out);
 	if (out >= 0) {
+		/*
+		 * A TLS v1.3 server sends its session tickets before any
+		 * data, so the session is complete once data arrives.
+		 */
+		if (sbuf->tls_session_pending && out > 0) {
+			sbuf->tls_session_pending = false;
+			save_server_tls_session(sbuf);
+		}
 		return out;
 	} else if (out == TLS_WANT_POLLIN) {
 		errno = EAGAIN;
@@ -1560,6 +2118,7 @@ void sbuf_cleanup(void)
 	client_accept_conf = NULL;
 	server_connect_conf = NULL;
 	client_accept_base = NULL;
+	drop_server_tls_sessions();
 }
 
 static bool handle_possible_direct_tls_startup(SBuf *sbuf, bool is_unix)
@@ -1614,6 +2173,23 @@ bool sbuf_tls_setup(void)
 {
 	return true;
 }
+void sbuf_tls_rotate_ticket_keys(void)
+{
+}
+void sbuf_tls_write_ticket_keys(PktBuf *buf)
+{
+}
+bool sbuf_tls_load_ticket_key(const char *task, uint64_t keyrev, const uint8_t *key, int len)
+{
+	return false;
+}
+void sbuf_tls_ticket_keys_loaded(void)
+{
+}
+bool sbuf_tls_resumed(SBuf *sbuf)
+{
+	return false;
+}
 bool sbuf_tls_accept(SBuf *sbuf)
 {
 	return false;
@@ -1638,3 +2214,247 @@ static bool handle_possible_direct_tls_startup(SBuf *sbuf, bool is_unix)
 }
 
 #endif
+
+/*
+ * Compression support.
+ *
+ * After both sides agreed on it, all data is sent as one zlib stream in
+ * each direction.  Every send is finished with Z_SYNC_FLUSH, so the other
+ * side can decompress everything that was sent without waiting for more.
+ */
+
+#ifdef HAVE_ZLIB
+
+#define COMPRESS_BUF_SIZE	(16 * 1024)
+#define COMPRESS_WINDOW_BITS	13
+#define COMPRESS_MEM_LEVEL	6
+
+struct SBufCompress {
+	const SBufIO *inner;	/* ops of the underlying connection */
+	z_stream deflate;
+	z_stream inflate;
+	bool inflate_full;	/* last inflate() filled the output, it may have more */
+	bool send_held;		/* last byte of previous send is compressed but was reported unsent */
+	unsigned recv_pos;	/* compressed data read from socket, not inflated yet */
+	unsigned recv_len;
+	unsigned send_pos;	/* compressed data not written to socket yet */
+	unsigned send_len;
+	uint8_t recv_buf[COMPRESS_BUF_SIZE];
+	uint8_t send_buf[COMPRESS_BUF_SIZE];
+};
+
+static void free_compress(struct SBufCompress *comp)
+{
+	deflateEnd(&comp->deflate);
+	inflateEnd(&comp->inflate);
+	free(comp);
+}
+
+/* switch the connection to compressed I/O */
+bool sbuf_compress_start(SBuf *sbuf)
+{
+	struct SBufCompress *comp;
+
+	Assert(!sbuf->compress);
+
+	comp = calloc(1, sizeof(*comp));
+	if (!comp)
+		return false;
+
+	/*
+	 * Favor speed, the data is mostly compressible text anyway.  The
+	 * smaller window and hash keep the deflate state at 64 kB instead
+	 * of 256 kB, inflate accepts any window so old peers still work.
+	 */
+	if (deflateInit2(&comp->deflate, Z_BEST_SPEED, Z_DEFLATED,
+			 COMPRESS_WINDOW_BITS, COMPRESS_MEM_LEVEL,
+			 Z_DEFAULT_STRATEGY) != Z_OK) {
+		free(comp);
+		return false;
+	}
+	if (inflateInit(&comp->inflate) != Z_OK) {
+		deflateEnd(&comp->deflate);
+		free(comp);
+		return false;
+	}
+
+	comp->inner = sbuf->ops;
+	sbuf->compress = comp;
+	sbuf->ops = &compress_sbufio_ops;
+	return true;
+}
+
+bool sbuf_compress_pending(SBuf *sbuf)
+{
+	struct SBufCompress *comp = sbuf->compress;
+
+	if (!comp)
+		return false;
+	return comp->recv_pos < comp->recv_len || comp->inflate_full;
+}
+
+static ssize_t compress_sbufio_peek(struct SBuf *sbuf, void *buf, size_t len)
+{
+	errno = EIO;
+	return -1;
+}
+
+static ssize_t compress_sbufio_recv(struct SBuf *sbuf, void *dst, size_t len)
+{
+	struct SBufCompress *comp = sbuf->compress;
+	z_stream *zs = &comp->inflate;
+	unsigned produced;
+	ssize_t got;
+	usec_t start;
+	int zres;
+
+	if (len > COMPRESS_BUF_SIZE * 4)
+		len = COMPRESS_BUF_SIZE * 4;
+
+	for (;;) {
+		if (comp->recv_pos == comp->recv_len && !comp->inflate_full) {
+			got = comp->inner->sbufio_recv(sbuf, comp->recv_buf, sizeof(comp->recv_buf));
+			if (got <= 0)
+				return got;
+			comp->recv_pos = 0;
+			comp->recv_len = got;
+			sbuf_compress_stats.recv_wire_bytes += got;
+		}
+
+		zs->next_in = comp->recv_buf + comp->recv_pos;
+		zs->avail_in = comp->recv_len - comp->recv_pos;
+		zs->next_out = dst;
+		zs->avail_out = len;
+
+		start = get_time_usec();
+		zres = inflate(zs, Z_SYNC_FLUSH);
+		sbuf_compress_stats.recv_time += get_time_usec() - start;
+		if (zres != Z_OK && zres != Z_BUF_ERROR) {
+			log_warning("compress_sbufio_recv: inflate failed: %s", zs->msg ? zs->msg : "stream end");
+			errno = EIO;
+			return -1;
+		}
+
+		comp->recv_pos = comp->recv_len - zs->avail_in;
+		produced = len - zs->avail_out;
+		comp->inflate_full = zs->avail_out == 0;
+		if (produced > 0) {
+			sbuf_compress_stats.recv_raw_bytes += produced;
+			return produced;
+		}
+
+		/* no output although input is left: broken stream */
+		if (comp->recv_pos < comp->recv_len) {
+			log_warning("compress_sbufio_recv: inflate made no progress");
+			errno = EIO;
+			return -1;
+		}
+	}
+}
+
+/* write out compressed data: 1 when done, 0 if the socket is full, -1 on error */
+static int compress_flush(struct SBuf *sbuf)
+{
+	struct SBufCompress *comp = sbuf->compress;
+	ssize_t res;
+
+	while (comp->send_pos < comp->send_len) {
+		res = comp->inner->sbufio_send(sbuf, comp->send_buf + comp->send_pos,
+					       comp->send_len - comp->send_pos);
+		if (res < 0)
+			return errno == EAGAIN ? 0 : -1;
+		if (res == 0)
+			return 0;
+		comp->send_pos += res;
+		sbuf_compress_stats.send_wire_bytes += res;
+	}
+	return 1;
+}
+
+/*
+ * The caller only waits for the socket to become writable when fewer bytes
+ * than requested are reported as sent.  So when compressed data is left
+ * over, the last byte that was compressed is reported as unsent, and
+ * skipped when the caller comes back with it after the left-over data has
+ * been written.
+ */
+static ssize_t compress_sbufio_send(struct SBuf *sbuf, const void *data, size_t len)
+{
+	struct SBufCompress *comp = sbuf->compress;
+	z_stream *zs = &comp->deflate;
+	size_t done = 0;
+	size_t chunk;
+	usec_t start;
+	int zres;
+	int res;
+
+	res = compress_flush(sbuf);
+	if (res <= 0)
+		return -1;
+	if (comp->send_held) {
+		comp->send_held = false;
+		done = 1;
+	}
+
+	while (done < len || zs->avail_out == 0) {
+		chunk = len - done;
+		if (chunk > COMPRESS_BUF_SIZE * 4)
+			chunk = COMPRESS_BUF_SIZE * 4;
+		zs->next_in = (Bytef *)data + done;
+		zs->avail_in = chunk;
+		zs->next_out = comp->send_buf;
+		zs->avail_out = sizeof(comp->send_buf);
+
+		start = get_time_usec();
+		zres = deflate(zs, Z_SYNC_FLUSH);
+		sbuf_compress_stats.send_time += get_time_usec() - start;
+		if (zres != Z_OK && zres != Z_BUF_ERROR) {
+			log_warning("compress_sbufio_send: deflate failed: %s", zs->msg ? zs->msg : "unknown error");
+			errno = EIO;
+			return -1;
+		}
+
+		sbuf_compress_stats.send_raw_bytes += chunk - zs->avail_in;
+		done += chunk - zs->avail_in;
+		comp->send_pos = 0;
+		comp->send_len = sizeof(comp->send_buf) - zs->avail_out;
+
+		res = compress_flush(sbuf);
+		if (res < 0)
+			return -1;
+		if (res == 0) {
+			if (done <= 1) {
+				comp->send_held = done == 1;
+				errno = EAGAIN;
+				return -1;
+			}
+			comp->send_held = true;
+			return done - 1;
+		}
+	}
+	return done;
+}
+
+static int compress_sbufio_close(struct SBuf *sbuf)
+{
+	struct SBufCompress *comp = sbuf->compress;
+
+	sbuf->ops = comp->inner;
+	sbuf->compress = NULL;
+	free_compress(comp);
+	return sbuf_op_close(sbuf);
+}
+
+#else
+
+bool sbuf_compress_start(SBuf *sbuf)
+{
+	return false;
+}
+
+bool sbuf_compress_pending(SBuf *sbuf)
+{
+	return false;
+}
+
+#endif
@@ -331,7 +331,7 @@ failed:
 char *build_client_final_message(PgSocket *server,
 				 const PgCredentials *credentials)
 {
-	ScramState *state = &server->scram_state;
+	ScramState *state = &server->login_state->scram_state;
 	char buf[512];
 	size_t len;
 	uint8_t client_proof[SCRAM_SHA_256_KEY_LEN];
@@ -367,7 +367,7 @@ failed:
 
 bool read_server_first_message(PgSocket *server, char *input)
 {
-	ScramState *state = &server->scram_state;
+	ScramState *state = &server->login_state->scram_state;
 	char *server_nonce;
 	char *encoded_salt;
 	int decoded_salt_len;
@@ -475,7 +475,7 @@ static bool calculate_client_proof(PgSocket *server,
 				   const char *client_final_message_without_proof,
 				   uint8_t *result)
 {
-	ScramState *state = &server->scram_state;
+	ScramState *state = &server->login_state->scram_state;
 	pg_saslprep_rc rc;
 	char *prep_password = NULL;
 	uint8 StoredKey[SCRAM_MAX_KEY_LEN];
@@ -557,7 +557,7 @@ failed:
 
 bool verify_server_signature(PgSocket *server, const PgCredentials *credentials, const char *ServerSignature, bool *match)
 {
-	ScramState *state = &server->scram_state;
+	ScramState *state = &server->login_state->scram_state;
 	uint8 expected_ServerSignature[SCRAM_MAX_KEY_LEN];
 	uint8 ServerKey[SCRAM_MAX_KEY_LEN];
 	pg_hmac_ctx *ctx;
@@ -621,7 +621,7 @@ bool verify_server_signature(PgSocket *server, const PgCredentials *credentials,
 
 bool read_client_first_message(PgSocket *client, char *input)
 {
-	ScramState *state = &client->scram_state;
+	ScramState *state = &client->login_state->scram_state;
 	char *client_first_message_bare = NULL;
 	char *client_nonce = NULL;
 	char *client_nonce_copy = NULL;
@@ -709,7 +709,7 @@ bool read_client_final_message(PgSocket *client, const uint8_t *raw_input, char
 			       const char **client_final_nonce_p,
 			       char **proof_p)
 {
-	ScramState *state = &client->scram_state;
+	ScramState *state = &client->login_state->scram_state;
 	const char *input_start = input;
 	char attr;
 	char *channel_binding;
@@ -1042,7 +1042,7 @@ static char *compute_server_signature(PgSocket *client, ScramState *state)
 
 char *build_server_final_message(PgSocket *client)
 {
-	ScramState *state = &client->scram_state;
+	ScramState *state = &client->login_state->scram_state;
 	char *server_signature = NULL;
 	size_t len;
 	char *result;
@@ -1092,7 +1092,7 @@ bool verify_final_nonce(const ScramState *state, const char *client_final_nonce)
 
 bool verify_client_proof(PgSocket *client, const char *ClientProof)
 {
-	ScramState *state = &client->scram_state;
+	ScramState *state = &client->login_state->scram_state;
 	uint8_t ClientSignature[SCRAM_SHA_256_KEY_LEN];
 	uint8_t client_StoredKey[SCRAM_SHA_256_KEY_LEN];
 	pg_hmac_ctx *ctx;
@@ -45,7 +45,7 @@ static bool load_parameter(PgSocket *server, PktHdr *pkt, bool startup)
 		goto failed;
 	slog_debug(server, "S: param: %s = %s", key, val);
 
-	varcache_set(&server->vars, key, val);
+	varcache_set_reported(&server->vars, key, val);
 
 	if (client) {
 		slog_debug(client, "setting client var: %s='%s'", key, val);
@@ -125,6 +125,7 @@ static bool handle_server_startup(PgSocket *server, PktHdr *pkt)
 	const char *msg;
 	bool res = false;
 	const uint8_t *ckey;
+	int hot_count;
 
 	if (incomplete_pkt(pkt)) {
 		if (pkt->len > (unsigned) cf_sbuf_len) {
@@ -165,6 +166,25 @@ static bool handle_server_startup(PgSocket *server, PktHdr *pkt)
 			sbuf_prepare_skip(sbuf, pkt->len);
 			return true;
 		}
+	} else if (server->preparing_hot_statements) {
+		switch (pkt->type) {
+		case PqMsg_ReadyForQuery:
+		case PqMsg_ParameterStatus:
+			/* handle them below */
+			break;
+
+		case PqMsg_ParseComplete:
+			hot_statement_prepared(server);
+			sbuf_prepare_skip(sbuf, pkt->len);
+			return true;
+
+		case PqMsg_ErrorResponse:
+			hot_statements_failed(server, pkt);
+		/* fallthrough */
+		default:	/* ignore rest */
+			sbuf_prepare_skip(sbuf, pkt->len);
+			return true;
+		}
 	}
 
 	switch (pkt->type) {
@@ -215,7 +235,7 @@ static bool handle_server_startup(PgSocket *server, PktHdr *pkt)
 		if (server->exec_on_connect) {
 			server->exec_on_connect = false;
 			/* deliberately ignore transaction status */
-		} else if (server->pool->db->connect_query) {
+		} else if (server->pool->db->connect_query && !server->preparing_hot_statements) {
 			server->exec_on_connect = true;
 			slog_debug(server, "server connect ok, send exec_on_connect");
 			SEND_generic(res, server, PqMsg_Query, "s", server->pool->db->connect_query);
@@ -224,6 +244,20 @@ static bool handle_server_startup(PgSocket *server, PktHdr *pkt)
 			break;
 		}
 
+		if (server->preparing_hot_statements) {
+			server->preparing_hot_statements = false;
+		} else {
+			hot_count = prepare_hot_statements(server);
+			if (hot_count < 0) {
+				disconnect_server(server, false, "preparing hot statements failed");
+				break;
+			}
+			if (hot_count > 0) {
+				res = true;
+				break;
+			}
+		}
+
 		/* login ok */
 		slog_debug(server, "server login ok, start accepting queries");
 		server->ready = true;
@@ -383,7 +417,7 @@ static bool handle_server_work(PgSocket *server, PktHdr *pkt)
 	SBuf *sbuf = &server->sbuf;
 	PgSocket *client = server->link;
 	bool async_response = false;
-	struct List *item, *tmp;
+	OutstandingRequest *request;
 	bool ignore_packet = false;
 
 	Assert(!server->pool->db->admin);
@@ -479,6 +513,7 @@ static bool handle_server_work(PgSocket *server, PktHdr *pkt)
 				return false;
 		}
 
+		check_describe_cache_error(pkt);
 		server->query_failed = true;
 		break;
 
@@ -554,9 +589,14 @@ static bool handle_server_work(PgSocket *server, PktHdr *pkt)
 		break;
 	case PqMsg_NoData:
 	case PqMsg_RowDescription:
+		if (!capture_describe_response(server, pkt))
+			return false;
 		pop_outstanding_request(server, (char[]) {PqMsg_Describe, '\0'}, &ignore_packet);
 		break;
 	case PqMsg_ParameterDescription:
+		if (!capture_describe_response(server, pkt))
+			return false;
+		break;
 	case PqMsg_CopyDone:
 	case PqMsg_CopyFail:
 	case PqMsg_FunctionCallResponse:
@@ -573,6 +613,8 @@ static bool handle_server_work(PgSocket *server, PktHdr *pkt)
 	}
 	server->idle_tx = idle_tx;
 	server->ready = ready;
+	if (ready && server->close_needed && cf_server_fast_close)
+		server_timeout_update(server);
 	server->pool->stats.server_bytes += pkt->len;
 
 	if (server->setting_vars) {
@@ -600,7 +642,7 @@ static bool handle_server_work(PgSocket *server, PktHdr *pkt)
 			 * similar, not only per client. (which would probably
 			 * be a good future improvement)
 			 */
-			if (statlist_count(&server->outstanding_requests) == 0) {
+			if (outstanding_request_count(server) == 0) {
 				/* every statement (independent or in a transaction) counts as a query */
 				if (ready || idle_tx) {
 					if (client->query_start) {
@@ -630,15 +672,16 @@ static bool handle_server_work(PgSocket *server, PktHdr *pkt)
 					}
 				}
 			}
-			statlist_for_each_safe(item, &server->outstanding_requests, tmp) {
-				OutstandingRequest *request = container_of(item, OutstandingRequest, node);
+			while ((request = first_outstanding_request(server)) != NULL) {
+				OutstandingRequest fake;
+
 				if (request->action != RA_FAKE)
 					break;
 
-				statlist_pop(&server->outstanding_requests);
+				take_outstanding_request(server, &fake);
 				sbuf->extra_packet_queue_after = true;
 
-				if (!queue_fake_response(client, request->type)) {
+				if (!queue_fake_response(client, fake.type, fake.describe_ps)) {
 					/*
 					 * The only reason the above could have failed is because
 					 * of allocation errors. To actually be able to retry after
@@ -652,7 +695,7 @@ static bool handle_server_work(PgSocket *server, PktHdr *pkt)
 					disconnect_server(client->link, true, "out of memory");
 					return false;
 				}
-				slab_free(outstanding_request_cache, request);
+				free_outstanding_request(&fake);
 			}
 		}
 	} else {
@@ -667,6 +710,45 @@ static bool handle_server_work(PgSocket *server, PktHdr *pkt)
 	return true;
 }
 
+/*
+ * Should a compressed connection be requested?  Compressing inside TLS
+ * lets the ciphertext length leak secrets, so "enable" skips TLS links.
+ */
+static bool want_server_compression(PgSocket *server)
+{
+	enum ServerCompression mode = server->pool->db->server_compression;
+
+	if (mode == SERVER_COMPRESSION_DISABLE || server->sbuf.compress)
+		return false;
+	if (pga_is_unix(&server->remote_addr))
+		return false;
+	return mode == SERVER_COMPRESSION_ALWAYS || !server->sbuf.tls;
+}
+
+/*
+ * Last step before the startup packet: ask for a compressed connection if
+ * configured.  The answer is handled by handle_compresschar().
+ */
+static bool send_startup_or_compressreq(PgSocket *server)
+{
+	if (want_server_compression(server)) {
+		slog_noise(server, "P: compression request");
+		if (!send_compressreq_packet(server))
+			return false;
+		server->wait_compresschar = true;
+		return true;
+	}
+	slog_noise(server, "P: startup");
+	return send_startup_message(server);
+}
+
+/* a peer link carries peer_link_secret, so it uses TLS like a login */
+static bool peer_link_wants_tls(PgSocket *server, bool is_unix)
+{
+	return server->pool->db->peer_id && cf_peer_link && *cf_peer_link_secret
+	       && server_connect_sslmode > SSLMODE_DISABLED && !is_unix;
+}
+
 /* got connection, decide what to do */
 static bool handle_connect(PgSocket *server)
 {
@@ -699,7 +781,20 @@ static bool handle_connect(PgSocket *server)
 	 * A special case is when this is a peer pool, instead of a regular pool.
 	 * Since only cancellation requests should be sent to peers.
 	 */
-	if (!statlist_empty(&pool->waiting_cancel_req_list)) {
+	if (server->cancel_standby) {
+		/* keep it ready, the server closes it if nothing is sent */
+		slog_debug(server, "keep it ready for cancel requests");
+		change_server_state(server, SV_ACTIVE_CANCEL);
+		start_waiting_cancel_requests(pool);
+		res = true;
+	} else if (peer_link_wants_tls(server, is_unix)) {
+		slog_noise(server, "P: SSL request for peer link");
+		res = send_sslreq_packet(server);
+		if (res)
+			server->wait_sslchar = true;
+		else
+			disconnect_server(server, false, "sslreq for peer link failed");
+	} else if (!statlist_empty(&pool->waiting_cancel_req_list)) {
 		slog_debug(server, "use it for pending cancel req");
 		forward_cancel_request(server);
 	} else if (pool->db->peer_id) {
@@ -714,8 +809,7 @@ static bool handle_connect(PgSocket *server)
 			if (res)
 				server->wait_sslchar = true;
 		} else {
-			slog_noise(server, "P: startup");
-			res = send_startup_message(server);
+			res = send_startup_or_compressreq(server);
 		}
 		if (!res)
 			disconnect_server(server, false, "startup pkt failed");
@@ -752,9 +846,14 @@ static bool handle_sslchar(PgSocket *server, struct MBuf *data)
 	} else if (server_connect_sslmode >= SSLMODE_REQUIRE) {
 		disconnect_server(server, false, "server refused SSL");
 		return false;
+	} else if (server->pool->db->peer_id) {
+		/* the peer has no TLS, open the link in plain text */
+		if (!open_peer_link(server))
+			return false;
+		ok = true;
 	} else {
 		/* proceed with non-TLS connection */
-		ok = send_startup_message(server);
+		ok = send_startup_or_compressreq(server);
 	}
 
 	if (ok) {
@@ -765,6 +864,44 @@ static bool handle_sslchar(PgSocket *server, struct MBuf *data)
 	return ok;
 }
 
+static bool handle_compresschar(PgSocket *server, struct MBuf *data)
+{
+	uint8_t zchar = '?';
+	bool ok;
+
+	server->wait_compresschar = false;
+
+	ok = mbuf_get_byte(data, &zchar);
+	if (!ok || (zchar != 'Z' && zchar != 'N')) {
+		disconnect_server(server, false, "bad compression request answer");
+		return false;
+	}
+	/* anything after the answer would be read uncompressed */
+	if (mbuf_avail_for_read(data) != 0) {
+		disconnect_server(server, false, "received data after compression response");
+		return false;
+	}
+
+	if (zchar == 'Z') {
+		if (!sbuf_compress_start(&server->sbuf)) {
+			disconnect_server(server, false, "could not start compression");
+			return false;
+		}
+		slog_noise(server, "compression enabled");
+	} else {
+		/* server does not support it, proceed uncompressed */
+		slog_debug(server, "server refused compression");
+	}
+
+	ok = send_startup_message(server);
+	if (ok) {
+		sbuf_prepare_skip(&server->sbuf, 1);
+	} else {
+		disconnect_server(server, false, "startup pkt failed");
+	}
+	return ok;
+}
+
 /* dispatch a fully buffered packet, see process_pkt_callback() */
 static bool server_handle_complete_packet(PgSocket *server, PktHdr *pkt)
 {
@@ -782,6 +919,7 @@ bool server_proto(SBuf *sbuf, SBufEvent evtype, struct MBuf *data)
 	PgPool *pool = server->pool;
 	PktHdr pkt;
 	char infobuf[96];
+	bool resumed;
 
 	Assert(is_server_socket(server));
 	Assert(server->state != SV_FREE);
@@ -792,7 +930,11 @@ bool server_proto(SBuf *sbuf, SBufEvent evtype, struct MBuf *data)
 
 	switch (evtype) {
 	case SBUF_EV_RECV_FAILED:
-		if (server->state == SV_ACTIVE_CANCEL)
+		if (server->peer_link)
+			disconnect_server(server, false, "peer link closed");
+		else if (server->cancel_standby)
+			disconnect_server(server, false, "cancel standby connection closed by server, is cancel_standby_lifetime longer than authentication_timeout?");
+		else if (server->state == SV_ACTIVE_CANCEL)
 			disconnect_server(server, false, "successfully sent cancel request");
 		else
 			disconnect_server(server, false, "server conn crashed?");
@@ -805,6 +947,10 @@ bool server_proto(SBuf *sbuf, SBufEvent evtype, struct MBuf *data)
 			res = handle_sslchar(server, data);
 			break;
 		}
+		if (server->wait_compresschar) {
+			res = handle_compresschar(server, data);
+			break;
+		}
 		if (incomplete_header(data)) {
 			slog_noise(server, "S: got partial header, trying to wait a bit");
 			break;
@@ -879,7 +1025,7 @@ bool server_proto(SBuf *sbuf, SBufEvent evtype, struct MBuf *data)
 			case SV_TESTED:
 				/* keep link if client expects more responses */
 				if (server->link) {
-					if (statlist_count(&server->outstanding_requests) > 0)
+					if (outstanding_request_count(server) > 0)
 						break;
 					/*
 					 * Client still in COPY-in stream (hasn't sent
@@ -912,15 +1058,26 @@ bool server_proto(SBuf *sbuf, SBufEvent evtype, struct MBuf *data)
 	case SBUF_EV_TLS_READY:
 		Assert(server->state == SV_LOGIN);
 
+		resumed = sbuf_tls_resumed(&server->sbuf);
+		pool->stats.server_tls_connect_count++;
+		if (resumed)
+			pool->stats.server_tls_resumed_count++;
+
 		tls_get_connection_info(server->sbuf.tls, infobuf, sizeof infobuf);
 		if (cf_log_connections) {
-			slog_info(server, "SSL established: %s", infobuf);
+			slog_info(server, "SSL established: %s%s", infobuf, resumed ? " (resumed)" : "");
 		} else {
-			slog_noise(server, "SSL established: %s", infobuf);
+			slog_noise(server, "SSL established: %s%s", infobuf, resumed ? " (resumed)" : "");
 		}
 
 		server->request_time = get_cached_time();
-		res = send_startup_message(server);
+		if (pool->db->peer_id) {
+			res = open_peer_link(server);
+			if (res)
+				sbuf_continue(&server->sbuf);
+			break;
+		}
+		res = send_startup_or_compressreq(server);
 		if (res)
 			sbuf_continue(&server->sbuf);
 		else
@@ -0,0 +1,211 @@
+/*
+ * PgBouncer - Lightweight connection pooler for PostgreSQL.
+ *
+ * Copyright (c) 2007-2009  Marko Kreen, Skype Technologies OÜ
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Result spool storage.
+ *
+ * The memory part is filled first.  Once it is full, further data goes
+ * to the temp file, and keeps going there until the file has been read
+ * back completely, so the byte order is kept.  Reading refills the memory
+ * part from the file.
+ */
+
+#include "bouncer.h"
+
+/* bytes held by all spools */
+static uint64_t spool_total;
+
+/*
+ * How much of len result_spool_total_size allows to spool.  Answers that
+ * pgbouncer generates itself are small and are not limited by it.
+ */
+size_t spool_total_room(size_t len)
+{
+	uint64_t max = cf_result_spool_total_size;
+
+	if (max == 0)
+		return len;
+	if (spool_total >= max)
+		return 0;
+	if (len > max - spool_total)
+		len = max - spool_total;
+	return len;
+}
+
+/* memory part may not be smaller than this, even after reload */
+static unsigned spool_mem_size(void)
+{
+	unsigned size = cf_result_spool_size;
+	if (size < (unsigned)cf_sbuf_len)
+		size = cf_sbuf_len;
+	return size;
+}
+
+static bool file_is_empty(const struct Spool *spool)
+{
+	return spool->file_read_pos == spool->file_write_pos;
+}
+
+struct Spool *spool_new(void)
+{
+	struct Spool *spool;
+
+	spool = calloc(1, sizeof(*spool));
+	if (!spool)
+		return NULL;
+	mbuf_init_dynamic(&spool->mem);
+	return spool;
+}
+
+void spool_free(struct Spool *spool)
+{
+	if (!spool)
+		return;
+	spool_total -= spool_amount(spool);
+	if (spool->file)
+		fclose(spool->file);
+	mbuf_free(&spool->mem);
+	free(spool);
+}
+
+static size_t append_mem(struct Spool *spool, const void *data, size_t len)
+{
+	struct MBuf *mem = &spool->mem;
+	unsigned used = mbuf_avail_for_read(mem);
+	unsigned size = spool_mem_size();
+
+	if (used >= size)
+		return 0;
+	if (len > size - used)
+		len = size - used;
+
+	/* move unread data to the front instead of growing past the limit */
+	if (mem->write_pos + len > size && mem->read_pos > 0) {
+		memmove(mem->data, mem->data + mem->read_pos, used);
+		mem->read_pos = 0;
+		mem->write_pos = used;
+	}
+
+	if (!mbuf_write(mem, data, len))
+		return 0;
+	return len;
+}
+
+static size_t append_file(struct Spool *spool, const void *data, size_t len)
+{
+	uint64_t max = cf_result_spool_file_size;
+
+	if (spool->file_write_pos >= max)
+		return 0;
+	if (len > max - spool->file_write_pos)
+		len = max - spool->file_write_pos;
+
+	if (!spool->file) {
+		spool->file = tmpfile();
+		if (!spool->file) {
+			log_warning("result spool: cannot create temp file: %s", strerror(errno));
+			return 0;
+		}
+	}
+
+	if (fseeko(spool->file, (off_t)spool->file_write_pos, SEEK_SET) < 0 ||
+	    fwrite(data, 1, len, spool->file) != len) {
+		log_warning("result spool: temp file write failed: %s", strerror(errno));
+		return 0;
+	}
+	spool->file_write_pos += len;
+	return len;
+}
+
+/*
+ * Add data to the end of the spool.  Returns the number of bytes taken,
+ * which is less than len if the spool is full.
+ */
+size_t spool_append(struct Spool *spool, const void *data, size_t len)
+{
+	size_t done = 0;
+
+	if (file_is_empty(spool))
+		done = append_mem(spool, data, len);
+	if (done < len)
+		done += append_file(spool, (const uint8_t *)data + done, len - done);
+	spool_total += done;
+	return done;
+}
+
+/* refill empty memory part from the temp file */
+static bool refill_mem(struct Spool *spool)
+{
+	struct MBuf *mem = &spool->mem;
+	uint64_t avail = spool->file_write_pos - spool->file_read_pos;
+	unsigned len = spool_mem_size();
+	size_t got;
+
+	if (avail < len)
+		len = avail;
+
+	mbuf_rewind_writer(mem);
+	if (!mbuf_make_room(mem, len))
+		return false;
+
+	if (fseeko(spool->file, (off_t)spool->file_read_pos, SEEK_SET) < 0) {
+		log_warning("result spool: temp file seek failed: %s", strerror(errno));
+		return false;
+	}
+	got = fread(mem->data, 1, len, spool->file);
+	if (got != len) {
+		log_warning("result spool: temp file read failed: %s", strerror(errno));
+		return false;
+	}
+	mem->write_pos = len;
+	spool->file_read_pos += len;
+
+	/* whole file is consumed, start writing it from the beginning */
+	if (file_is_empty(spool))
+		spool->file_read_pos = spool->file_write_pos = 0;
+	return true;
+}
+
+/*
+ * Get the next contiguous chunk of spooled data.  Returns false on
+ * temp file errors, which means the spooled data is lost.
+ */
+bool spool_peek(struct Spool *spool, const uint8_t **data_p, unsigned *len_p)
+{
+	struct MBuf *mem = &spool->mem;
+
+	if (mbuf_avail_for_read(mem) == 0 && !file_is_empty(spool)) {
+		if (!refill_mem(spool))
+			return false;
+	}
+	*data_p = mem->data + mem->read_pos;
+	*len_p = mbuf_avail_for_read(mem);
+	return true;
+}
+
+/* mark data returned by spool_peek() as sent */
+void spool_consume(struct Spool *spool, unsigned len)
+{
+	struct MBuf *mem = &spool->mem;
+
+	Assert(len <= mbuf_avail_for_read(mem));
+	mem->read_pos += len;
+	spool_total -= len;
+	if (mem->read_pos == mem->write_pos)
+		mbuf_rewind_writer(mem);
+}
@@ -35,8 +35,13 @@ static void reset_stats(PgStats *stat)
 	stat->ps_client_parse_count = 0;
 	stat->ps_server_parse_count = 0;
 	stat->ps_bind_count = 0;
+	stat->ps_describe_cache_hit_count = 0;
 
 	stat->client_login_count = 0;
+	stat->client_tls_login_count = 0;
+	stat->client_tls_resumed_count = 0;
+	stat->server_tls_connect_count = 0;
+	stat->server_tls_resumed_count = 0;
 }
 
 static void stat_add(PgStats *total, PgStats *stat)
@@ -53,8 +58,13 @@ static void stat_add(PgStats *total, PgStats *stat)
 	total->ps_client_parse_count += stat->ps_client_parse_count;
 	total->ps_server_parse_count += stat->ps_server_parse_count;
 	total->ps_bind_count += stat->ps_bind_count;
+	total->ps_describe_cache_hit_count += stat->ps_describe_cache_hit_count;
 
 	total->client_login_count += stat->client_login_count;
+	total->client_tls_login_count += stat->client_tls_login_count;
+	total->client_tls_resumed_count += stat->client_tls_resumed_count;
+	total->server_tls_connect_count += stat->server_tls_connect_count;
+	total->server_tls_resumed_count += stat->server_tls_resumed_count;
 }
 
 static void calc_average(PgStats *avg, PgStats *cur, PgStats *old)
@@ -65,7 +75,12 @@ static void calc_average(PgStats *avg, PgStats *cur, PgStats *old)
 	uint64_t ps_client_parse_count;
 	uint64_t ps_server_parse_count;
 	uint64_t ps_bind_count;
+	uint64_t ps_describe_cache_hit_count;
 	uint64_t client_login_count;
+	uint64_t client_tls_login_count;
+	uint64_t client_tls_resumed_count;
+	uint64_t server_tls_connect_count;
+	uint64_t server_tls_resumed_count;
 
 	usec_t dur = get_cached_time() - old_stamp;
 
@@ -97,34 +112,56 @@ static void calc_average(PgStats *avg, PgStats *cur, PgStats *old)
 	ps_client_parse_count = cur->ps_client_parse_count - old->ps_client_parse_count;
 	ps_server_parse_count = cur->ps_server_parse_count - old->ps_server_parse_count;
 	ps_bind_count = cur->ps_bind_count - old->ps_bind_count;
+	ps_describe_cache_hit_count = cur->ps_describe_cache_hit_count - old->ps_describe_cache_hit_count;
 
 	avg->ps_client_parse_count = USEC * ps_client_parse_count / dur;
 	avg->ps_server_parse_count = USEC * ps_server_parse_count / dur;
 	avg->ps_bind_count = USEC * ps_bind_count / dur;
+	avg->ps_describe_cache_hit_count = USEC * ps_describe_cache_hit_count / dur;
 
 	client_login_count = cur->client_login_count - old->client_login_count;
 	avg->client_login_count = USEC * client_login_count / dur;
+
+	client_tls_login_count = cur->client_tls_login_count - old->client_tls_login_count;
+	client_tls_resumed_count = cur->client_tls_resumed_count - old->client_tls_resumed_count;
+	avg->client_tls_login_count = USEC * client_tls_login_count / dur;
+	avg->client_tls_resumed_count = USEC * client_tls_resumed_count / dur;
+
+	server_tls_connect_count = cur->server_tls_connect_count - old->server_tls_connect_count;
+	server_tls_resumed_count = cur->server_tls_resumed_count - old->server_tls_resumed_count;
+	avg->server_tls_connect_count = USEC * server_tls_connect_count / dur;
+	avg->server_tls_resumed_count = USEC * server_tls_resumed_count / dur;
 }
 
 static void write_stats(PktBuf *buf, PgStats *stat, PgStats *old, char *dbname)
 {
 	PgStats avg;
 	calc_average(&avg, stat, old);
-	pktbuf_write_DataRow(buf, "sNNNNNNNNNNNNNNNNNNNNNNNN", dbname,
+	pktbuf_write_DataRow(buf, "sNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNN", dbname,
 			     stat->server_assignment_count,
 			     stat->xact_count, stat->query_count,
 			     stat->client_bytes, stat->server_bytes,
 			     stat->xact_time, stat->query_time,
 			     stat->wait_time, stat->ps_client_parse_count,
 			     stat->ps_server_parse_count, stat->ps_bind_count,
+			     stat->ps_describe_cache_hit_count,
 			     stat->client_login_count,
+			     stat->client_tls_login_count,
+			     stat->client_tls_resumed_count,
+			     stat->server_tls_connect_count,
+			     stat->server_tls_resumed_count,
 			     avg.server_assignment_count,
 			     avg.xact_count, avg.query_count,
 			     avg.client_bytes, avg.server_bytes,
 			     avg.xact_time, avg.query_time,
 			     avg.wait_time, avg.ps_client_parse_count,
 			     avg.ps_server_parse_count, avg.ps_bind_count,
-			     avg.client_login_count);
+			     avg.ps_describe_cache_hit_count,
+			     avg.client_login_count,
+			     avg.client_tls_login_count,
+			     avg.client_tls_resumed_count,
+			     avg.server_tls_connect_count,
+			     avg.server_tls_resumed_count);
 }
 
 bool admin_database_stats(PgSocket *client, struct StatList *pool_list)
@@ -144,21 +181,31 @@ bool admin_database_stats(PgSocket *client, struct StatList *pool_list)
 		return true;
 	}
 
-	pktbuf_write_RowDescription(buf, "sNNNNNNNNNNNNNNNNNNNNNNNN", "database",
+	pktbuf_write_RowDescription(buf, "sNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNNN", "database",
 				    "total_server_assignment_count",
 				    "total_xact_count", "total_query_count",
 				    "total_received", "total_sent",
 				    "total_xact_time", "total_query_time",
 				    "total_wait_time", "total_client_parse_count",
 				    "total_server_parse_count", "total_bind_count",
+				    "total_describe_cache_hit_count",
 				    "total_client_login_count",
+				    "total_client_tls_login_count",
+				    "total_client_tls_resumed_count",
+				    "total_server_tls_connect_count",
+				    "total_server_tls_resumed_count",
 				    "avg_server_assignment_count",
 				    "avg_xact_count", "avg_query_count",
 				    "avg_recv", "avg_sent",
 				    "avg_xact_time", "avg_query_time",
 				    "avg_wait_time", "avg_client_parse_count",
 				    "avg_server_parse_count", "avg_bind_count",
-				    "avg_client_login_count");
+				    "avg_describe_cache_hit_count",
+				    "avg_client_login_count",
+				    "avg_client_tls_login_count",
+				    "avg_client_tls_resumed_count",
+				    "avg_server_tls_connect_count",
+				    "avg_server_tls_resumed_count");
 	statlist_for_each(item, pool_list) {
 		pool = container_of(item, PgPool, head);
 
@@ -186,14 +233,19 @@ bool admin_database_stats(PgSocket *client, struct StatList *pool_list)
 
 static void write_stats_totals(PktBuf *buf, PgStats *stat, PgStats *old, char *dbname)
 {
-	pktbuf_write_DataRow(buf, "sNNNNNNNNNNNN", dbname,
+	pktbuf_write_DataRow(buf, "sNNNNNNNNNNNNNNNNN", dbname,
 			     stat->server_assignment_count,
 			     stat->xact_count, stat->query_count,
 			     stat->client_bytes, stat->server_bytes,
 			     stat->xact_time, stat->query_time,
 			     stat->wait_time, stat->ps_client_parse_count,
 			     stat->ps_server_parse_count, stat->ps_bind_count,
-			     stat->client_login_count);
+			     stat->ps_describe_cache_hit_count,
+			     stat->client_login_count,
+			     stat->client_tls_login_count,
+			     stat->client_tls_resumed_count,
+			     stat->server_tls_connect_count,
+			     stat->server_tls_resumed_count);
 }
 
 bool admin_database_stats_totals(PgSocket *client, struct StatList *pool_list)
@@ -213,14 +265,19 @@ bool admin_database_stats_totals(PgSocket *client, struct StatList *pool_list)
 		return true;
 	}
 
-	pktbuf_write_RowDescription(buf, "sNNNNNNNNNNNN", "database",
+	pktbuf_write_RowDescription(buf, "sNNNNNNNNNNNNNNNNN", "database",
 				    "server_assignment_count",
 				    "xact_count", "query_count",
 				    "bytes_received", "bytes_sent",
 				    "xact_time", "query_time",
 				    "wait_time", "client_parse_count",
 				    "server_parse_count", "bind_count",
-				    "client_login_count");
+				    "describe_cache_hit_count",
+				    "client_login_count",
+				    "client_tls_login_count",
+				    "client_tls_resumed_count",
+				    "server_tls_connect_count",
+				    "server_tls_resumed_count");
 	statlist_for_each(item, pool_list) {
 		pool = container_of(item, PgPool, head);
 
@@ -250,14 +307,19 @@ static void write_stats_averages(PktBuf *buf, PgStats *stat, PgStats *old, char
 {
 	PgStats avg;
 	calc_average(&avg, stat, old);
-	pktbuf_write_DataRow(buf, "sNNNNNNNNNNNN", dbname,
+	pktbuf_write_DataRow(buf, "sNNNNNNNNNNNNNNNNN", dbname,
 			     avg.server_assignment_count,
 			     avg.xact_count, avg.query_count,
 			     avg.client_bytes, avg.server_bytes,
 			     avg.xact_time, avg.query_time,
 			     avg.wait_time, avg.ps_client_parse_count,
 			     avg.ps_server_parse_count, avg.ps_bind_count,
-			     avg.client_login_count);
+			     avg.ps_describe_cache_hit_count,
+			     avg.client_login_count,
+			     avg.client_tls_login_count,
+			     avg.client_tls_resumed_count,
+			     avg.server_tls_connect_count,
+			     avg.server_tls_resumed_count);
 }
 
 bool admin_database_stats_averages(PgSocket *client, struct StatList *pool_list)
@@ -277,14 +339,19 @@ bool admin_database_stats_averages(PgSocket *client, struct StatList *pool_list)
 		return true;
 	}
 
-	pktbuf_write_RowDescription(buf, "sNNNNNNNNNNNN", "database",
+	pktbuf_write_RowDescription(buf, "sNNNNNNNNNNNNNNNNN", "database",
 				    "server_assignment_count",
 				    "xact_count", "query_count",
 				    "bytes_received", "bytes_sent",
 				    "xact_time", "query_time",
 				    "wait_time", "avg_client_parse_count",
 				    "avg_server_parse_count", "avg_bind_count",
-				    "avg_client_login_count");
+				    "avg_describe_cache_hit_count",
+				    "avg_client_login_count",
+				    "avg_client_tls_login_count",
+				    "avg_client_tls_resumed_count",
+				    "avg_server_tls_connect_count",
+				    "avg_server_tls_resumed_count");
 	statlist_for_each(item, pool_list) {
 		pool = container_of(item, PgPool, head);
 
@@ -351,7 +418,12 @@ bool show_stat_totals(PgSocket *client, struct StatList *pool_list)
 	WTOTAL(ps_client_parse_count);
 	WTOTAL(ps_server_parse_count);
 	WTOTAL(ps_bind_count);
+	WTOTAL(ps_describe_cache_hit_count);
 	WTOTAL(client_login_count);
+	WTOTAL(client_tls_login_count);
+	WTOTAL(client_tls_resumed_count);
+	WTOTAL(server_tls_connect_count);
+	WTOTAL(server_tls_resumed_count);
 	WAVG(server_assignment_count);
 	WAVG(xact_count);
 	WAVG(query_count);
@@ -363,7 +435,12 @@ bool show_stat_totals(PgSocket *client, struct StatList *pool_list)
 	WAVG(ps_client_parse_count);
 	WAVG(ps_server_parse_count);
 	WAVG(ps_bind_count);
+	WAVG(ps_describe_cache_hit_count);
 	WAVG(client_login_count);
+	WAVG(client_tls_login_count);
+	WAVG(client_tls_resumed_count);
+	WAVG(server_tls_connect_count);
+	WAVG(server_tls_resumed_count);
 
 	admin_flush(client, buf, "SHOW");
 	return true;
@@ -387,12 +464,16 @@ static void refresh_stats(evutil_socket_t s, short flags, void *arg)
 		pool->older_stats = pool->newer_stats;
 		pool->newer_stats = pool->stats;
 
+		prewarm_update_pool(pool, new_stamp - old_stamp);
+
 		if (cf_log_stats) {
 			stat_add(&cur_total, &pool->stats);
 			stat_add(&old_total, &pool->older_stats);
 		}
 	}
 
+	prewarm_save(false);
+
 	calc_average(&avg, &cur_total, &old_total);
 
 	if (cf_log_stats) {
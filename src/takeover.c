@@ -21,6 +21,9 @@
  * and continue with them.
  *
  * Each row from SHOW FDS will have corresponding fd in ancillary message.
+ * After that SHOW PREPARED_STATEMENTS loads the prepared statements of the
+ * sockets, and SHOW TLS_TICKET_KEYS the keys that TLS sessions of clients
+ * can be resumed with.
  *
  * Manpages: unix, sendmsg, recvmsg, cmsg, readv
  */
@@ -36,6 +39,18 @@
 
 static PgSocket *old_bouncer = NULL;
 
+/* what was last asked from the old process */
+enum TakeoverStep {
+	TAKEOVER_FDS,
+	TAKEOVER_PREPARED_STATEMENTS,
+	TAKEOVER_TLS_TICKET_KEYS,
+};
+
+static enum TakeoverStep takeover_step;
+
+/* data that did not make a complete packet yet */
+static struct MBuf recv_buf;
+
 void takeover_finish(void)
 {
 	uint8_t buf[512];
@@ -59,6 +74,7 @@ void takeover_finish(void)
 
 	disconnect_server(old_bouncer, false, "disko over");
 	old_bouncer = NULL;
+	mbuf_free(&recv_buf);
 
 	if (cf_pidfile && cf_pidfile[0]) {
 		log_info("waiting for old pidfile to go away");
@@ -170,6 +186,130 @@ static void takeover_load_fd(struct MBuf *pkt, const struct cmsghdr *cmsg)
 		fatal("socket takeover failed");
 }
 
+/*
+ * The suspended sockets by the fd they had in the old process, built once
+ * after SHOW FDS.  The fds are unique among all sockets of the old process.
+ */
+static PgSocket **old_sockets;
+static int old_socket_count;
+
+/* 0: find the largest fd, 1: fill in the map */
+static void scan_old_sockets(int pass, int *maxfd)
+{
+	struct List *item, *item2;
+	struct StatList *lists[3];
+	PgPool *pool;
+	PgSocket *sk;
+	int i;
+
+	statlist_for_each(item, &pool_list) {
+		pool = container_of(item, PgPool, head);
+		lists[0] = &pool->active_client_list;
+		lists[1] = &pool->active_server_list;
+		lists[2] = &pool->idle_server_list;
+		for (i = 0; i < 3; i++) {
+			statlist_for_each(item2, lists[i]) {
+				sk = container_of(item2, PgSocket, head);
+				if (!sk->suspended)
+					continue;
+				if (pass == 0 && (int)sk->tmp_sk_oldfd > *maxfd)
+					*maxfd = sk->tmp_sk_oldfd;
+				else if (pass == 1)
+					old_sockets[sk->tmp_sk_oldfd] = sk;
+			}
+		}
+	}
+}
+
+static void build_old_socket_map(void)
+{
+	int maxfd = -1;
+
+	scan_old_sockets(0, &maxfd);
+	if (maxfd < 0)
+		return;
+	old_sockets = calloc(maxfd + 1, sizeof(*old_sockets));
+	if (!old_sockets)
+		fatal("out of memory");
+	old_socket_count = maxfd + 1;
+	scan_old_sockets(1, &maxfd);
+}
+
+static void free_old_socket_map(void)
+{
+	free(old_sockets);
+	old_sockets = NULL;
+	old_socket_count = 0;
+}
+
+/* find a socket by the fd it had in the old process */
+static PgSocket *find_old_socket(bool is_server, int oldfd)
+{
+	PgSocket *sk;
+
+	if (oldfd < 0 || oldfd >= old_socket_count)
+		return NULL;
+	sk = old_sockets[oldfd];
+	if (!sk || is_server_socket(sk) != is_server)
+		return NULL;
+	return sk;
+}
+
+/* parse one row of SHOW PREPARED_STATEMENTS */
+static void takeover_load_prepared(struct MBuf *pkt)
+{
+	char *task, *name;
+	uint8_t *data;
+	int oldfd, len;
+	int got;
+	uint64_t query_id;
+	PgSocket *sk;
+
+	got = scan_text_result(pkt, "siqsb", &task, &oldfd, &query_id, &name, &len, &data);
+	if (got < 0 || task == NULL)
+		die("invalid prepared statement data from old process");
+
+	if (strcmp(task, "statement") == 0) {
+		if (!data || !takeover_load_prepared_statement(query_id, data, len))
+			log_warning("takeover: could not load prepared statement %" PRIu64, query_id);
+	} else if (strcmp(task, "server") == 0) {
+		sk = find_old_socket(true, oldfd);
+		if (sk && !takeover_load_server_prepared_statement(sk, query_id)) {
+			/* it would not know what is prepared on it */
+			log_warning("takeover: could not load prepared statement %" PRIu64 " of server, closing it", query_id);
+			sk->close_needed = true;
+			server_timeout_update(sk);
+		}
+	} else if (strcmp(task, "client") == 0) {
+		sk = find_old_socket(false, oldfd);
+		if (sk && (!name || !takeover_load_client_prepared_statement(sk, name, query_id)))
+			log_warning("takeover: could not load prepared statement %s of client", name ? name : "NULL");
+	} else {
+		fatal("unknown task: %s", task);
+	}
+	free(data);
+}
+
+/* parse one row of SHOW TLS_TICKET_KEYS */
+static void takeover_load_ticket_key(struct MBuf *pkt)
+{
+	char *task;
+	uint8_t *key;
+	uint64_t keyrev;
+	int len;
+	int got;
+
+	got = scan_text_result(pkt, "sqb", &task, &keyrev, &len, &key);
+	if (got < 0 || task == NULL)
+		die("invalid TLS ticket key data from old process");
+
+	if (!key || !sbuf_tls_load_ticket_key(task, keyrev, key, len))
+		log_warning("takeover: could not load TLS %s", task);
+	if (key)
+		explicit_bzero(key, len);
+	free(key);
+}
+
 static void takeover_create_link(PgPool *pool, PgSocket *client)
 {
 	struct List *item;
@@ -225,6 +365,34 @@ static void takeover_postprocess_fds(void)
 	}
 }
 
+/* the result of the last command is complete */
+static void takeover_step_done(void)
+{
+	switch (takeover_step) {
+	case TAKEOVER_FDS:
+		build_old_socket_map();
+		log_info("SHOW FDS finished");
+		break;
+	case TAKEOVER_PREPARED_STATEMENTS:
+		takeover_prepared_statements_done();
+		log_info("SHOW PREPARED_STATEMENTS finished");
+		break;
+	case TAKEOVER_TLS_TICKET_KEYS:
+		sbuf_tls_ticket_keys_loaded();
+		log_info("SHOW TLS_TICKET_KEYS finished");
+		break;
+	}
+}
+
+static void takeover_loaded(PgSocket *bouncer)
+{
+	/* all fds loaded, review them */
+	free_old_socket_map();
+	takeover_postprocess_fds();
+
+	takeover_finish_part1(bouncer);
+}
+
 static void next_command(PgSocket *bouncer, struct MBuf *pkt)
 {
 	bool res = true;
@@ -238,11 +406,19 @@ static void next_command(PgSocket *bouncer, struct MBuf *pkt)
 		log_info("SUSPEND finished, sending SHOW FDS");
 		SEND_generic(res, bouncer, PqMsg_Query, "s", "SHOW FDS;");
 	} else if (strncmp(cmd, "SHOW", 4) == 0) {
-		/* all fds loaded, review them */
-		takeover_postprocess_fds();
-		log_info("SHOW FDS finished");
-
-		takeover_finish_part1(bouncer);
+		takeover_step_done();
+		if (takeover_step == TAKEOVER_FDS && cf_max_prepared_statements != 0) {
+			log_info("sending SHOW PREPARED_STATEMENTS");
+			takeover_step = TAKEOVER_PREPARED_STATEMENTS;
+			SEND_generic(res, bouncer, PqMsg_Query, "s", "SHOW PREPARED_STATEMENTS;");
+		} else if (takeover_step != TAKEOVER_TLS_TICKET_KEYS
+			   && client_accept_sslmode != SSLMODE_DISABLED) {
+			log_info("sending SHOW TLS_TICKET_KEYS");
+			takeover_step = TAKEOVER_TLS_TICKET_KEYS;
+			SEND_generic(res, bouncer, PqMsg_Query, "s", "SHOW TLS_TICKET_KEYS;");
+		} else {
+			takeover_loaded(bouncer);
+		}
 	} else {
 		fatal("got bad CMD from old bouncer: %s", cmd);
 	}
@@ -255,19 +431,31 @@ static void takeover_parse_data(PgSocket *bouncer,
 				struct msghdr *msg, struct MBuf *data)
 {
 	struct cmsghdr *cmsg;
+	struct MBuf rest;
 	PktHdr pkt;
 
 	cmsg = msg->msg_controllen ? CMSG_FIRSTHDR(msg) : NULL;
 
 	while (mbuf_avail_for_read(data) > 0) {
-		if (!get_header(data, &pkt))
+		mbuf_copy(data, &rest);
+		if (!get_header(&rest, &pkt)) {
+			if (mbuf_avail_for_read(data) < NEW_HEADER_LEN && !cmsg)
+				break;
 			fatal("cannot parse packet");
+		}
 
 		/*
-		 * There should not be partial reads from UNIX socket.
+		 * Rows with a fd always come in one read from the UNIX
+		 * socket.  Rows of prepared statements can be longer than
+		 * the read buffer, the rest of them comes with the next
+		 * read.
 		 */
-		if (incomplete_pkt(&pkt))
-			fatal("unexpected partial packet");
+		if (incomplete_pkt(&pkt)) {
+			if (cmsg || takeover_step == TAKEOVER_FDS)
+				fatal("unexpected partial packet");
+			break;
+		}
+		mbuf_copy(&rest, data);
 
 		switch (pkt.type) {
 		case PqMsg_RowDescription:
@@ -275,7 +463,11 @@ static void takeover_parse_data(PgSocket *bouncer,
 			break;
 		case PqMsg_DataRow:
 			log_debug("takeover_parse_data: DataRow");
-			if (cmsg) {
+			if (takeover_step == TAKEOVER_PREPARED_STATEMENTS) {
+				takeover_load_prepared(&pkt.data);
+			} else if (takeover_step == TAKEOVER_TLS_TICKET_KEYS) {
+				takeover_load_ticket_key(&pkt.data);
+			} else if (cmsg) {
 				takeover_load_fd(&pkt.data, cmsg);
 				cmsg = CMSG_NXTHDR(msg, cmsg);
 			} else {
@@ -291,6 +483,12 @@ static void takeover_parse_data(PgSocket *bouncer,
 			break;
 		case PqMsg_ErrorResponse:
 			log_server_error("old bouncer sent", &pkt);
+			if (takeover_step != TAKEOVER_FDS) {
+				/* older version, continue without the rest */
+				takeover_step_done();
+				takeover_loaded(bouncer);
+				break;
+			}
 			fatal("something failed");
 		default:
 			fatal("takeover_parse_data: unexpected pkt: '%c'", pkt_desc(&pkt));
@@ -311,7 +509,6 @@ static void takeover_recv_cb(evutil_socket_t sock, short flags, void *arg)
 	struct msghdr msg;
 	struct iovec io;
 	ssize_t res;
-	struct MBuf data;
 
 	memset(&msg, 0, sizeof(msg));
 	io.iov_base = data_buf;
@@ -323,8 +520,14 @@ static void takeover_recv_cb(evutil_socket_t sock, short flags, void *arg)
 
 	res = safe_recvmsg(sock, &msg, 0);
 	if (res > 0) {
-		mbuf_init_fixed_reader(&data, data_buf, res);
-		takeover_parse_data(bouncer, &msg, &data);
+		if (!mbuf_write(&recv_buf, data_buf, res))
+			fatal("out of memory");
+		takeover_parse_data(bouncer, &msg, &recv_buf);
+
+		/* keep only the incomplete packet, if any */
+		if (!mbuf_cut(&recv_buf, 0, mbuf_consumed(&recv_buf)))
+			fatal("mbuf_cut failed");
+		mbuf_rewind_reader(&recv_buf);
 	} else if (res == 0) {
 		fatal("unexpected EOF");
 	} else {
@@ -343,6 +546,7 @@ bool takeover_login(PgSocket *bouncer)
 	bool res;
 
 	slog_info(bouncer, "login OK, sending SUSPEND");
+	mbuf_init_dynamic(&recv_buf);
 	SEND_generic(res, bouncer, PqMsg_Query, "s", "SUSPEND;");
 	if (res) {
 		/* use own callback */
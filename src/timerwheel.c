@@ -0,0 +1,203 @@
+/*
+ * PgBouncer - Lightweight connection pooler for PostgreSQL.
+ *
+ * Copyright (c) 2007-2009  Marko Kreen, Skype Technologies OÜ
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Hierarchical timer wheel.
+ *
+ * A timer is put on the lowest level whose range covers its distance from
+ * the current tick.  Whenever the index of level 0 wraps around, the
+ * current slot of level 1 is cascaded, i.e. its timers are put back on the
+ * lower levels, and so on upwards.  Arming and disarming a timer is O(1),
+ * processing a tick costs the timers that fire or cascade in it.
+ */
+
+#include "bouncer.h"
+
+/* number of ticks the whole wheel covers */
+#define TW_RANGE        ((uint64_t)1 << (TW_LEVEL_BITS * TW_LEVELS))
+
+/*
+ * Advancing further than this at once is done by re-placing every timer,
+ * instead of walking all the ticks in between.  Only happens after a stall
+ * or when the clock jumps.
+ */
+#define TW_MAX_WALK     (TW_LEVEL_SIZE * TW_LEVEL_SIZE)
+
+#define level_shift(level) (TW_LEVEL_BITS * (level))
+
+void timerwheel_init(struct TimerWheel *tw, uint64_t now, void (*fire)(struct TimerEntry *entry))
+{
+	int level, i;
+
+	tw->tick = now;
+	tw->count = 0;
+	tw->fire = fire;
+	for (level = 0; level < TW_LEVELS; level++) {
+		for (i = 0; i < TW_LEVEL_SIZE; i++)
+			list_init(&tw->slots[level][i]);
+	}
+}
+
+void timerwheel_entry_init(struct TimerEntry *entry)
+{
+	list_init(&entry->node);
+	entry->expires = 0;
+}
+
+/* put timer to its slot, expires must not be before current tick */
+static void place(struct TimerWheel *tw, struct TimerEntry *entry)
+{
+	uint64_t delta = entry->expires - tw->tick;
+	int level = 0;
+
+	while (level < TW_LEVELS - 1 && delta >= ((uint64_t)1 << level_shift(level + 1)))
+		level++;
+	list_append(&tw->slots[level][(entry->expires >> level_shift(level)) & TW_LEVEL_MASK], &entry->node);
+}
+
+void timerwheel_add(struct TimerWheel *tw, struct TimerEntry *entry, uint64_t expires)
+{
+	if (timerwheel_armed(entry))
+		timerwheel_del(tw, entry);
+
+	/* the current tick has been processed already */
+	if (expires <= tw->tick)
+		expires = tw->tick + 1;
+	else if (expires - tw->tick >= TW_RANGE)
+		expires = tw->tick + TW_RANGE - 1;
+
+	entry->expires = expires;
+	place(tw, entry);
+	tw->count++;
+}
+
+void timerwheel_del(struct TimerWheel *tw, struct TimerEntry *entry)
+{
+	if (!timerwheel_armed(entry))
+		return;
+	list_del(&entry->node);
+	tw->count--;
+}
+
+static void fire_list(struct TimerWheel *tw, struct List *list)
+{
+	struct TimerEntry *entry;
+
+	while (!list_empty(list)) {
+		entry = container_of(list_pop(list), struct TimerEntry, node);
+		tw->count--;
+		tw->fire(entry);
+	}
+}
+
+/* move the timers of the current slot of the given level down */
+static int cascade(struct TimerWheel *tw, int level)
+{
+	int idx = (tw->tick >> level_shift(level)) & TW_LEVEL_MASK;
+	struct List *slot = &tw->slots[level][idx];
+	struct TimerEntry *entry;
+	LIST(tmp);
+
+	while (!list_empty(slot))
+		list_append(&tmp, list_pop(slot));
+	while (!list_empty(&tmp)) {
+		entry = container_of(list_pop(&tmp), struct TimerEntry, node);
+		place(tw, entry);
+	}
+	return idx;
+}
+
+/* re-place all timers relative to a new current tick, firing expired ones */
+static void rebase(struct TimerWheel *tw, uint64_t now)
+{
+	struct TimerEntry *entry;
+	struct List *slot;
+	int level, i;
+	LIST(all);
+	LIST(expired);
+
+	for (level = 0; level < TW_LEVELS; level++) {
+		for (i = 0; i < TW_LEVEL_SIZE; i++) {
+			slot = &tw->slots[level][i];
+			while (!list_empty(slot))
+				list_append(&all, list_pop(slot));
+		}
+	}
+
+	tw->tick = now;
+	while (!list_empty(&all)) {
+		entry = container_of(list_pop(&all), struct TimerEntry, node);
+		if (entry->expires <= now)
+			list_append(&expired, &entry->node);
+		else
+			place(tw, entry);
+	}
+	fire_list(tw, &expired);
+}
+
+/* fire all timers that expire up to and including now */
+void timerwheel_run(struct TimerWheel *tw, uint64_t now)
+{
+	int level;
+
+	if (now <= tw->tick)
+		return;
+
+	if (now - tw->tick > TW_MAX_WALK) {
+		rebase(tw, now);
+		return;
+	}
+
+	while (tw->tick < now) {
+		tw->tick++;
+		if ((tw->tick & TW_LEVEL_MASK) == 0) {
+			for (level = 1; level < TW_LEVELS; level++) {
+				if (cascade(tw, level) != 0)
+					break;
+			}
+		}
+		fire_list(tw, &tw->slots[0][tw->tick & TW_LEVEL_MASK]);
+	}
+}
+
+/*
+ * Earliest tick at which timerwheel_run() has something to do, either
+ * firing a timer or cascading a slot.  UINT64_MAX if nothing is armed.
+ */
+uint64_t timerwheel_next_tick(const struct TimerWheel *tw)
+{
+	uint64_t next = UINT64_MAX;
+	uint64_t cur, t;
+	int level, k;
+
+	if (tw->count == 0)
+		return next;
+
+	for (level = 0; level < TW_LEVELS; level++) {
+		cur = tw->tick >> level_shift(level);
+		for (k = 1; k <= TW_LEVEL_SIZE; k++) {
+			if (list_empty(&tw->slots[level][(cur + k) & TW_LEVEL_MASK]))
+				continue;
+			t = (cur + k) << level_shift(level);
+			if (t < next)
+				next = t;
+			break;
+		}
+	}
+	return next;
+}
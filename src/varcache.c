@@ -18,6 +18,14 @@
 
 /*
  * Operations with server config parameters.
+ *
+ * Values are interned, so two caches hold the same value exactly when
+ * they point to the same PStr.  The parameters that Postgres compares
+ * case-insensitively share one PStr for all spellings of a value, the
+ * one the server reported last.  Each cache also keeps a fingerprint
+ * of all its values.  Different fingerprints mean that some value
+ * differs, equal ones still need the pointers compared, as two sets of
+ * values can share a fingerprint.
  */
 
 #include "bouncer.h"
@@ -36,13 +44,124 @@ struct var_lookup {
 
 static struct var_lookup *lookup_map;
 
+/* parameter names by index */
+static const char **var_names;
+
 static struct StrPool *vpool;
 
+/*
+ * Canonical spelling of case-insensitive values, keyed by the lower-cased
+ * value.  The key is zero-terminated because HASH_KEYCMP is strcasecmp()
+ * in this file.
+ */
+struct var_fold {
+	struct PStr *value;
+	UT_hash_handle hh;
+	char key[];
+};
+
+/* longer values are not folded, varcache_apply() compares them without case */
+#define FOLD_KEY_MAX 128
+
+static struct var_fold *fold_map;
+static unsigned fold_sweep_at = 64;
+
 static inline struct PStr *get_value(VarCache *cache, const struct var_lookup *lk)
 {
 	return cache->var_list[lk->idx];
 }
 
+/* values Postgres itself compares without case */
+static bool fold_case(int idx)
+{
+	return idx == VDateStyle || idx == VClientEncoding
+	       || idx == VTimeZone || idx == VStdStr;
+}
+
+static uint64_t slot_hash(int idx, const struct PStr *val)
+{
+	uint64_t x;
+
+	if (!val)
+		return 0;
+
+	/* splitmix64 finalizer */
+	x = (uint64_t)(uintptr_t)val + (uint64_t)(idx + 1) * UINT64_C(0x9E3779B97F4A7C15);
+	x = (x ^ (x >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+	x = (x ^ (x >> 27)) * UINT64_C(0x94D049BB133111EB);
+	return x ^ (x >> 31);
+}
+
+/* store value, the reference to it is taken over by the cache */
+static void set_slot(VarCache *cache, int idx, struct PStr *val)
+{
+	struct PStr *old = cache->var_list[idx];
+
+	cache->fingerprint ^= slot_hash(idx, old) ^ slot_hash(idx, val);
+	cache->var_list[idx] = val;
+	strpool_decref(old);
+}
+
+/* forget spellings that no cache uses anymore */
+static void fold_sweep(void)
+{
+	struct var_fold *fold, *tmp;
+
+	HASH_ITER(hh, fold_map, fold, tmp) {
+		if (fold->value->refcnt > 1)
+			continue;
+		HASH_DEL(fold_map, fold);
+		strpool_decref(fold->value);
+		free(fold);
+	}
+	fold_sweep_at = 2 * HASH_COUNT(fold_map) + 64;
+}
+
+/*
+ * Get the canonical PStr for a case-insensitive value.  A spelling
+ * reported by the server replaces the earlier one.
+ */
+static struct PStr *fold_value(struct PStr *pstr, bool reported)
+{
+	struct var_fold *fold;
+	char key[FOLD_KEY_MAX];
+	size_t i;
+
+	if (pstr->len >= FOLD_KEY_MAX)
+		return pstr;
+	for (i = 0; i < pstr->len; i++)
+		key[i] = tolower((unsigned char)pstr->str[i]);
+	key[i] = '\0';
+
+	HASH_FIND(hh, fold_map, key, pstr->len, fold);
+	if (fold) {
+		if (fold->value == pstr)
+			return pstr;
+		if (reported) {
+			strpool_incref(pstr);
+			strpool_decref(fold->value);
+			fold->value = pstr;
+			return pstr;
+		}
+		strpool_incref(fold->value);
+		strpool_decref(pstr);
+		return fold->value;
+	}
+
+	if (HASH_COUNT(fold_map) >= fold_sweep_at)
+		fold_sweep();
+
+	/* unknown value, keep it as is if out of memory */
+	fold = calloc(1, sizeof(*fold) + pstr->len + 1);
+	if (!fold)
+		return pstr;
+	memcpy(fold->key, key, pstr->len);
+	strpool_incref(pstr);
+	fold->value = pstr;
+	HASH_ADD(hh, fold_map, key, pstr->len, fold);
+	return pstr;
+}
+
 static bool sl_add(void *arg, const char *s)
 {
 	return strlist_append(arg, s);
@@ -104,9 +223,15 @@ void init_var_lookup(const char *cf_track_extra_parameters)
 	init_var_lookup_from_config(cf_track_extra_parameters, &idx);
 
 	num_var_cached = idx;
+
+	var_names = calloc(num_var_cached, sizeof(*var_names));
+	if (!var_names)
+		die("out of memory");
+	for (lookup = lookup_map; lookup; lookup = lookup->hh.next)
+		var_names[lookup->idx] = lookup->name;
 }
 
-bool varcache_set(VarCache *cache, const char *key, const char *value)
+static bool set_value(VarCache *cache, const char *key, const char *value, bool reported)
 {
 	const struct var_lookup *lk = NULL;
 	struct PStr *pstr = NULL;
@@ -123,8 +248,7 @@ bool varcache_set(VarCache *cache, const char *key, const char *value)
 		return false;
 
 	/* drop old value */
-	strpool_decref(cache->var_list[lk->idx]);
-	cache->var_list[lk->idx] = NULL;
+	set_slot(cache, lk->idx, NULL);
 
 	/* NULL value? */
 	if (!value)
@@ -134,10 +258,46 @@ bool varcache_set(VarCache *cache, const char *key, const char *value)
 	pstr = strpool_get(vpool, value, strlen(value));
 	if (!pstr)
 		return false;
-	cache->var_list[lk->idx] = pstr;
+	if (fold_case(lk->idx))
+		pstr = fold_value(pstr, reported);
+	set_slot(cache, lk->idx, pstr);
 	return true;
 }
 
+bool varcache_set(VarCache *cache, const char *key, const char *value)
+{
+	return set_value(cache, key, value, false);
+}
+
+/* value sent by the server in ParameterStatus, its spelling wins */
+bool varcache_set_reported(VarCache *cache, const char *key, const char *value)
+{
+	return set_value(cache, key, value, true);
+}
+
+/*
+ * Returns the interned value without taking a reference, NULL if the
+ * parameter is not tracked or not set.  Equal values are the same PStr.
+ */
+struct PStr *varcache_get_pstr(VarCache *cache, const char *key)
+{
+	const struct var_lookup *lk = NULL;
+
+	HASH_FIND_STR(lookup_map, key, lk);
+	if (lk == NULL)
+		return NULL;
+
+	return get_value(cache, lk);
+}
+
+/* returns NULL if the parameter is not tracked or not set */
+const char *varcache_get(VarCache *cache, const char *key)
+{
+	struct PStr *pstr = varcache_get_pstr(cache, key);
+
+	return pstr ? pstr->str : NULL;
+}
+
 static bool variable_is_guc_list_quote(const char *key)
 {
 	if (strcasecmp("search_path", key) == 0)
@@ -163,10 +323,6 @@ static int apply_var(PktBuf *pkt, const char *key,
 	if (cval == sval)
 		return 0;
 
-	/* ignore case difference */
-	if (strcasecmp(cval->str, sval->str) == 0)
-		return 0;
-
 	/* parameters that are marked GUC_LIST_QUOTE are returned already fully quoted
 	 * re-quoting them using pg_quote_literal will result in malformed values. */
 	if (variable_is_guc_list_quote(key)) {
@@ -202,23 +358,51 @@ static int apply_var(PktBuf *pkt, const char *key,
 	return 1;
 }
 
+/* same value in every slot, only a pointer compare per slot */
+static bool varcache_same(const VarCache *a, const VarCache *b)
+{
+	int idx;
+
+	for (idx = 0; idx < num_var_cached; idx++) {
+		if (a->var_list[idx] != b->var_list[idx])
+			return false;
+	}
+	return true;
+}
+
 bool varcache_apply(PgSocket *server, PgSocket *client, bool *changes_p)
 {
 	int changes = 0;
 	struct PStr *cval, *sval;
-	const struct var_lookup *lk, *tmp;
+	int idx;
 	int sql_ofs;
-	struct PktBuf *pkt = pktbuf_temp();
+	struct PktBuf *pkt;
 
+	/* the usual case, nothing changed since the last client */
+	if (client->vars.fingerprint == server->vars.fingerprint
+	    && varcache_same(&client->vars, &server->vars)) {
+		*changes_p = false;
+		return true;
+	}
+
+	pkt = pktbuf_temp();
 	pktbuf_start_packet(pkt, PqMsg_Query);
 
 	/* grab query position inside pkt */
 	sql_ofs = pktbuf_written(pkt);
 
-	HASH_ITER(hh, lookup_map, lk, tmp) {
-		sval = get_value(&server->vars, lk);
-		cval = get_value(&client->vars, lk);
-		changes += apply_var(pkt, lk->name, cval, sval);
+	for (idx = 0; idx < num_var_cached; idx++) {
+		cval = client->vars.var_list[idx];
+		sval = server->vars.var_list[idx];
+
+		/* spelling from before the server reported its own */
+		if (cval && sval && cval != sval && fold_case(idx)
+		    && strcasecmp(cval->str, sval->str) == 0) {
+			strpool_incref(sval);
+			set_slot(&client->vars, idx, sval);
+			continue;
+		}
+		changes += apply_var(pkt, var_names[idx], cval, sval);
 	}
 
 	*changes_p = changes > 0;
@@ -235,17 +419,16 @@ bool varcache_apply(PgSocket *server, PgSocket *client, bool *changes_p)
 void varcache_set_canonical(PgSocket *server, PgSocket *client)
 {
 	struct PStr *server_val, *client_val;
-	const struct var_lookup *lk, *tmp;
+	int idx;
 
-	HASH_ITER(hh, lookup_map, lk, tmp) {
-		server_val = server->vars.var_list[lk->idx];
-		client_val = client->vars.var_list[lk->idx];
+	for (idx = 0; idx < num_var_cached; idx++) {
+		server_val = server->vars.var_list[idx];
+		client_val = client->vars.var_list[idx];
 		if (client_val && server_val && client_val != server_val) {
 			slog_debug(client, "varcache_set_canonical: setting %s to its canonical version %s -> %s",
-				   lk->name, client_val->str, server_val->str);
+				   var_names[idx], client_val->str, server_val->str);
 			strpool_incref(server_val);
-			strpool_decref(client_val);
-			client->vars.var_list[lk->idx] = server_val;
+			set_slot(&client->vars, idx, server_val);
 		}
 	}
 }
@@ -267,15 +450,14 @@ void varcache_apply_startup(PktBuf *pkt, PgSocket *client)
 
 void varcache_fill_unset(VarCache *src, PgSocket *dst)
 {
-	struct PStr *srcval, *dstval;
-	const struct var_lookup *lk, *tmp;
+	struct PStr *srcval;
+	int idx;
 
-	HASH_ITER(hh, lookup_map, lk, tmp) {
-		srcval = src->var_list[lk->idx];
-		dstval = dst->vars.var_list[lk->idx];
-		if (!dstval) {
+	for (idx = 0; idx < num_var_cached; idx++) {
+		srcval = src->var_list[idx];
+		if (srcval && !dst->vars.var_list[idx]) {
 			strpool_incref(srcval);
-			dst->vars.var_list[lk->idx] = srcval;
+			set_slot(&dst->vars, idx, srcval);
 		}
 	}
 }
@@ -286,6 +468,7 @@ void varcache_clean(VarCache *cache)
 		strpool_decref(cache->var_list[i]);
 		cache->var_list[i] = NULL;
 	}
+	cache->fingerprint = 0;
 }
 
 void varcache_add_params(PktBuf *pkt, VarCache *vars)
@@ -302,6 +485,13 @@ void varcache_add_params(PktBuf *pkt, VarCache *vars)
 
 void varcache_deinit(void)
 {
+	struct var_fold *fold, *tmp;
+
+	HASH_ITER(hh, fold_map, fold, tmp) {
+		HASH_DEL(fold_map, fold);
+		strpool_decref(fold->value);
+		free(fold);
+	}
 	strpool_free(vpool);
 	vpool = NULL;
 }
@@ -0,0 +1,147 @@
+/*
+ * Microbenchmark for the lookup of prepared statements in the global
+ * query hash (see src/prepare.c).
+ *
+ * Compares the old way, HASH_BER over the whole query on every lookup,
+ * against xxhash computed once and passed to HASH_FIND_BYHASHVALUE.
+ *
+ * Usage: hashbench [-n lookups] [-s statements]
+ */
+
+#ifdef WIN32
+#undef strerror
+#undef main
+#endif
+
+#include <usual/base.h>
+#include <usual/getopt.h>
+#include <usual/time.h>
+#include <usual/hashing/xxhash.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HASH_FUNCTION HASH_BER
+#include "common/uthash.h"
+
+typedef struct Entry {
+	UT_hash_handle hh;
+	size_t len;
+	char query[];
+} Entry;
+
+static const size_t query_sizes[] = { 64, 1024, 20 * 1024 };
+
+/* queries of equal length that only differ at the end, like ORM output */
+static char *make_query(size_t len, int id)
+{
+	char *q = malloc(len);
+	size_t i;
+
+	if (!q)
+		abort();
+	for (i = 0; i < len; i++)
+		q[i] = 'a' + (i % 26);
+	snprintf(q + len - 12, 12, "%011d", id);
+	return q;
+}
+
+static Entry *make_entry(const char *query, size_t len)
+{
+	Entry *e = malloc(sizeof(Entry) + len);
+
+	if (!e)
+		abort();
+	e->len = len;
+	memcpy(e->query, query, len);
+	return e;
+}
+
+static void run(size_t len, int nstmts, int nlookups)
+{
+	Entry *ber_hash = NULL, *xx_hash = NULL, *e, *tmp;
+	char **queries;
+	usec_t start, ber_time, xx_time;
+	unsigned hashv;
+	int i, found = 0;
+
+	queries = calloc(nstmts, sizeof(char *));
+	if (!queries)
+		abort();
+	for (i = 0; i < nstmts; i++) {
+		queries[i] = make_query(len, i);
+		e = make_entry(queries[i], len);
+		HASH_ADD_KEYPTR(hh, ber_hash, e->query, len, e);
+		e = make_entry(queries[i], len);
+		hashv = xxhash(queries[i], len, 0);
+		HASH_ADD_KEYPTR_BYHASHVALUE(hh, xx_hash, e->query, len, hashv, e);
+	}
+
+	start = get_time_usec();
+	for (i = 0; i < nlookups; i++) {
+		HASH_FIND(hh, ber_hash, queries[i % nstmts], len, e);
+		found += e != NULL;
+	}
+	ber_time = get_time_usec() - start;
+
+	start = get_time_usec();
+	for (i = 0; i < nlookups; i++) {
+		hashv = xxhash(queries[i % nstmts], len, 0);
+		HASH_FIND_BYHASHVALUE(hh, xx_hash, queries[i % nstmts], len, hashv, e);
+		found += e != NULL;
+	}
+	xx_time = get_time_usec() - start;
+
+	if (found != 2 * nlookups) {
+		fprintf(stderr, "lookup failed\n");
+		exit(1);
+	}
+
+	printf("%6zu bytes: ber %8.1f ns/lookup, xxhash %8.1f ns/lookup\n",
+	       len,
+	       (double)ber_time * 1000 / nlookups,
+	       (double)xx_time * 1000 / nlookups);
+
+	HASH_ITER(hh, ber_hash, e, tmp) {
+		HASH_DEL(ber_hash, e);
+		free(e);
+	}
+	HASH_ITER(hh, xx_hash, e, tmp) {
+		HASH_DEL(xx_hash, e);
+		free(e);
+	}
+	for (i = 0; i < nstmts; i++)
+		free(queries[i]);
+	free(queries);
+}
+
+int main(int argc, char *argv[])
+{
+	int nlookups = 100000;
+	int nstmts = 1000;
+	unsigned i;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:s:")) != -1) {
+		switch (c) {
+		case 'n':
+			nlookups = atoi(optarg);
+			break;
+		case 's':
+			nstmts = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n lookups] [-s statements]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (nlookups <= 0 || nstmts <= 0) {
+		fprintf(stderr, "counts must be positive\n");
+		return 1;
+	}
+
+	for (i = 0; i < ARRAY_NELEM(query_sizes); i++)
+		run(query_sizes[i], nstmts, nlookups);
+	return 0;
+}
@@ -78,6 +78,7 @@ def test_show_user(bouncer):
 def test_show(bouncer):
     show_items = [
         "clients",
+        "compression",
         "config",
         "databases",
         # Calling SHOW FDS on MacOS leaks the returned file descriptors to the
@@ -89,6 +90,7 @@ def test_show(bouncer):
         "peers",
         "peer_pools",
         "pools",
+        "prepared_statements",
         "servers",
         "sockets",
         "active_sockets",
@@ -1,3 +1,4 @@
+import asyncio
 import getpass
 import re
 import subprocess
@@ -90,6 +91,75 @@ def test_auth_user(pg, bouncer):
     bouncer.test(user="someuser", password="anypasswd")
 
 
+@pytest.mark.md5
+def test_auth_query_cache(pg, bouncer):
+    bouncer.default_db = "authdb"
+    bouncer.admin(f"set auth_type='md5'")
+    bouncer.admin(f"set auth_query_cache_ttl=60")
+    bouncer.test(user="someuser", password="anypasswd")
+
+    pg.sql("ALTER USER someuser VALID UNTIL '1999-01-01'")
+
+    # the cached password is still used
+    bouncer.test(user="someuser", password="anypasswd")
+
+    # a failed login drops it, so the next login runs auth_query again
+    with pytest.raises(
+        psycopg.OperationalError, match="(SASL|password) authentication failed"
+    ):
+        bouncer.test(user="someuser", password="badpasswd")
+    with pytest.raises(
+        psycopg.OperationalError, match="password authentication failed"
+    ):
+        bouncer.test(user="someuser", password="anypasswd")
+
+    pg.sql("ALTER USER someuser VALID UNTIL 'infinity'")
+    bouncer.test(user="someuser", password="anypasswd")
+
+
+@pytest.mark.md5
+async def test_auth_query_concurrent_logins(pg, bouncer):
+    # a slow auth_query that records every call, so that all logins arrive
+    # while the first one is still running
+    pg.sql("CREATE TABLE auth_query_calls (usename text)", dbname="p1")
+    pg.sql(
+        """
+        CREATE OR REPLACE FUNCTION auth_query_counted(username TEXT)
+        RETURNS TABLE(usename name, passwd text) AS $$
+        BEGIN
+            INSERT INTO auth_query_calls VALUES (username);
+            PERFORM pg_sleep(1);
+            RETURN QUERY SELECT u.usename, u.passwd FROM pg_shadow u WHERE u.usename = username;
+        END;
+        $$ LANGUAGE plpgsql SECURITY DEFINER;
+        """,
+        dbname="p1",
+    )
+
+    try:
+        bouncer.default_db = "authdb"
+        bouncer.admin(f"set auth_type='md5'")
+        bouncer.admin(f"set auth_query='SELECT * FROM auth_query_counted($1)'")
+
+        # logins that wait for the auth_query of another one get its result
+        await asyncio.gather(
+            *[bouncer.atest(user="someuser", password="anypasswd") for _ in range(20)]
+        )
+        with pytest.raises(psycopg.OperationalError, match="no such user"):
+            await asyncio.gather(
+                *[bouncer.atest(user="nouser", password="anypasswd") for _ in range(5)]
+            )
+
+        # each user was looked up by a single query
+        assert pg.sql(
+            "SELECT usename, count(*) FROM auth_query_calls GROUP BY 1 ORDER BY 1",
+            dbname="p1",
+        ) == [("nouser", 1), ("someuser", 1)]
+    finally:
+        pg.sql("DROP FUNCTION IF EXISTS auth_query_counted(TEXT)", dbname="p1")
+        pg.sql("DROP TABLE IF EXISTS auth_query_calls", dbname="p1")
+
+
 @pytest.mark.md5
 def test_auth_dbname_global(bouncer):
     bouncer.admin(f"set auth_dbname='authdb'")
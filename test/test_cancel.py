@@ -3,6 +3,7 @@ from concurrent.futures import ThreadPoolExecutor
 
 import psycopg
 import pytest
+from psycopg.rows import dict_row
 
 
 def test_cancel(bouncer):
@@ -116,3 +117,78 @@ def test_cancel_race(bouncer):
     finally:
         conn1.close()
         conn2.close()
+
+
+def cancel_standby_count(bouncer, dbname, expected):
+    for _ in range(50):
+        servers = bouncer.admin("show servers", row_factory=dict_row)
+        count = sum(
+            1
+            for s in servers
+            if s["database"] == dbname and s["state"] == "cancel_standby"
+        )
+        if count == expected:
+            return count
+        time.sleep(0.1)
+    return count
+
+
+def cancel_query(bouncer, cur):
+    with ThreadPoolExecutor(max_workers=2) as pool:
+        query = pool.submit(cur.execute, "select pg_sleep(5)")
+        time.sleep(1)
+
+        with bouncer.log_contains(r"closing because: successfully sent cancel request"):
+            cancel = pool.submit(cur.connection.cancel)
+            cancel.result()
+            with pytest.raises(
+                psycopg.errors.QueryCanceled, match="due to user request"
+            ):
+                query.result()
+
+
+# Test that connections are kept ready for cancel requests once one arrived,
+# that they are replaced after use, and closed when no more requests come.
+def test_cancel_standby(bouncer):
+    bouncer.admin("set cancel_pool_size=2")
+    bouncer.admin("set cancel_standby_lifetime=3")
+
+    with bouncer.cur(dbname="p3") as cur:
+        time.sleep(1)
+        assert cancel_standby_count(bouncer, "p3", 0) == 0
+
+        cancel_query(bouncer, cur)
+        assert cancel_standby_count(bouncer, "p3", 2) == 2
+
+        cancel_query(bouncer, cur)
+        assert cancel_standby_count(bouncer, "p3", 2) == 2
+
+        time.sleep(3)
+        assert cancel_standby_count(bouncer, "p3", 0) == 0
+
+    bouncer.admin("set cancel_standby_lifetime=30")
+    bouncer.admin("set cancel_pool_size=0")
+
+
+# Connections kept ready for cancel requests must not take the place of
+# server connections in the pool or in the database limit.
+def test_cancel_standby_full_pool(bouncer):
+    bouncer.admin("set default_pool_size=2")
+    bouncer.admin("set max_db_connections=2")
+    bouncer.admin("set query_wait_timeout=3")
+    bouncer.admin("set cancel_pool_size=2")
+
+    with bouncer.cur(dbname="p3") as cur1:
+        cancel_query(bouncer, cur1)
+        assert cancel_standby_count(bouncer, "p3", 2) == 2
+        with bouncer.cur(dbname="p3") as cur2:
+            cur1.execute("select 1")
+            cur2.execute("select 1")
+
+            pools = bouncer.admin("show pools", row_factory=dict_row)
+            p3 = next(p for p in pools if p["database"] == "p3")
+            assert p3["sv_active"] == 2
+            assert p3["sv_active_cancel"] == 0
+            assert cancel_standby_count(bouncer, "p3", 2) == 2
+
+    bouncer.admin("set cancel_pool_size=0")
@@ -247,6 +247,22 @@ async def test_min_pool_size(pg, bouncer):
     assert pg.connection_count(dbname="p0", users=("postgres",)) == 5
 
 
+async def test_predictive_prewarm(pg, bouncer):
+    # A load profile of 2 busy servers for every time slot of the day
+    # should make the forced user pool of p1 pre-open 2 connections
+    # after a restart, without any client connecting.
+    state_file = bouncer.config_dir / "load_profile"
+    with state_file.open("w") as f:
+        f.write("# pgbouncer load profile v1\n")
+        f.write("p1\tbouncer\t" + " ".join(["32"] * 96) + "\n")
+    bouncer.write_ini("predictive_prewarm = 1")
+    bouncer.write_ini(f"predictive_prewarm_state_file = {state_file}")
+    await bouncer.restart()
+
+    await asyncio.sleep(2)
+    assert pg.connection_count("p1") == 2
+
+
 @pytest.mark.parametrize(
     ("test_db", "test_user"),
     [
@@ -5,9 +5,11 @@ import time
 
 import psycopg
 import pytest
+from psycopg.rows import dict_row
 
 from .utils import (
     HAVE_IPV6_LOCALHOST,
+    LIBPQ_SUPPORTS_PIPELINING,
     LINUX,
     LONG_PASSWORD,
     PG_MAJOR_VERSION,
@@ -15,6 +17,8 @@ from .utils import (
     PKT_BUF_SIZE,
     USE_UNIX_SOCKETS,
     WINDOWS,
+    ZLIB_SUPPORT,
+    Bouncer,
 )
 
 
@@ -631,6 +635,80 @@ def test_startup_message_larger_than_pktbuf(bouncer):
     bouncer.test(options=f"-c extra_float_digits={long_string}")
 
 
+def test_result_spool(bouncer):
+    bouncer.admin("set result_spool_size = 65536")
+    bouncer.admin("set result_spool_file_size = 1048576")
+    with bouncer.cur(dbname="p3x") as cur:
+        for _ in range(3):
+            cur.execute("select repeat('x', 1000) from generate_series(1, 5000)")
+            rows = cur.fetchall()
+            assert len(rows) == 5000
+            assert all(row[0] == "x" * 1000 for row in rows)
+        assert cur.execute("select 1").fetchone()[0] == 1
+
+
+def test_result_spool_releases_server(bouncer):
+    # With a single server, a second client only gets it while the first
+    # one has not read its result if the result was spooled.
+    bouncer.admin("set default_pool_size = 1")
+    bouncer.admin("set query_wait_timeout = 5")
+    bouncer.admin("set result_spool_size = 65536")
+    bouncer.admin("set result_spool_file_size = 104857600")
+    with bouncer.conn(dbname="p3x") as slow, bouncer.cur(dbname="p3x") as cur:
+        slow.pgconn.send_query(
+            b"select repeat('x', 1000) from generate_series(1, 50000)"
+        )
+        time.sleep(1)
+        assert cur.execute("select 1").fetchone()[0] == 1
+
+        assert slow.pgconn.get_result().ntuples == 50000
+        assert slow.pgconn.get_result() is None
+
+    # over result_spool_total_size the server waits for the client again
+    bouncer.admin("set result_spool_total_size = 65536")
+    with bouncer.conn(dbname="p3x") as slow, bouncer.cur(dbname="p3x") as cur:
+        slow.pgconn.send_query(
+            b"select repeat('x', 1000) from generate_series(1, 50000)"
+        )
+        time.sleep(1)
+        with pytest.raises(psycopg.OperationalError, match="query_wait_timeout"):
+            cur.execute("select 1")
+        assert slow.pgconn.get_result().ntuples == 50000
+
+
+@pytest.mark.skipif("not ZLIB_SUPPORT", reason="pgbouncer is built without zlib")
+async def test_server_compression(pg, bouncer, tmp_path):
+    upstream = Bouncer(pg, tmp_path / "upstream")
+    with upstream.ini_path.open("a") as f:
+        f.write("client_compression = 1\n")
+    await upstream.start()
+
+    try:
+        with bouncer.ini_path.open("a") as f:
+            f.write("[databases]\n")
+            f.write(
+                f"chained = host=127.0.0.1 port={upstream.port} dbname=p3x user=bouncer"
+                " server_compression=enable\n"
+            )
+        bouncer.admin("reload")
+
+        with bouncer.cur(dbname="chained") as cur:
+            cur.execute("select repeat('x', 1000) from generate_series(1, 1000)")
+            assert len(cur.fetchall()) == 1000
+
+        for admin in (bouncer, upstream):
+            stats = {
+                row["direction"]: row
+                for row in admin.admin("show compression", row_factory=dict_row)
+            }
+            assert stats["send"]["raw_bytes"] > 0
+            assert stats["recv"]["raw_bytes"] > 0
+        # the upstream sent the repetitive result, it must have shrunk
+        assert stats["send"]["raw_bytes"] > 10 * stats["send"]["wire_bytes"]
+    finally:
+        await upstream.cleanup()
+
+
 def test_empty_application_name(bouncer):
     with bouncer.cur(dbname="p1", application_name="") as cur:
         assert cur.execute("SHOW application_name").fetchone()[0] == ""
@@ -659,6 +737,37 @@ def test_equivalent_startup_param(bouncer):
             cur.execute("SELECT 1")
 
 
+def test_case_insensitive_startup_param(bouncer):
+    bouncer.admin("set verbose=2")
+    bouncer.admin("set pool_mode=transaction")
+    # let a server report its spelling first
+    bouncer.test()
+
+    with bouncer.cur(options="-c standard_conforming_strings=ON") as cur:
+        with bouncer.log_contains("varcache_apply: .*SET", times=0):
+            cur.execute("SELECT 1")
+            cur.execute("SELECT 1")
+        assert cur.execute("SHOW standard_conforming_strings").fetchone()[0] == "on"
+
+
+def test_case_insensitive_set(bouncer):
+    bouncer.admin("set verbose=2")
+    bouncer.admin("set pool_mode=transaction")
+    bouncer.admin("set default_pool_size=1")
+
+    with bouncer.cur() as cur1, bouncer.cur(
+        options="-c standard_conforming_strings=On"
+    ) as cur2:
+        cur1.execute("SET standard_conforming_strings = 'ON'")
+        # both clients share the server, the spellings only differ in
+        # case, so it is never sent a SET
+        with bouncer.log_contains("varcache_apply: .*SET", times=0):
+            for _ in range(3):
+                cur1.execute("SELECT 1")
+                cur2.execute("SELECT 1")
+        assert cur2.execute("SHOW standard_conforming_strings").fetchone()[0] == "on"
+
+
 @pytest.mark.skipif("WINDOWS", reason="Windows doesn't support sending SIGTERM")
 async def test_repeated_sigterm(bouncer):
     with bouncer.cur() as cur:
@@ -894,3 +1003,144 @@ async def test_server_login_large_packets(bouncer):
     # Simply connecting exercises the server login path: the server sends
     # ParameterStatus, BackendKeyData, ReadyForQuery etc.
     bouncer.test()
+
+
+def setup_read_only_routing(bouncer):
+    with bouncer.ini_path.open() as f:
+        original = f.read()
+    with bouncer.ini_path.open("w") as f:
+        new = re.sub(
+            r"^\[databases\]$",
+            "[databases]\n"
+            f"rw = host={bouncer.pg.host} port={bouncer.pg.port} dbname=p0 user=bouncer pool_mode=transaction replicas=ro\n"
+            f"ro = host={bouncer.pg.host} port={bouncer.pg.port} dbname=p0 user=bouncer pool_mode=transaction",
+            original,
+            flags=re.MULTILINE,
+        )
+        f.write(new)
+    bouncer.admin("reload")
+
+
+def routed_xact_counts(bouncer):
+    stats = bouncer.admin("SHOW STATS", row_factory=dict_row)
+    return {
+        s["database"]: s["total_xact_count"]
+        for s in stats
+        if s["database"] in ("rw", "ro")
+    }
+
+
+def test_read_only_routing(bouncer):
+    setup_read_only_routing(bouncer)
+
+    def xact_counts():
+        return routed_xact_counts(bouncer)
+
+    with bouncer.cur(dbname="rw") as cur:
+        cur.execute("BEGIN READ ONLY")
+        cur.execute("SELECT 1")
+        cur.execute("COMMIT")
+        cur.execute("SELECT 1")
+        assert xact_counts() == {"rw": 1, "ro": 1}
+
+        bouncer.admin("set read_only_routing=select")
+        cur.execute("SELECT 1")
+        cur.execute("SELECT 1 FOR UPDATE")
+        assert xact_counts() == {"rw": 2, "ro": 2}
+
+        # between transactions the client is back on its own database
+        cur.execute("SELECT 1")
+        clients = bouncer.admin("SHOW CLIENTS", row_factory=dict_row)
+        assert [c["database"] for c in clients if c["database"] != "pgbouncer"] == [
+            "rw"
+        ]
+
+
+@pytest.mark.skipif("not LIBPQ_SUPPORTS_PIPELINING")
+def test_read_only_routing_pipeline(bouncer):
+    setup_read_only_routing(bouncer)
+    bouncer.admin("set read_only_routing=select")
+
+    bouncer.pg.sql("CREATE TABLE routing_pipeline (i int)", dbname="p0")
+    try:
+        with bouncer.conn(dbname="rw") as conn:
+            before = routed_xact_counts(bouncer)
+
+            # a write later in the same batch keeps the SELECT on the primary
+            with conn.pipeline():
+                curs = [conn.cursor() for _ in range(2)]
+                curs[0].execute("SELECT 1")
+                curs[1].execute("INSERT INTO routing_pipeline VALUES (1)")
+            assert curs[0].fetchall() == [(1,)]
+
+            after = routed_xact_counts(bouncer)
+            assert after.get("ro", 0) == before.get("ro", 0)
+            assert after["rw"] > before["rw"]
+    finally:
+        bouncer.pg.sql("DROP TABLE routing_pipeline", dbname="p0")
+
+
+async def test_pkt_buf_max(pg, tmp_path):
+    bouncer = Bouncer(pg, tmp_path / "bouncer")
+    with bouncer.ini_path.open("a") as f:
+        f.write("pkt_buf_max = 65536\n")
+    await bouncer.start()
+
+    try:
+        caches = [row[0] for row in bouncer.admin("show mem")]
+        assert "iobuf_cache" in caches
+        assert "iobuf_cache_65536" in caches
+
+        with bouncer.cur() as cur:
+            cur.execute("select repeat('x', 1000) from generate_series(1, 10000)")
+            assert len(cur.fetchall()) == 10000
+
+        # the buffers are given back once the result is through, but the
+        # larger class must have been allocated from
+        memtotal = {row[0]: row[4] for row in bouncer.admin("show mem")}
+        assert memtotal["iobuf_cache_8192"] > 0
+    finally:
+        await bouncer.cleanup()
+
+
+def test_slab_trim(bouncer):
+    bouncer.admin("set max_client_conn=300")
+
+    def reserved():
+        return {row[0]: row[6] for row in bouncer.admin("show mem")}["client_cache"]
+
+    conns = [bouncer.conn(dbname="p3x") for _ in range(250)]
+    peak = reserved()
+    for conn in conns:
+        conn.close()
+
+    # the janitor gives the chunks of the closed clients back
+    for _ in range(50):
+        if reserved() < peak:
+            break
+        time.sleep(0.1)
+    assert 0 < reserved() < peak
+
+
+@pytest.mark.skipif("not LINUX", reason="huge page arena is only supported on Linux")
+async def test_huge_page_arena(pg, tmp_path):
+    bouncer = Bouncer(pg, tmp_path / "bouncer")
+    with bouncer.ini_path.open("a") as f:
+        f.write("huge_page_arena_size = 4194304\n")
+    await bouncer.start()
+
+    try:
+        with bouncer.cur() as cur:
+            cur.execute("select 1")
+
+        mem = {row[0]: row for row in bouncer.admin("show mem")}
+        if "huge_page_arena" not in mem:
+            pytest.skip("huge pages not available")
+        name, size, used, free, memtotal, memused, memreserved = mem[
+            "huge_page_arena"
+        ]
+        # the client, server and their buffers come from the arena
+        assert used > 0
+        assert 0 < memused <= memtotal <= memreserved == 4194304
+    finally:
+        await bouncer.cleanup()
@@ -1,10 +1,13 @@
 import asyncio
+import socket
+import struct
 import time
 from concurrent.futures import ThreadPoolExecutor
 from typing import Dict
 
 import psycopg
 import pytest
+from psycopg.rows import dict_row
 
 from .utils import LINUX, Bouncer
 
@@ -71,6 +74,61 @@ def test_peering_with_own_index(peers):
                     query.result()
 
 
+def test_peering_link(peers):
+    for bouncer in peers.values():
+        bouncer.admin("set peer_link=1")
+        bouncer.admin("set peer_link_secret='s3cret'")
+
+    with peers[1].cur() as cur:
+        with ThreadPoolExecutor(max_workers=2) as pool:
+            for _ in range(10):
+                query = pool.submit(cur.execute, "select pg_sleep(5)")
+                time.sleep(0.5)
+                cancel = pool.submit(cur.connection.cancel)
+                cancel.result()
+                with pytest.raises(
+                    psycopg.errors.QueryCanceled, match="due to user request"
+                ):
+                    query.result()
+
+    # all forwarded cancels went over at most one link per peer
+    for bouncer in peers.values():
+        for peer_pool in bouncer.admin("show peer_pools", row_factory=dict_row):
+            assert peer_pool["sv_active_cancel"] <= 1
+
+
+def open_peer_link(bouncer, peer_id, secret):
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.connect(f"{bouncer.admin_host}/.s.PGSQL.{bouncer.port}")
+    body = struct.pack("!ii", 80877150, peer_id) + secret + b"\0"
+    sock.sendall(struct.pack("!i", len(body) + 4) + body)
+    sock.settimeout(1)
+    return sock
+
+
+def test_peering_link_refused(peers):
+    peers[1].admin("set peer_link_secret='s3cret'")
+
+    with peers[1].log_contains("peer link refused", times=3):
+        # wrong secret, unknown peer, own peer id
+        for peer_id, secret in [(2, b"wrong"), (9, b"s3cret"), (1, b"s3cret")]:
+            with open_peer_link(peers[1], peer_id, secret) as sock:
+                assert sock.recv(1) == b""
+
+    # a configured peer with the right secret keeps its link open
+    with peers[1].log_contains("peer link refused", times=0):
+        with open_peer_link(peers[1], 2, b"s3cret") as sock:
+            with pytest.raises(socket.timeout):
+                sock.recv(1)
+
+    # the secret is not shown
+    config = {
+        row["key"]: row["value"]
+        for row in peers[1].admin("show config", row_factory=dict_row)
+    }
+    assert config["peer_link_secret"] == "********"
+
+
 async def test_rolling_restart_admin(peers):
     # Stop 2 of the 3 peers, so that we know we connect to peer 1
     await peers[2].stop()
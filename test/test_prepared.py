@@ -6,7 +6,7 @@ import pytest
 from psycopg import pq, sql
 from psycopg.rows import dict_row
 
-from .utils import LIBPQ_SUPPORTS_PIPELINING, LINUX, PKT_BUF_SIZE, USE_SUDO
+from .utils import LIBPQ_SUPPORTS_PIPELINING, LINUX, PKT_BUF_SIZE, USE_SUDO, WINDOWS
 
 
 def test_prepared_statement(bouncer):
@@ -508,6 +508,36 @@ def test_pipeline_flushes_on_full_pkt_buf(bouncer):
         conn.pgconn.exit_pipeline_mode()
 
 
+# Rewritten Bind and Execute packets are batched and sent to the server
+# together.  Send a pipeline that is much larger than pkt_buf, so the batch
+# is sent early and packets are split over several reads, and check that all
+# results arrive in order.
+@pytest.mark.skipif("not LIBPQ_SUPPORTS_PIPELINING")
+def test_prepared_statement_pipeline_batching(bouncer):
+    n_executes = 200
+    param = "x" * (PKT_BUF_SIZE // 10)
+
+    with bouncer.conn() as conn:
+        conn.pgconn.enter_pipeline_mode()
+        conn.pgconn.send_prepare(b"batched", b"SELECT $1::int, $2::text")
+        for i in range(n_executes):
+            conn.pgconn.send_query_prepared(
+                b"batched", [str(i).encode(), param.encode()]
+            )
+        conn.pgconn.pipeline_sync()
+
+        assert conn.pgconn.get_result().status == pq.ExecStatus.COMMAND_OK
+        assert conn.pgconn.get_result() is None
+        for i in range(n_executes):
+            res = conn.pgconn.get_result()
+            assert res.status == pq.ExecStatus.TUPLES_OK
+            assert res.get_value(0, 0) == str(i).encode()
+            assert res.get_value(0, 1) == param.encode()
+            assert conn.pgconn.get_result() is None
+        assert conn.pgconn.get_result().status == pq.ExecStatus.PIPELINE_SYNC
+        conn.pgconn.exit_pipeline_mode()
+
+
 # This resolves a bug where we would incorrectly release a server connection
 # even though there were still requests in flight. This was causing a weird
 # errors in Npgsql, because halfway through the second transaction its
@@ -637,3 +667,91 @@ def test_prepared_statement_counters(bouncer):
     assert p0_stats["total_server_parse_count"] == 2
     # 2 executions with prepare=True + 3 re-use executions
     assert p0_stats["total_bind_count"] == 5
+
+
+def test_prepared_statement_cache_mem(bouncer):
+    bouncer.admin(f"set pool_mode=transaction")
+    bouncer.admin(f"set prepared_statement_cache_size=1000000")
+    with bouncer.cur() as cur:
+        for i in range(3):
+            cur.execute(f"SELECT {i}", prepare=True)
+
+    mem = bouncer.admin("SHOW MEM", row_factory=dict_row)
+    ps_mem = next(m for m in mem if m["name"] == "prepared_statements")
+    # the client is gone, but the queries are kept in the cache
+    assert ps_mem["used"] + ps_mem["free"] == 3
+    assert ps_mem["memtotal"] > 0
+
+
+def test_prepared_statement_describe_cache(bouncer):
+    bouncer.admin(f"set pool_mode=transaction")
+    bouncer.admin(f"set max_prepared_statements=100")
+    bouncer.admin(f"set prepared_statement_describe_cache=1")
+
+    for _ in range(2):
+        with bouncer.conn() as conn:
+            result = conn.pgconn.prepare(b"test", b"SELECT $1::text, 1 AS b")
+            assert result.status == pq.ExecStatus.COMMAND_OK
+            # only the first Describe goes to the server, the rest are
+            # answered from the cache
+            for _ in range(2):
+                result = conn.pgconn.describe_prepared(b"test")
+                assert result.status == pq.ExecStatus.COMMAND_OK
+                assert result.nparams == 1
+                assert result.nfields == 2
+                assert result.fname(1) == b"b"
+            result = conn.pgconn.exec_prepared(b"test", (b"abc",))
+            assert result.status == pq.ExecStatus.TUPLES_OK
+            assert result.get_value(0, 0) == b"abc"
+
+    stats = bouncer.admin("SHOW STATS", row_factory=dict_row)
+    p0_stats = next(s for s in stats if s["database"] == "p0")
+    assert p0_stats["total_describe_cache_hit_count"] == 3
+
+    # RECONNECT invalidates the cache, so the next Describe is a miss
+    bouncer.admin("RECONNECT")
+    with bouncer.conn() as conn:
+        result = conn.pgconn.prepare(b"test", b"SELECT $1::text, 1 AS b")
+        assert result.status == pq.ExecStatus.COMMAND_OK
+        result = conn.pgconn.describe_prepared(b"test")
+        assert result.status == pq.ExecStatus.COMMAND_OK
+        assert result.nfields == 2
+
+    stats = bouncer.admin("SHOW STATS", row_factory=dict_row)
+    p0_stats = next(s for s in stats if s["database"] == "p0")
+    assert p0_stats["total_describe_cache_hit_count"] == 3
+
+
+def test_prepared_statement_preprepare(bouncer):
+    bouncer.admin(f"set pool_mode=transaction")
+    bouncer.admin(f"set prepared_statement_preprepare=10")
+    with bouncer.cur() as cur1:
+        with bouncer.cur() as cur2:
+            cur1.execute("SELECT 1", prepare=True)
+            with cur1.connection.transaction():
+                # Claim server 1 with client 1
+                cur1.execute("SELECT 2")
+                # Client 2 gets a new server, on which the statement of
+                # client 1 was prepared right after login
+                cur2.execute(
+                    "SELECT statement FROM pg_prepared_statements WHERE NOT from_sql"
+                )
+                assert cur2.fetchall() == [("SELECT 1",)]
+
+
+@pytest.mark.skipif("WINDOWS", reason="gets stuck for some reason during takeover")
+async def test_prepared_statement_takeover(bouncer):
+    # long enough to need more than one read during takeover
+    long_query = b"SELECT $1::text" + b" " * PKT_BUF_SIZE * 2
+    with bouncer.conn() as conn:
+        result = conn.pgconn.prepare(b"short", b"SELECT $1::text")
+        assert result.status == pq.ExecStatus.COMMAND_OK
+        result = conn.pgconn.prepare(b"long", long_query)
+        assert result.status == pq.ExecStatus.COMMAND_OK
+
+        await bouncer.reboot()
+
+        for name in [b"short", b"long"]:
+            result = conn.pgconn.exec_prepared(name, (b"abc",))
+            assert result.status == pq.ExecStatus.TUPLES_OK
+            assert result.get_value(0, 0) == b"abc"
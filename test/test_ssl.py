@@ -1,3 +1,6 @@
+import socket
+import ssl
+import struct
 import subprocess
 import time
 
@@ -50,6 +53,46 @@ def test_server_ssl(pg, bouncer_tls, cert_dir):
         pg.reload()
     bouncer_tls.test()
 
+    totals = dict(bouncer_tls.admin("SHOW TOTALS"))
+    assert totals["total_server_tls_connect_count"] >= 1
+
+
+async def test_server_ssl_resumption(pg, bouncer_tls, cert_dir, tmp_path):
+    """
+    PostgreSQL does not resume TLS sessions, so put a pgbouncer that does in
+    front of it and check that the second server connection resumes the
+    session of the first one.
+    """
+    root = cert_dir / "TestCA1" / "ca.crt"
+    key = cert_dir / "TestCA1" / "sites" / "01-localhost.key"
+    cert = cert_dir / "TestCA1" / "sites" / "01-localhost.crt"
+    bouncer_tls.admin(f"set client_tls_key_file = '{key}'")
+    bouncer_tls.admin(f"set client_tls_cert_file = '{cert}'")
+    bouncer_tls.admin(f"set client_tls_ca_file = '{root}'")
+    bouncer_tls.admin(f"set client_tls_sslmode = require")
+
+    outer = Bouncer(pg, tmp_path / "outer")
+    outer.write_ini("server_tls_sslmode = require")
+    outer.write_ini("[databases]")
+    outer.write_ini(
+        f"tls_p0 = host={bouncer_tls.host} port={bouncer_tls.port} dbname=p0 user=bouncer"
+    )
+    await outer.start()
+    try:
+        outer.test(dbname="tls_p0")
+        totals = dict(outer.admin("SHOW TOTALS"))
+        assert totals["total_server_tls_connect_count"] == 1
+        assert totals["total_server_tls_resumed_count"] == 0
+
+        # the next server connection offers the session of the first one
+        outer.admin("reconnect tls_p0")
+        outer.test(dbname="tls_p0")
+        totals = dict(outer.admin("SHOW TOTALS"))
+        assert totals["total_server_tls_connect_count"] == 2
+        assert totals["total_server_tls_resumed_count"] == 1
+    finally:
+        await outer.cleanup()
+
 
 def test_server_ssl_set_disable(pg, bouncer_tls, cert_dir):
     bouncer_tls.admin("set server_tls_sslmode = require")
@@ -489,6 +532,60 @@ def test_client_direct_ssl(bouncer, cert_dir):
     bouncer.psql_test(host="localhost", sslmode="require", sslnegotiation="direct")
 
 
+def tls_login(bouncer, context, session=None):
+    """Log in with a raw TLS socket, returns the session and whether it was
+    resumed"""
+    with socket.create_connection((bouncer.host, bouncer.port)) as sock:
+        sock.sendall(struct.pack("!ii", 8, 80877103))
+        assert sock.recv(1) == b"S"
+        with context.wrap_socket(
+            sock, server_hostname="localhost", session=session
+        ) as tls:
+            params = b"user\0bouncer\0database\0p1\0\0"
+            tls.sendall(struct.pack("!ii", len(params) + 8, 196608) + params)
+            data = b""
+            while b"Z\0\0\0\5" not in data:
+                got = tls.recv(4096)
+                assert got, data
+                data += got
+            tls.sendall(b"X\0\0\0\4")
+            return tls.session, tls.session_reused
+
+
+@pytest.mark.parametrize("version", ["TLSv1_2", "TLSv1_3"])
+def test_client_ssl_session_resumption(bouncer_tls, cert_dir, version):
+    root = cert_dir / "TestCA1" / "ca.crt"
+    key = cert_dir / "TestCA1" / "sites" / "01-localhost.key"
+    cert = cert_dir / "TestCA1" / "sites" / "01-localhost.crt"
+    bouncer_tls.write_ini(f"client_tls_key_file = {key}")
+    bouncer_tls.write_ini(f"client_tls_cert_file = {cert}")
+    bouncer_tls.write_ini(f"client_tls_ca_file = {root}")
+    bouncer_tls.write_ini(f"client_tls_sslmode = require")
+    bouncer_tls.admin("reload")
+
+    context = ssl.create_default_context(cafile=str(root))
+    context.minimum_version = getattr(ssl.TLSVersion, version)
+    context.maximum_version = getattr(ssl.TLSVersion, version)
+
+    session, resumed = tls_login(bouncer_tls, context)
+    assert not resumed
+    session, resumed = tls_login(bouncer_tls, context, session)
+    assert resumed
+
+    # sessions survive a reload that does not change the TLS settings
+    bouncer_tls.admin("reload")
+    session, resumed = tls_login(bouncer_tls, context, session)
+    assert resumed
+
+    totals = dict(bouncer_tls.admin("SHOW TOTALS"))
+    assert totals["total_client_tls_login_count"] >= 3
+    assert totals["total_client_tls_resumed_count"] == 2
+
+    bouncer_tls.admin("set client_tls_session_lifetime = 0")
+    session, resumed = tls_login(bouncer_tls, context, session)
+    assert not resumed
+
+
 def test_system_error_propagation(bouncer_tls, cert_dir):
     root = cert_dir / "TestCA1" / "ca.crt"
     key = cert_dir / "TestCA1" / "sites" / "01-localhost.key"
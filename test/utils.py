@@ -231,6 +231,13 @@ def get_tls_support():
 
 
 TLS_SUPPORT = get_tls_support()
+
+
+def get_zlib_support():
+    return get_build_feature("zlib_support", "HAVE_ZLIB")
+
+
+ZLIB_SUPPORT = get_zlib_support()
 DIRECT_TLS_SUPPORT = TLS_SUPPORT and PG_MAJOR_VERSION >= 17
 
 